@@ -0,0 +1,405 @@
+#include "CartridgeLibrary.h"
+#include "DexedLocator.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+namespace {
+
+constexpr size_t cartridgeHeaderSize = 6;
+constexpr size_t packedVoiceSize = 128;
+constexpr size_t packedNameOffset = 118;
+constexpr size_t cartridgeDataSize = packedVoiceSize * Dx7Patch::numberOfVoicesPerCartridge;
+
+// "MDXC" and the layout of the index file
+constexpr int indexMagic = 0x4344584d;
+constexpr int indexVersion = 2;
+
+bool isBulkDump(const uint8_t *bytes, size_t size)
+{
+    // F0 43 0n 09 20 00: Yamaha, 32 voices, 4096 bytes; the checksum and F7 at the end are often missing
+    return size >= static_cast<size_t>(Dx7Patch::cartridgeSize) - 2
+        && bytes[0] == 0xf0 && bytes[1] == 0x43 && bytes[3] == 0x09;
+}
+
+} // namespace
+
+CartridgeLibrary::CartridgeLibrary()
+    : juce::Thread("Cartridge library")
+{
+}
+
+CartridgeLibrary::~CartridgeLibrary()
+{
+    stopThread(5000);
+}
+
+juce::File CartridgeLibrary::getLibraryDirectory()
+{
+    juce::PropertiesFile settings(DexedLocator::getSettingsOptions());
+    const juce::String configured = settings.getValue("cartridgeLibraryPath");
+    if (configured.isNotEmpty()) {
+        return juce::File(configured);
+    }
+    return juce::File::getSpecialLocation(juce::File::userDocumentsDirectory).getChildFile("Dexed").getChildFile("Cartridges");
+}
+
+juce::File CartridgeLibrary::getIndexFile()
+{
+    return DexedLocator::getSettingsOptions().getDefaultFile().getSiblingFile("MultiDexed-Cartridges.index");
+}
+
+void CartridgeLibrary::startScan()
+{
+    if (!isThreadRunning()) {
+        scanning = true;
+        startThread(juce::Thread::Priority::low);
+    }
+}
+
+int CartridgeLibrary::getNumberOfCartridges() const
+{
+    const juce::ScopedLock lock(indexLock);
+    return static_cast<int>(std::count_if(index.cartridges.begin(), index.cartridges.end(),
+                                          [](const Cartridge &cartridge) { return cartridge.numberOfVoices > 0; }));
+}
+
+int CartridgeLibrary::getNumberOfVoices() const
+{
+    const juce::ScopedLock lock(indexLock);
+    return static_cast<int>(index.voices.size());
+}
+
+juce::Array<CartridgeLibrary::Voice> CartridgeLibrary::search(const juce::String &text, int maximumResults) const
+{
+    // The names are plain ASCII, see indexCartridge()
+    char key[nameLength + 1] = {};
+    text.trim().toLowerCase().copyToUTF8(key, sizeof(key));
+
+    juce::Array<Voice> results;
+    std::vector<uint32_t> shownChecksums;
+
+    const juce::ScopedLock lock(indexLock);
+    for (size_t i = 0; i < index.voices.size() && results.size() < maximumResults; i++) {
+        if (key[0] != 0 && std::strstr(index.searchKeys.data() + i * (nameLength + 1), key) == nullptr) {
+            continue;
+        }
+
+        // Collections repeat the same voices in many cartridges
+        const Voice &voice = index.voices[i];
+        if (std::find(shownChecksums.begin(), shownChecksums.end(), voice.checksum) != shownChecksums.end()) {
+            continue;
+        }
+        shownChecksums.push_back(voice.checksum);
+        results.add(voice);
+    }
+    return results;
+}
+
+juce::File CartridgeLibrary::getCartridgeFile(const Voice &voice) const
+{
+    const juce::ScopedLock lock(indexLock);
+    if (!juce::isPositiveAndBelow(voice.cartridge, static_cast<int>(index.cartridges.size()))) {
+        return {};
+    }
+    return index.cartridges[static_cast<size_t>(voice.cartridge)].file;
+}
+
+bool CartridgeLibrary::readCartridge(const Voice &voice, juce::MemoryBlock &cartridge) const
+{
+    Cartridge indexed;
+    {
+        const juce::ScopedLock lock(indexLock);
+        if (!juce::isPositiveAndBelow(voice.cartridge, static_cast<int>(index.cartridges.size()))) {
+            return false;
+        }
+        indexed = index.cartridges[static_cast<size_t>(voice.cartridge)];
+    }
+
+    if (indexed.file.getLastModificationTime().toMilliseconds() != indexed.modificationTime) {
+        return false;
+    }
+
+    juce::MemoryMappedFile mappedFile(indexed.file, juce::MemoryMappedFile::readOnly);
+    const auto *bytes = static_cast<const uint8_t *>(mappedFile.getData());
+    const size_t size = mappedFile.getSize();
+    if (bytes == nullptr || static_cast<juce::int64>(size) != indexed.size || !isBulkDump(bytes, size)) {
+        return false;
+    }
+
+    const uint8_t *data = bytes + cartridgeHeaderSize;
+    if (getChecksum(data + static_cast<size_t>(voice.voiceIndex) * packedVoiceSize) != voice.checksum) {
+        return false;
+    }
+
+    // Dexed expects the complete dump, so the checksum and F7 are made up if they are missing
+    cartridge.setSize(static_cast<size_t>(Dx7Patch::cartridgeSize));
+    auto *out = static_cast<uint8_t *>(cartridge.getData());
+    std::memcpy(out, bytes, cartridgeHeaderSize + cartridgeDataSize);
+
+    int sum = 0;
+    for (size_t i = 0; i < cartridgeDataSize; i++) {
+        sum += data[i] & 0x7f;
+    }
+    out[cartridgeHeaderSize + cartridgeDataSize] = static_cast<uint8_t>((128 - (sum & 0x7f)) & 0x7f);
+    out[cartridgeHeaderSize + cartridgeDataSize + 1] = 0xf7;
+    return true;
+}
+
+bool CartridgeLibrary::makeDexedState(const juce::MemoryBlock &currentState, const juce::MemoryBlock &cartridge,
+                                      int voiceIndex, juce::MemoryBlock &newState)
+{
+    Dx7Patch patch;
+    if (!patch.readFromCartridge(cartridge.getData(), cartridge.getSize(), voiceIndex)) {
+        return false;
+    }
+
+    auto xml = juce::AudioProcessor::getXmlFromBinary(currentState.getData(), static_cast<int>(currentState.getSize()));
+    if (xml == nullptr || !xml->hasTagName("dexedState")) {
+        return false;
+    }
+
+    auto *blob = xml->getChildByName("dexedBlob");
+    if (blob == nullptr) {
+        return false;
+    }
+
+    // The voice as edited, followed by the operator switches, see Dx7Patch::readFromDexedState()
+    juce::MemoryBlock program(patch.data, sizeof(patch.data));
+    const uint8_t switches[Dx7Patch::numberOfOperators] = { 1, 1, 1, 1, 1, 1 };
+    program.append(switches, sizeof(switches));
+
+    juce::NamedValueSet values;
+    values.setFromXmlAttributes(*blob);
+    values.set("sysex", juce::var(cartridge));
+    values.set("program", juce::var(program));
+    values.copyToXmlAttributes(*blob);
+    xml->setAttribute("currentProgram", voiceIndex);
+
+    newState.reset();
+    juce::AudioProcessor::copyXmlToBinary(*xml, newState);
+    return true;
+}
+
+void CartridgeLibrary::Index::addVoice(const Voice &voice)
+{
+    voices.push_back(voice);
+    for (int i = 0; i <= nameLength; i++) {
+        searchKeys.push_back(static_cast<char>(juce::CharacterFunctions::toLowerCase(static_cast<juce::juce_wchar>(voice.name[i]))));
+    }
+}
+
+uint32_t CartridgeLibrary::getChecksum(const uint8_t *packedVoice)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < packedVoiceSize; i++) {
+        hash = (hash ^ packedVoice[i]) * 16777619u;
+    }
+    return hash;
+}
+
+bool CartridgeLibrary::indexCartridge(const void *data, size_t size, int cartridgeIndex, Index &index)
+{
+    const auto *bytes = static_cast<const uint8_t *>(data);
+    if (bytes == nullptr || !isBulkDump(bytes, size)) {
+        return false;
+    }
+
+    for (int v = 0; v < Dx7Patch::numberOfVoicesPerCartridge; v++) {
+        const uint8_t *packed = bytes + cartridgeHeaderSize + static_cast<size_t>(v) * packedVoiceSize;
+
+        Voice voice;
+        voice.cartridge = cartridgeIndex;
+        voice.voiceIndex = v;
+        voice.checksum = getChecksum(packed);
+
+        // Some editors leave garbage in the names
+        for (int i = 0; i < nameLength; i++) {
+            const char c = static_cast<char>(packed[packedNameOffset + static_cast<size_t>(i)] & 0x7f);
+            voice.name[i] = c >= ' ' && c < 0x7f ? c : ' ';
+        }
+        for (int i = nameLength - 1; i >= 0 && voice.name[i] == ' '; i--) {
+            voice.name[i] = 0;
+        }
+
+        index.addVoice(voice);
+    }
+    return true;
+}
+
+void CartridgeLibrary::publish(Index &&newIndex)
+{
+    {
+        const juce::ScopedLock lock(indexLock);
+        std::swap(index, newIndex);
+    }
+
+    // Freed here rather than under the lock
+    newIndex = {};
+    sendChangeMessage();
+}
+
+void CartridgeLibrary::run()
+{
+    // What was found last time can be searched while the folder is scanned
+    if (!hasReadIndexFile) {
+        hasReadIndexFile = true;
+
+        Index previous;
+        if (readIndexFile(previous)) {
+            publish(std::move(previous));
+        }
+    }
+
+    // Files of the previous index by path
+    std::map<juce::String, Cartridge> previousCartridges;
+    std::map<juce::String, std::vector<Voice>> previousVoices;
+    {
+        const juce::ScopedLock lock(indexLock);
+        for (const Voice &voice : index.voices) {
+            previousVoices[index.cartridges[static_cast<size_t>(voice.cartridge)].file.getFullPathName()].push_back(voice);
+        }
+        for (const Cartridge &cartridge : index.cartridges) {
+            previousCartridges[cartridge.file.getFullPathName()] = cartridge;
+        }
+    }
+
+    juce::Array<juce::File> files;
+    for (const auto &entry : juce::RangedDirectoryIterator(getLibraryDirectory(), true, "*.syx;*.SYX", juce::File::findFiles)) {
+        if (threadShouldExit()) {
+            return;
+        }
+        files.add(entry.getFile());
+    }
+
+    // The order of the results does not depend on the file system
+    std::sort(files.begin(), files.end(), [](const juce::File &a, const juce::File &b) {
+        return a.getFullPathName().compareNatural(b.getFullPathName()) < 0;
+    });
+
+    Index newIndex;
+    bool hasChanged = files.size() != static_cast<int>(previousCartridges.size());
+
+    for (const juce::File &file : files) {
+        if (threadShouldExit()) {
+            return;
+        }
+
+        Cartridge cartridge;
+        cartridge.file = file;
+        cartridge.size = file.getSize();
+        cartridge.modificationTime = file.getLastModificationTime().toMilliseconds();
+        const int cartridgeIndex = static_cast<int>(newIndex.cartridges.size());
+
+        const auto previous = previousCartridges.find(file.getFullPathName());
+        if (previous != previousCartridges.end() && previous->second.size == cartridge.size
+            && previous->second.modificationTime == cartridge.modificationTime) {
+            for (Voice voice : previousVoices[file.getFullPathName()]) {
+                voice.cartridge = cartridgeIndex;
+                newIndex.addVoice(voice);
+            }
+            cartridge.numberOfVoices = previous->second.numberOfVoices;
+            newIndex.cartridges.push_back(cartridge);
+            continue;
+        }
+
+        // New or changed; the mapping spares reading the file into memory of our own
+        hasChanged = true;
+        juce::MemoryMappedFile mappedFile(file, juce::MemoryMappedFile::readOnly);
+        if (indexCartridge(mappedFile.getData(), mappedFile.getSize(), cartridgeIndex, newIndex)) {
+            cartridge.numberOfVoices = Dx7Patch::numberOfVoicesPerCartridge;
+        }
+        newIndex.cartridges.push_back(cartridge);
+    }
+
+    if (hasChanged) {
+        writeIndexFile(newIndex);
+    }
+
+    scanning = false;
+    if (hasChanged) {
+        publish(std::move(newIndex));
+    } else {
+        sendChangeMessage();
+    }
+}
+
+bool CartridgeLibrary::readIndexFile(Index &index)
+{
+    const juce::File file = getIndexFile();
+    juce::MemoryMappedFile mappedFile(file, juce::MemoryMappedFile::readOnly);
+    if (mappedFile.getData() == nullptr) {
+        return false;
+    }
+
+    juce::MemoryInputStream input(mappedFile.getData(), mappedFile.getSize(), false);
+    if (input.readInt() != indexMagic || input.readInt() != indexVersion) {
+        return false;
+    }
+
+    const int numberOfCartridges = input.readInt();
+    for (int c = 0; c < numberOfCartridges; c++) {
+        Cartridge cartridge;
+        cartridge.file = juce::File(input.readString());
+        cartridge.size = input.readInt64();
+        cartridge.modificationTime = input.readInt64();
+        cartridge.numberOfVoices = input.readInt();
+        if (input.isExhausted() && c + 1 < numberOfCartridges) {
+            // Truncated
+            index = {};
+            return false;
+        }
+        if (!juce::isPositiveAndNotGreaterThan(cartridge.numberOfVoices, Dx7Patch::numberOfVoicesPerCartridge)) {
+            index = {};
+            return false;
+        }
+
+        for (int v = 0; v < cartridge.numberOfVoices; v++) {
+            // Reads past the end give zeros rather than failing, so every voice must be there in full
+            if (input.getNumBytesRemaining() < nameLength + static_cast<juce::int64>(sizeof(juce::int32))) {
+                index = {};
+                return false;
+            }
+
+            Voice voice;
+            voice.cartridge = c;
+            voice.voiceIndex = v;
+            input.read(voice.name, nameLength);
+            voice.checksum = static_cast<uint32_t>(input.readInt());
+            index.addVoice(voice);
+        }
+        index.cartridges.push_back(cartridge);
+    }
+    return true;
+}
+
+void CartridgeLibrary::writeIndexFile(const Index &index)
+{
+    juce::MemoryOutputStream output;
+    output.writeInt(indexMagic);
+    output.writeInt(indexVersion);
+    output.writeInt(static_cast<int>(index.cartridges.size()));
+
+    size_t firstVoice = 0;
+    for (const Cartridge &cartridge : index.cartridges) {
+        output.writeString(cartridge.file.getFullPathName());
+        output.writeInt64(cartridge.size);
+        output.writeInt64(cartridge.modificationTime);
+        output.writeInt(cartridge.numberOfVoices);
+
+        for (size_t v = 0; v < static_cast<size_t>(cartridge.numberOfVoices); v++) {
+            const Voice &voice = index.voices[firstVoice + v];
+            output.write(voice.name, nameLength);
+            output.writeInt(static_cast<int>(voice.checksum));
+        }
+        firstVoice += static_cast<size_t>(cartridge.numberOfVoices);
+    }
+
+    // Another plugin in another process may be reading it
+    juce::TemporaryFile temporaryFile(getIndexFile());
+    if (temporaryFile.getFile().replaceWithData(output.getData(), output.getDataSize())) {
+        temporaryFile.overwriteTargetFileWithTemporary();
+    }
+}
@@ -0,0 +1,118 @@
+/*
+  ==============================================================================
+
+    Index of the voices in a folder of DX7 cartridges, for finding a voice
+    by name and loading it into all instances at once.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "Dx7Patch.h"
+
+#include <atomic>
+#include <vector>
+
+//==============================================================================
+/**
+    Keeps the name and a checksum of every voice of the 32 voice bulk dumps
+    (.syx) below the library folder, the "cartridgeLibraryPath" entry of
+    MultiDexed.settings, which defaults to Dexed's own Cartridges folder.
+
+    The index is kept in MultiDexed-Cartridges.index next to the settings,
+    along with the size and modification time of every file; startScan()
+    reads it and then brings it up to date in the background, mapping only
+    the files that are new or have changed. A change message is sent
+    whenever a new index can be searched.
+
+    Shared by all plugins in the process through juce::SharedResourcePointer;
+    the methods are for the message thread.
+ */
+class CartridgeLibrary : public juce::ChangeBroadcaster,
+                         private juce::Thread
+{
+public:
+    CartridgeLibrary();
+    ~CartridgeLibrary() override;
+
+    static constexpr int nameLength = 10;
+
+    struct Voice
+    {
+        int cartridge = -1;   // Position of the file in the index
+        int voiceIndex = 0;   // 0 to 31
+        uint32_t checksum = 0; // Of the packed voice; equal voices in several cartridges have the same one
+        char name[nameLength + 1] = {};
+    };
+
+    // The folder below which the cartridges are looked for
+    static juce::File getLibraryDirectory();
+
+    // Reads the index if that has not been done yet and rescans the folder; does nothing while scanning
+    void startScan();
+    bool isScanning() const { return scanning.load(); }
+
+    int getNumberOfCartridges() const;
+    int getNumberOfVoices() const;
+
+    // Voices whose names contain text, ignoring case, each voice only once, in the order of the files
+    juce::Array<Voice> search(const juce::String &text, int maximumResults) const;
+
+    juce::File getCartridgeFile(const Voice &voice) const;
+
+    // The bulk dump holding the voice; false if the file changed since it was indexed
+    bool readCartridge(const Voice &voice, juce::MemoryBlock &cartridge) const;
+
+    // A Dexed state that differs from currentState in its cartridge and current voice
+    static bool makeDexedState(const juce::MemoryBlock &currentState, const juce::MemoryBlock &cartridge,
+                               int voiceIndex, juce::MemoryBlock &newState);
+
+private:
+    // Files that are not bulk dumps are kept with no voices, so that they are not read again until they change
+    struct Cartridge
+    {
+        juce::File file;
+        juce::int64 size = 0;
+        juce::int64 modificationTime = 0;
+        int numberOfVoices = 0;
+    };
+
+    // Voices are stored by cartridge, numberOfVoices for each
+    struct Index
+    {
+        std::vector<Cartridge> cartridges;
+        std::vector<Voice> voices;
+
+        // The lowercase names of the voices, nameLength + 1 bytes each, for search()
+        std::vector<char> searchKeys;
+
+        void addVoice(const Voice &voice);
+    };
+
+    void run() override;
+
+    // Replaces the index that is searched and tells the listeners
+    void publish(Index &&newIndex);
+
+    // Adds the voices of a bulk dump; false if the data is not one
+    static bool indexCartridge(const void *data, size_t size, int cartridgeIndex, Index &index);
+
+    static uint32_t getChecksum(const uint8_t *packedVoice);
+
+    static juce::File getIndexFile();
+    static bool readIndexFile(Index &index);
+    static void writeIndexFile(const Index &index);
+
+    mutable juce::CriticalSection indexLock;
+    Index index;
+
+    // Set once the index file has been read
+    bool hasReadIndexFile = false;
+
+    // Cleared before the change message that ends a scan
+    std::atomic<bool> scanning { false };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CartridgeLibrary)
+};
@@ -0,0 +1,125 @@
+#include "CartridgeLibraryPanel.h"
+
+CartridgeLibraryPanel::CartridgeLibraryPanel()
+{
+    addAndMakeVisible(searchBox);
+    searchBox.setTextToShowWhenEmpty("Search voices", juce::Colours::grey);
+    searchBox.onTextChange = [this] {
+        updateResults();
+    };
+    searchBox.onReturnKey = [this] {
+        loadVoice(juce::jmax(0, resultList.getSelectedRow()));
+    };
+
+    addAndMakeVisible(resultList);
+    resultList.setRowHeight(rowHeight);
+
+    addAndMakeVisible(statusLabel);
+
+    library->addChangeListener(this);
+    updateResults();
+}
+
+CartridgeLibraryPanel::~CartridgeLibraryPanel()
+{
+    library->removeChangeListener(this);
+}
+
+void CartridgeLibraryPanel::paint(juce::Graphics &g)
+{
+    // Lies over the Dexed editor like the performance HUD
+    g.fillAll(juce::Colours::black.withAlpha(0.8f));
+}
+
+void CartridgeLibraryPanel::resized()
+{
+    auto area = getLocalBounds().reduced(10);
+    auto top = area.removeFromTop(24);
+    searchBox.setBounds(top.removeFromLeft(juce::jmin(300, top.getWidth())));
+    top.removeFromLeft(10);
+    statusLabel.setBounds(top);
+    area.removeFromTop(6);
+    resultList.setBounds(area);
+}
+
+void CartridgeLibraryPanel::visibilityChanged()
+{
+    // Picks up cartridges added since the panel was last shown
+    if (isVisible()) {
+        library->startScan();
+        updateStatus();
+        searchBox.grabKeyboardFocus();
+    }
+}
+
+void CartridgeLibraryPanel::changeListenerCallback(juce::ChangeBroadcaster *)
+{
+    updateResults();
+}
+
+int CartridgeLibraryPanel::getNumRows()
+{
+    return results.size();
+}
+
+void CartridgeLibraryPanel::paintListBoxItem(int rowNumber, juce::Graphics &g, int width, int height, bool rowIsSelected)
+{
+    if (!juce::isPositiveAndBelow(rowNumber, results.size())) {
+        return;
+    }
+
+    if (rowIsSelected) {
+        g.fillAll(juce::Colours::darkslateblue);
+    }
+
+    const CartridgeLibrary::Voice &voice = results.getReference(rowNumber);
+    g.setColour(juce::Colours::white);
+    g.setFont(juce::Font(juce::Font::getDefaultMonospacedFontName(), 13.0f, juce::Font::plain));
+    g.drawText(voice.name, 4, 0, 100, height, juce::Justification::centredLeft);
+
+    g.setColour(juce::Colours::lightgrey);
+    g.drawText(library->getCartridgeFile(voice).getFileName() + " #" + juce::String(voice.voiceIndex + 1),
+               110, 0, juce::jmax(0, width - 114), height, juce::Justification::centredLeft);
+}
+
+void CartridgeLibraryPanel::listBoxItemDoubleClicked(int row, const juce::MouseEvent &)
+{
+    loadVoice(row);
+}
+
+void CartridgeLibraryPanel::updateResults()
+{
+    results = library->search(searchBox.getText(), maximumNumberOfResults);
+    resultList.updateContent();
+    resultList.repaint();
+    updateStatus();
+}
+
+void CartridgeLibraryPanel::updateStatus()
+{
+    juce::String status;
+    status << juce::String(library->getNumberOfVoices()) << " voices in "
+           << juce::String(library->getNumberOfCartridges()) << " cartridges";
+    if (library->isScanning()) {
+        status << ", scanning " << CartridgeLibrary::getLibraryDirectory().getFullPathName();
+    }
+    statusLabel.setText(status, juce::dontSendNotification);
+}
+
+void CartridgeLibraryPanel::loadVoice(int row)
+{
+    if (!juce::isPositiveAndBelow(row, results.size()) || onLoadVoice == nullptr) {
+        return;
+    }
+
+    const CartridgeLibrary::Voice voice = results[row];
+    juce::MemoryBlock cartridge;
+    if (!library->readCartridge(voice, cartridge) || !onLoadVoice(cartridge, voice.voiceIndex)) {
+        // Most likely the file changed since it was indexed
+        statusLabel.setText("Could not load " + juce::String(voice.name) + ", rescanning", juce::dontSendNotification);
+        library->startScan();
+        return;
+    }
+
+    statusLabel.setText("Loaded " + juce::String(voice.name), juce::dontSendNotification);
+}
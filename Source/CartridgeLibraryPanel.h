@@ -0,0 +1,63 @@
+/*
+  ==============================================================================
+
+    Panel for searching the cartridge library by voice name and loading a
+    voice into all instances.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "CartridgeLibrary.h"
+
+//==============================================================================
+/**
+    Lists the voices of the CartridgeLibrary whose names contain the text of
+    the search box. Double-clicking a voice, or pressing return in the search
+    box, hands the cartridge of the selected voice to onLoadVoice. The library
+    is scanned whenever the panel is shown.
+ */
+class CartridgeLibraryPanel : public juce::Component,
+                              private juce::ChangeListener,
+                              private juce::ListBoxModel
+{
+public:
+    CartridgeLibraryPanel();
+    ~CartridgeLibraryPanel() override;
+
+    // Loads the voice with the index in the cartridge; false if it could not
+    std::function<bool(const juce::MemoryBlock &cartridge, int voiceIndex)> onLoadVoice;
+
+    void paint(juce::Graphics &g) override;
+    void resized() override;
+    void visibilityChanged() override;
+
+private:
+    // A new index can be searched
+    void changeListenerCallback(juce::ChangeBroadcaster *source) override;
+
+    int getNumRows() override;
+    void paintListBoxItem(int rowNumber, juce::Graphics &g, int width, int height, bool rowIsSelected) override;
+    void listBoxItemDoubleClicked(int row, const juce::MouseEvent &event) override;
+
+    void updateResults();
+    void updateStatus();
+    void loadVoice(int row);
+
+    juce::SharedResourcePointer<CartridgeLibrary> library;
+
+    juce::TextEditor searchBox;
+    juce::ListBox resultList { {}, this };
+    juce::Label statusLabel;
+
+    juce::Array<CartridgeLibrary::Voice> results;
+
+    // More would not be looked through anyway
+    static constexpr int maximumNumberOfResults = 500;
+
+    static constexpr int rowHeight = 18;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CartridgeLibraryPanel)
+};
@@ -0,0 +1,91 @@
+#include "ControlCommandQueue.h"
+
+ControlCommandQueue::ControlCommandQueue(int capacity)
+    : commands(capacity),
+      storage(static_cast<size_t>(capacity)),
+      garbage(capacity),
+      garbageStorage(static_cast<size_t>(capacity), nullptr)
+{
+}
+
+ControlCommandQueue::~ControlCommandQueue()
+{
+    // Nothing runs on the audio thread any more, so whatever is left can be freed here
+    applyAll([this](const Command &command) {
+        if (command.state != nullptr) {
+            retire(command.state);
+        }
+        return true;
+    });
+    collectGarbage();
+}
+
+bool ControlCommandQueue::post(Type type, int index, float value)
+{
+    Command command;
+    command.type = type;
+    command.index = index;
+    command.value = value;
+    return push(command);
+}
+
+bool ControlCommandQueue::post(Type type, std::unique_ptr<juce::MemoryBlock> state)
+{
+    Command command;
+    command.type = type;
+    command.state = state.get();
+
+    if (!push(command)) {
+        return false;
+    }
+
+    // The queue owns the blob now
+    state.release();
+    return true;
+}
+
+bool ControlCommandQueue::push(const Command &command)
+{
+    const juce::SpinLock::ScopedLockType lock(producerLock);
+
+    // Freeing first keeps the number of blobs in flight below the capacity of
+    // the garbage queue, so the audio thread can always retire them
+    freeRetiredStates();
+
+    // Full while a long state load holds up the audio thread; the callers handle it
+    if (commands.getFreeSpace() == 0) {
+        return false;
+    }
+
+    if (command.state != nullptr) {
+        pendingStates.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    const auto scope = commands.write(1);
+    scope.forEach([this, &command](int index) { storage[static_cast<size_t>(index)] = command; });
+    return true;
+}
+
+void ControlCommandQueue::retire(juce::MemoryBlock *state)
+{
+    pendingStates.fetch_sub(1, std::memory_order_acq_rel);
+
+    const auto scope = garbage.write(1);
+    jassert(scope.blockSize1 + scope.blockSize2 == 1);
+    scope.forEach([this, state](int index) { garbageStorage[static_cast<size_t>(index)] = state; });
+}
+
+void ControlCommandQueue::collectGarbage()
+{
+    const juce::SpinLock::ScopedLockType lock(producerLock);
+    freeRetiredStates();
+}
+
+void ControlCommandQueue::freeRetiredStates()
+{
+    const auto scope = garbage.read(garbage.getNumReady());
+    scope.forEach([this](int index) {
+        delete garbageStorage[static_cast<size_t>(index)];
+        garbageStorage[static_cast<size_t>(index)] = nullptr;
+    });
+}
@@ -0,0 +1,101 @@
+/*
+  ==============================================================================
+
+    Queue for control operations that the message thread (or whichever thread
+    the host uses for them) hands to the audio thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <memory>
+
+//==============================================================================
+/**
+    A wait-free single-producer/single-consumer queue of control commands.
+
+    Commands are posted from outside the audio thread and applied by the audio
+    thread at the start of a block, in the order they were posted. Heavy
+    payloads such as state blobs are prepared by the producer and passed by
+    pointer; after use the audio thread hands them back through a second queue
+    so that they are freed by the producer, never on the audio thread.
+
+    Producers are serialized with a lock that the audio thread never touches,
+    so several threads may post, while the consumer side stays wait-free.
+ */
+class ControlCommandQueue
+{
+public:
+    enum class Type
+    {
+        setProgram, // state: ParameterSync::Change records of the program that instance 0 is switching to
+        setNumberOfInstances, // index: the number of instances to render, including instance 0
+        applyState, // state: blob to load into all instances
+        applyStateToFollowers, // state: blob to load into all instances but instance 0
+        applyOverrides, // state: SessionState::Override records to set in the followers
+        setFmPatch, // state: the Dx7Patch for the built-in FM engine
+        setLayerVoices // index: the layer, value: the number of its voices to render
+    };
+
+    struct Command
+    {
+        Type type;
+        int index = 0;
+        float value = 0.0f;
+        juce::MemoryBlock *state = nullptr;
+    };
+
+    explicit ControlCommandQueue(int capacity = 256);
+    ~ControlCommandQueue();
+
+    // Posts a command without a payload; returns false if the queue is full. Not for the audio thread.
+    bool post(Type type, int index = 0, float value = 0.0f);
+
+    // Posts a command that carries a state blob; returns false if the queue is full. Not for the audio thread.
+    bool post(Type type, std::unique_ptr<juce::MemoryBlock> state);
+
+    // Calls apply for the queued commands, oldest first, until apply returns false.
+    // Audio thread only; does not lock or allocate.
+    template<typename Function>
+    void applyAll(Function &&apply)
+    {
+        bool keepGoing = true;
+        while (keepGoing && commands.getNumReady() > 0) {
+            const auto scope = commands.read(1);
+            scope.forEach([this, &apply, &keepGoing](int index) {
+                keepGoing = apply(storage[static_cast<size_t>(index)]);
+            });
+        }
+    }
+
+    // Hands the state blob of an applied command back to be freed. Audio thread only.
+    void retire(juce::MemoryBlock *state);
+
+    // Number of state blobs that were posted but not applied yet
+    int getNumberOfPendingStates() const { return pendingStates.load(std::memory_order_acquire); }
+
+    // Frees the state blobs that the audio thread has finished with. Not for the audio thread.
+    void collectGarbage();
+
+private:
+    bool push(const Command &command);
+
+    // Same as collectGarbage(), with producerLock already held
+    void freeRetiredStates();
+
+    juce::AbstractFifo commands;
+    std::vector<Command> storage;
+
+    // State blobs that were applied and can be freed
+    juce::AbstractFifo garbage;
+    std::vector<juce::MemoryBlock *> garbageStorage;
+
+    std::atomic<int> pendingStates { 0 };
+
+    juce::SpinLock producerLock;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ControlCommandQueue)
+};
@@ -0,0 +1,115 @@
+#include "DexedLocator.h"
+
+juce::PropertiesFile::Options DexedLocator::getSettingsOptions()
+{
+    juce::PropertiesFile::Options options;
+    options.applicationName = "MultiDexed";
+    options.filenameSuffix = ".settings";
+    options.osxLibrarySubFolder = "Application Support";
+#if JUCE_LINUX || JUCE_BSD
+    options.folderName = "~/.config";
+#else
+    options.folderName = "";
+#endif
+    return options;
+}
+
+juce::FileSearchPath DexedLocator::getSearchPath()
+{
+    juce::PropertiesFile settings(getSettingsOptions());
+    const juce::String configured = settings.getValue("dexedSearchPath");
+    if (configured.isNotEmpty()) {
+        return juce::FileSearchPath(configured);
+    }
+
+    juce::FileSearchPath searchPath;
+#if JUCE_WINDOWS
+    searchPath.add(juce::File("C:\\Program Files\\Common Files\\VST3"));
+#elif JUCE_MAC
+    searchPath.add(juce::File("~/Library/Audio/Plug-Ins/VST3"));
+    searchPath.add(juce::File("/Library/Audio/Plug-Ins/VST3"));
+#elif JUCE_BSD
+    searchPath.add(juce::File("~/.vst3"));
+    searchPath.add(juce::File("/usr/local/lib/vst3"));
+#else
+    searchPath.add(juce::File("~/.vst3"));
+    searchPath.add(juce::File("/usr/lib/vst3"));
+    searchPath.add(juce::File("/usr/local/lib/vst3"));
+#endif
+    return searchPath;
+}
+
+juce::File DexedLocator::findModule(const juce::FileSearchPath &searchPath)
+{
+    for (int i = 0; i < searchPath.getNumPaths(); i++) {
+        const juce::File bundle = searchPath[i].getChildFile("Dexed.vst3");
+
+#if JUCE_WINDOWS
+        // Bundles on Windows are scanned through the module inside them
+        const juce::File module = bundle.getChildFile("Contents").getChildFile("x86_64-win").getChildFile("Dexed.vst3");
+        if (module.existsAsFile()) {
+            return module;
+        }
+#endif
+
+        if (bundle.exists()) {
+            return bundle;
+        }
+    }
+    return {};
+}
+
+juce::String DexedLocator::getModuleSignature(const juce::File &module)
+{
+    int64_t size = module.existsAsFile() ? module.getSize() : 0;
+    juce::int64 modified = module.getLastModificationTime().toMilliseconds();
+
+    if (module.isDirectory()) {
+        for (const auto &entry : juce::RangedDirectoryIterator(module, true, "*", juce::File::findFiles)) {
+            size += entry.getFileSize();
+            modified = juce::jmax(modified, entry.getModificationTime().toMilliseconds());
+        }
+    }
+
+    return juce::String(size) + ":" + juce::String(modified);
+}
+
+juce::File DexedLocator::getCacheFile()
+{
+    return getSettingsOptions().getDefaultFile().getSiblingFile("MultiDexed-Dexed.xml");
+}
+
+std::unique_ptr<juce::PluginDescription> DexedLocator::getDescription(const juce::File &module, juce::AudioPluginFormat &format)
+{
+    const juce::String path = module.getFullPathName();
+    const juce::String signature = getModuleSignature(module);
+
+    // The cache is used if it describes this very module
+    const juce::File cacheFile = getCacheFile();
+    if (auto cache = juce::parseXML(cacheFile)) {
+        if (cache->getStringAttribute("module") == path && cache->getStringAttribute("signature") == signature) {
+            juce::KnownPluginList cachedList;
+            cachedList.recreateFromXml(*cache);
+            if (cachedList.getNumTypes() > 0) {
+                return std::make_unique<juce::PluginDescription>(cachedList.getTypes()[0]);
+            }
+        }
+    }
+
+    juce::OwnedArray<juce::PluginDescription> pluginDescriptions;
+    juce::KnownPluginList pluginList;
+    pluginList.scanAndAddFile(path, true, pluginDescriptions, format);
+    if (pluginDescriptions.size() == 0) {
+        return nullptr;
+    }
+
+    // Written through a temporary file, so that other instances never read half of it
+    if (auto xml = pluginList.createXml()) {
+        xml->setAttribute("module", path);
+        xml->setAttribute("signature", signature);
+        cacheFile.getParentDirectory().createDirectory();
+        xml->writeTo(cacheFile);
+    }
+
+    return std::make_unique<juce::PluginDescription>(*pluginDescriptions[0]);
+}
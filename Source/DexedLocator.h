@@ -0,0 +1,45 @@
+/*
+  ==============================================================================
+
+    Finds the Dexed VST3 module, and remembers its plugin description so
+    that it does not have to be scanned again every time.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    Looks for Dexed along a search path and caches the result of scanning it.
+
+    The search path is the "dexedSearchPath" entry of MultiDexed.settings, a
+    list of folders separated by ';', and defaults to the usual VST3 folders
+    of the platform. The description of the module that was found is kept in
+    MultiDexed-Dexed.xml next to the settings, in the format of
+    KnownPluginList, along with the path, size and modification time of the
+    module; it is used for as long as these still match.
+ */
+class DexedLocator
+{
+public:
+    // The folders Dexed.vst3 is looked for in, in order
+    static juce::FileSearchPath getSearchPath();
+
+    // The first Dexed module on the search path, or a nonexistent file
+    static juce::File findModule(const juce::FileSearchPath &searchPath);
+
+    // Scans module unless the cache still describes it; nullptr if it is not a plugin of format
+    static std::unique_ptr<juce::PluginDescription> getDescription(const juce::File &module, juce::AudioPluginFormat &format);
+
+    // Where the settings and the cache are kept; shared with the standalone application
+    static juce::PropertiesFile::Options getSettingsOptions();
+
+private:
+    // Size and modification time of the module; for a bundle, the total size and latest time of its files
+    static juce::String getModuleSignature(const juce::File &module);
+
+    static juce::File getCacheFile();
+};
@@ -0,0 +1,161 @@
+#include "Dx7Patch.h"
+
+#include <cstring>
+
+namespace {
+
+constexpr size_t cartridgeHeaderSize = 6;
+constexpr size_t packedVoiceSize = 128;
+
+// Dexed keeps the operator switches right after the voice
+constexpr size_t dexedProgramSize = Dx7Patch::voiceSize + Dx7Patch::numberOfOperators;
+
+// VMEM (packed, as in cartridges) to VCED (unpacked, as in single voice dumps)
+void unpackVoice(const uint8_t *packed, uint8_t *voice)
+{
+    for (int op = 0; op < Dx7Patch::numberOfOperators; op++) {
+        const uint8_t *in = packed + op * 17;
+        uint8_t *out = voice + op * 21;
+
+        // Rates, levels, break point and depths
+        for (int i = 0; i < 11; i++) {
+            out[i] = in[i] & 0x7f;
+        }
+
+        out[11] = in[11] & 3;
+        out[12] = (in[11] >> 2) & 3;
+        out[13] = in[12] & 7;
+        out[14] = in[13] & 3;
+        out[15] = (in[13] >> 2) & 7;
+        out[16] = in[14] & 0x7f;
+        out[17] = in[15] & 1;
+        out[18] = (in[15] >> 1) & 0x1f;
+        out[19] = in[16] & 0x7f;
+        out[20] = (in[12] >> 3) & 0x0f;
+    }
+
+    // Pitch envelope
+    for (int i = 0; i < 8; i++) {
+        voice[126 + i] = packed[102 + i] & 0x7f;
+    }
+
+    voice[134] = packed[110] & 0x1f;
+    voice[135] = packed[111] & 7;
+    voice[136] = (packed[111] >> 3) & 1;
+
+    // LFO speed, delay and modulation depths
+    for (int i = 0; i < 4; i++) {
+        voice[137 + i] = packed[112 + i] & 0x7f;
+    }
+
+    voice[141] = packed[116] & 1;
+    voice[142] = (packed[116] >> 1) & 7;
+    voice[143] = (packed[116] >> 4) & 7;
+    voice[144] = packed[117] & 0x7f;
+
+    for (int i = 0; i < 10; i++) {
+        voice[145 + i] = packed[118 + i] & 0x7f;
+    }
+}
+
+} // namespace
+
+juce::String Dx7Patch::getName() const
+{
+    return juce::String(reinterpret_cast<const char *>(data + 145), 10).trimEnd();
+}
+
+bool Dx7Patch::readFromDexedState(const juce::MemoryBlock &state)
+{
+    auto xml = juce::AudioProcessor::getXmlFromBinary(state.getData(), static_cast<int>(state.getSize()));
+    if (xml == nullptr || !xml->hasTagName("dexedState")) {
+        return false;
+    }
+
+    auto *blob = xml->getChildByName("dexedBlob");
+    if (blob == nullptr) {
+        return false;
+    }
+
+    // The blobs are stored as base64 attributes, which NamedValueSet decodes
+    juce::NamedValueSet values;
+    values.setFromXmlAttributes(*blob);
+
+    // "program" is the voice as edited, "sysex" the cartridge it came from
+    if (const auto *program = values["program"].getBinaryData()) {
+        if (program->getSize() >= static_cast<size_t>(voiceSize)) {
+            std::memcpy(data, program->getData(), static_cast<size_t>(voiceSize));
+
+            operatorsEnabled = 0x3f;
+            if (program->getSize() >= dexedProgramSize) {
+                const auto *switches = static_cast<const uint8_t *>(program->getData()) + voiceSize;
+                operatorsEnabled = 0;
+                for (int op = 0; op < numberOfOperators; op++) {
+                    if (switches[op] != 0) {
+                        operatorsEnabled |= static_cast<uint8_t>(1 << op);
+                    }
+                }
+            }
+            return true;
+        }
+    }
+
+    if (const auto *sysex = values["sysex"].getBinaryData()) {
+        return readFromCartridge(sysex->getData(), sysex->getSize(), xml->getIntAttribute("currentProgram"));
+    }
+
+    return false;
+}
+
+bool Dx7Patch::readFromCartridge(const void *sysex, size_t size, int voiceIndex)
+{
+    if (size < static_cast<size_t>(cartridgeSize) - 2 || !juce::isPositiveAndBelow(voiceIndex, numberOfVoicesPerCartridge)) {
+        return false;
+    }
+
+    const auto *bytes = static_cast<const uint8_t *>(sysex);
+
+    // F0 43 0n 09 20 00: Yamaha, 32 voices, 4096 bytes
+    if (bytes[0] != 0xf0 || bytes[1] != 0x43 || bytes[3] != 0x09) {
+        return false;
+    }
+
+    unpackVoice(bytes + cartridgeHeaderSize + static_cast<size_t>(voiceIndex) * packedVoiceSize, data);
+    operatorsEnabled = 0x3f;
+    return true;
+}
+
+void Dx7Patch::setToInitVoice()
+{
+    std::memset(data, 0, sizeof(data));
+
+    for (int op = 0; op < numberOfOperators; op++) {
+        uint8_t *out = data + op * 21;
+        for (int i = 0; i < 4; i++) {
+            out[i] = 99;
+        }
+        out[4] = 99;
+        out[5] = 99;
+        out[6] = 99;
+        out[7] = 0;
+        out[8] = 39; // C3
+        out[18] = 1;
+        out[20] = 7;
+    }
+
+    // Only operator 1 is audible
+    data[(numberOfOperators - 1) * 21 + 16] = 99;
+
+    for (int i = 0; i < 4; i++) {
+        data[126 + i] = 99;
+        data[130 + i] = 50;
+    }
+
+    data[136] = 1;
+    data[137] = 35;
+    data[141] = 1;
+    data[143] = 3;
+    data[144] = 24;
+    std::memcpy(data + 145, "INIT VOICE", 10);
+    operatorsEnabled = 0x3f;
+}
@@ -0,0 +1,76 @@
+/*
+  ==============================================================================
+
+    A DX7 voice, as read from the state of a Dexed instance.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    The parameters of one DX7 voice in the unpacked 155 byte VCED layout,
+    plus the operator on/off switches that Dexed keeps next to it.
+
+    Operators are stored in the DX7 order, operator 6 first; use operator_()
+    to address them by their number.
+ */
+struct Dx7Patch
+{
+    static constexpr int numberOfOperators = 6;
+    static constexpr int voiceSize = 155;
+    static constexpr int cartridgeSize = 4104;
+    static constexpr int numberOfVoicesPerCartridge = 32;
+
+    struct Operator
+    {
+        uint8_t rates[4];
+        uint8_t levels[4];
+        uint8_t breakPoint;
+        uint8_t leftDepth;
+        uint8_t rightDepth;
+        uint8_t leftCurve;
+        uint8_t rightCurve;
+        uint8_t rateScaling;
+        uint8_t amplitudeModulationSensitivity;
+        uint8_t velocitySensitivity;
+        uint8_t outputLevel;
+        uint8_t fixedFrequency;
+        uint8_t frequencyCoarse;
+        uint8_t frequencyFine;
+        uint8_t detune;
+    };
+
+    // The raw voice; the accessors below read from it
+    uint8_t data[voiceSize] = {};
+
+    // Bit n set if operator n + 1 is switched on
+    uint8_t operatorsEnabled = 0x3f;
+
+    // Operator by its number, 1 to 6
+    const Operator &operator_(int number) const
+    {
+        jassert(number >= 1 && number <= numberOfOperators);
+        return *reinterpret_cast<const Operator *>(data + (numberOfOperators - number) * sizeof(Operator));
+    }
+
+    int getAlgorithm() const { return data[134] & 31; } // 0 to 31
+    int getFeedback() const { return data[135] & 7; }
+    bool getOscillatorKeySync() const { return data[136] != 0; }
+    int getTranspose() const { return data[144]; } // 24 is C3
+    juce::String getName() const;
+
+    // Reads the current voice from a Dexed state blob; returns false if there is none
+    bool readFromDexedState(const juce::MemoryBlock &state);
+
+    // Reads a voice from a 32 voice bulk dump, e.g. the "sysex" of a Dexed state or a .syx file
+    bool readFromCartridge(const void *sysex, size_t size, int voiceIndex);
+
+    // The "INIT VOICE" of the DX7
+    void setToInitVoice();
+};
+
+static_assert(sizeof(Dx7Patch::Operator) == 21, "Operators must match the VCED layout");
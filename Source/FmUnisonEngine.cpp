@@ -0,0 +1,637 @@
+#include "FmUnisonEngine.h"
+
+#include <cmath>
+
+#if JUCE_INTEL
+#  include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#  include <arm_neon.h>
+#  define MULTIDEXED_HAS_NEON 1
+#endif
+
+namespace {
+
+//==============================================================================
+// A handful of lanes in one register
+
+#if JUCE_INTEL
+
+using Lanes = __m128;
+constexpr int laneWidth = 4;
+
+inline Lanes load(const float *p) { return _mm_load_ps(p); }
+inline void store(float *p, Lanes v) { _mm_store_ps(p, v); }
+inline Lanes broadcast(float x) { return _mm_set1_ps(x); }
+inline Lanes add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+inline Lanes subtract(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+inline Lanes multiply(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+inline Lanes absolute(Lanes a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+
+// x - floor(x)
+inline Lanes fraction(Lanes x)
+{
+    const Lanes f = _mm_sub_ps(x, _mm_cvtepi32_ps(_mm_cvttps_epi32(x)));
+    return _mm_add_ps(f, _mm_and_ps(_mm_cmplt_ps(f, _mm_setzero_ps()), _mm_set1_ps(1.0f)));
+}
+
+#elif MULTIDEXED_HAS_NEON
+
+using Lanes = float32x4_t;
+constexpr int laneWidth = 4;
+
+inline Lanes load(const float *p) { return vld1q_f32(p); }
+inline void store(float *p, Lanes v) { vst1q_f32(p, v); }
+inline Lanes broadcast(float x) { return vdupq_n_f32(x); }
+inline Lanes add(Lanes a, Lanes b) { return vaddq_f32(a, b); }
+inline Lanes subtract(Lanes a, Lanes b) { return vsubq_f32(a, b); }
+inline Lanes multiply(Lanes a, Lanes b) { return vmulq_f32(a, b); }
+inline Lanes absolute(Lanes a) { return vabsq_f32(a); }
+
+inline Lanes fraction(Lanes x)
+{
+    const Lanes f = vsubq_f32(x, vcvtq_f32_s32(vcvtq_s32_f32(x)));
+    return vbslq_f32(vcltq_f32(f, vdupq_n_f32(0.0f)), vaddq_f32(f, vdupq_n_f32(1.0f)), f);
+}
+
+#else
+
+using Lanes = float;
+constexpr int laneWidth = 1;
+
+inline Lanes load(const float *p) { return *p; }
+inline void store(float *p, Lanes v) { *p = v; }
+inline Lanes broadcast(float x) { return x; }
+inline Lanes add(Lanes a, Lanes b) { return a + b; }
+inline Lanes subtract(Lanes a, Lanes b) { return a - b; }
+inline Lanes multiply(Lanes a, Lanes b) { return a * b; }
+inline Lanes absolute(Lanes a) { return std::abs(a); }
+inline Lanes fraction(Lanes x) { return x - std::floor(x); }
+
+#endif
+
+static_assert(FmUnisonEngine::maximumNumberOfLanes % laneWidth == 0, "Lanes must fill whole registers");
+
+inline float sum(Lanes v)
+{
+    alignas(16) float values[laneWidth];
+    store(values, v);
+    float result = 0.0f;
+    for (int i = 0; i < laneWidth; i++) {
+        result += values[i];
+    }
+    return result;
+}
+
+// sin(2 pi x) for x in [0, 1), from a parabola with one correction step; within 0.1 %
+inline Lanes sineOfCycles(Lanes x)
+{
+    const Lanes s = subtract(x, broadcast(0.5f));
+    Lanes p = subtract(multiply(broadcast(8.0f), s), multiply(broadcast(16.0f), multiply(s, absolute(s))));
+    p = add(multiply(broadcast(0.225f), subtract(multiply(p, absolute(p)), p)), p);
+    return subtract(broadcast(0.0f), p);
+}
+
+//==============================================================================
+// The 32 algorithms of the DX7. Operators are numbered from 1 here, as on the front panel.
+
+constexpr uint8_t op(int number) { return static_cast<uint8_t>(1 << (number - 1)); }
+
+struct Algorithm
+{
+    // Per operator, the operators that modulate it
+    uint8_t modulators[Dx7Patch::numberOfOperators];
+    uint8_t carriers;
+
+    // The operator whose output feeds back, and the one it feeds into; the same one but in algorithms 4 and 6
+    int feedbackSource;
+    int feedbackTarget;
+};
+
+const Algorithm algorithms[32] = {
+    { { op(2), 0, op(4), op(5), op(6), 0 }, op(1) | op(3), 6, 6 },
+    { { op(2), 0, op(4), op(5), op(6), 0 }, op(1) | op(3), 2, 2 },
+    { { op(2), op(3), 0, op(5), op(6), 0 }, op(1) | op(4), 6, 6 },
+    { { op(2), op(3), 0, op(5), op(6), 0 }, op(1) | op(4), 4, 6 },
+    { { op(2), 0, op(4), 0, op(6), 0 }, op(1) | op(3) | op(5), 6, 6 },
+    { { op(2), 0, op(4), 0, op(6), 0 }, op(1) | op(3) | op(5), 5, 6 },
+    { { op(2), 0, op(4) | op(5), 0, op(6), 0 }, op(1) | op(3), 6, 6 },
+    { { op(2), 0, op(4) | op(5), 0, op(6), 0 }, op(1) | op(3), 4, 4 },
+    { { op(2), 0, op(4) | op(5), 0, op(6), 0 }, op(1) | op(3), 2, 2 },
+    { { op(2), op(3), 0, op(5) | op(6), 0, 0 }, op(1) | op(4), 3, 3 },
+    { { op(2), op(3), 0, op(5) | op(6), 0, 0 }, op(1) | op(4), 6, 6 },
+    { { op(2), 0, op(4) | op(5) | op(6), 0, 0, 0 }, op(1) | op(3), 2, 2 },
+    { { op(2), 0, op(4) | op(5) | op(6), 0, 0, 0 }, op(1) | op(3), 6, 6 },
+    { { op(2), 0, op(4), op(5) | op(6), 0, 0 }, op(1) | op(3), 6, 6 },
+    { { op(2), 0, op(4), op(5) | op(6), 0, 0 }, op(1) | op(3), 2, 2 },
+    { { op(2) | op(3) | op(5), 0, op(4), 0, op(6), 0 }, op(1), 6, 6 },
+    { { op(2) | op(3) | op(5), 0, op(4), 0, op(6), 0 }, op(1), 2, 2 },
+    { { op(2) | op(3) | op(4), 0, 0, op(5), op(6), 0 }, op(1), 3, 3 },
+    { { op(2), op(3), 0, op(6), op(6), 0 }, op(1) | op(4) | op(5), 6, 6 },
+    { { op(3), op(3), 0, op(5) | op(6), 0, 0 }, op(1) | op(2) | op(4), 3, 3 },
+    { { op(3), op(3), 0, op(6), op(6), 0 }, op(1) | op(2) | op(4) | op(5), 3, 3 },
+    { { op(2), 0, op(6), op(6), op(6), 0 }, op(1) | op(3) | op(4) | op(5), 6, 6 },
+    { { 0, op(3), 0, op(6), op(6), 0 }, op(1) | op(2) | op(4) | op(5), 6, 6 },
+    { { 0, 0, op(6), op(6), op(6), 0 }, op(1) | op(2) | op(3) | op(4) | op(5), 6, 6 },
+    { { 0, 0, 0, op(6), op(6), 0 }, op(1) | op(2) | op(3) | op(4) | op(5), 6, 6 },
+    { { 0, op(3), 0, op(5) | op(6), 0, 0 }, op(1) | op(2) | op(4), 6, 6 },
+    { { 0, op(3), 0, op(5) | op(6), 0, 0 }, op(1) | op(2) | op(4), 3, 3 },
+    { { op(2), 0, op(4), op(5), 0, 0 }, op(1) | op(3) | op(6), 5, 5 },
+    { { 0, 0, op(4), 0, op(6), 0 }, op(1) | op(2) | op(3) | op(5), 6, 6 },
+    { { 0, 0, op(4), op(5), 0, 0 }, op(1) | op(2) | op(3) | op(6), 5, 5 },
+    { { 0, 0, 0, 0, op(6), 0 }, op(1) | op(2) | op(3) | op(4) | op(5), 6, 6 },
+    { { 0, 0, 0, 0, 0, 0 }, op(1) | op(2) | op(3) | op(4) | op(5) | op(6), 6, 6 },
+};
+
+//==============================================================================
+// Scaling tables and curves of the DX7 emulation in Dexed
+
+const uint8_t outputLevels[20] = { 0, 5, 9, 13, 17, 20, 23, 25, 27, 29, 31, 33, 35, 37, 39, 41, 42, 43, 45, 46 };
+
+const uint8_t velocityCurve[64] = {
+    0, 70, 86, 97, 106, 114, 121, 126, 132, 138, 142, 148, 152, 156, 160, 163,
+    166, 170, 173, 174, 178, 181, 184, 186, 189, 190, 194, 196, 198, 200, 202,
+    205, 206, 209, 211, 214, 216, 218, 220, 222, 224, 225, 227, 229, 230, 232,
+    233, 235, 237, 238, 240, 241, 242, 243, 244, 246, 246, 248, 249, 250, 251,
+    252, 253, 254
+};
+
+const uint8_t exponentialScaling[33] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 11, 14, 16, 19, 23, 27, 33, 39, 47, 56, 66,
+    80, 94, 112, 133, 158, 188, 224, 255, 255, 255, 255, 255
+};
+
+// The rate the envelope rates of the DX7 emulation are specified at
+constexpr double envelopeReferenceSampleRate = 44100.0;
+
+// Envelopes are advanced this often, with the gains ramped in between
+constexpr int envelopeInterval = 16;
+
+// Full scale of a carrier at the highest level, which is a gain of 2
+constexpr float outputScale = 0.125f;
+
+int scaleOutputLevel(int level)
+{
+    return level >= 20 ? 28 + level : outputLevels[juce::jlimit(0, 19, level)];
+}
+
+int scaleVelocity(int velocity, int sensitivity)
+{
+    const int value = velocityCurve[juce::jlimit(0, 127, velocity) >> 1] - 239;
+    return ((sensitivity * value + 7) >> 3) << 4;
+}
+
+int scaleRate(int note, int sensitivity)
+{
+    const int x = juce::jlimit(0, 31, note / 3 - 7);
+    return (sensitivity * x) >> 3;
+}
+
+int scaleCurve(int group, int depth, int curve)
+{
+    int scale;
+    if (curve == 0 || curve == 3) {
+        // Linear
+        scale = (group * depth * 329) >> 12;
+    } else {
+        scale = (exponentialScaling[juce::jmin(group, 32)] * depth * 329) >> 15;
+    }
+    return curve < 2 ? -scale : scale;
+}
+
+int scaleLevel(int note, const Dx7Patch::Operator &op)
+{
+    // Break point 0 is A-1, i.e. note 21
+    const int offset = note - op.breakPoint - 21;
+    if (offset >= 0) {
+        return scaleCurve(offset / 3, op.rightDepth, op.rightCurve);
+    }
+    return scaleCurve(-offset / 3, op.leftDepth, op.leftCurve);
+}
+
+// Frequency in Hz of an operator for a note
+double operatorFrequency(const Dx7Patch::Operator &op, int note)
+{
+    if (op.fixedFrequency) {
+        double octaves = (op.frequencyCoarse & 3) * 3.321928 + op.frequencyFine * 0.03321928;
+        if (op.detune > 7) {
+            octaves += (op.detune - 7) * 13457.0 / (1 << 24);
+        }
+        return std::exp2(octaves);
+    }
+
+    double octaves = std::log2(440.0) + (note - 69) / 12.0;
+
+    // Detune is relatively larger for low notes
+    const double detuneRatio = 0.0209 * std::exp(-0.396 * octaves) / 7.0;
+    octaves += detuneRatio * octaves * (op.detune - 7);
+
+    const double coarse = op.frequencyCoarse == 0 ? 0.5 : static_cast<double>(op.frequencyCoarse);
+    return std::exp2(octaves) * coarse * (1.0 + op.frequencyFine * 0.01);
+}
+
+} // namespace
+
+//==============================================================================
+void FmUnisonEngine::Envelope::start(const Dx7Patch::Operator &op, int newOutputLevel, int newRateScaling, double newRateFactor)
+{
+    for (int i = 0; i < 4; i++) {
+        rates[i] = op.rates[i];
+        levels[i] = op.levels[i];
+    }
+    outputLevel = newOutputLevel;
+    rateScaling = newRateScaling;
+    rateFactor = newRateFactor;
+
+    level = 0.0f;
+    keyDown = true;
+    enterStage(0);
+}
+
+void FmUnisonEngine::Envelope::release()
+{
+    keyDown = false;
+    if (stage < 4) {
+        enterStage(3);
+    }
+}
+
+void FmUnisonEngine::Envelope::enterStage(int newStage)
+{
+    stage = newStage;
+    if (stage >= 4) {
+        return;
+    }
+
+    int actualLevel = ((scaleOutputLevel(levels[stage]) >> 1) << 6) + outputLevel - 4256;
+    actualLevel = juce::jmax(16, actualLevel);
+    targetLevel = static_cast<float>(actualLevel);
+    rising = targetLevel > level;
+
+    const int qrate = juce::jmin(63, ((rates[stage] * 41) >> 6) + rateScaling);
+    increment = static_cast<float>(((4 + (qrate & 3)) << (2 + (qrate >> 2))) / 65536.0 * rateFactor);
+}
+
+float FmUnisonEngine::Envelope::advance(int numberOfSamples)
+{
+    // The sustain stage holds until the key is released
+    if (stage < 3 || (stage == 3 && !keyDown)) {
+        if (rising) {
+            // Attacks start from a level where they can be heard, and slow down towards the top
+            level = juce::jmax(level, 1716.0f);
+            level += std::floor(17.0f - level / 256.0f) * increment * numberOfSamples;
+            if (level >= targetLevel) {
+                level = targetLevel;
+                enterStage(stage + 1);
+            }
+        } else {
+            level -= increment * numberOfSamples;
+            if (level <= targetLevel) {
+                level = targetLevel;
+                enterStage(stage + 1);
+            }
+        }
+    }
+    return level;
+}
+
+//==============================================================================
+FmUnisonEngine::FmUnisonEngine()
+{
+    patch.setToInitVoice();
+
+    for (int i = 0; i < maximumNumberOfLanes; i++) {
+        laneRatios[i] = 1.0f;
+        laneFades[i] = 1.0f;
+    }
+    for (int i = 0; i < numberOfLanes; i++) {
+        laneLeftGains[i] = laneRightGains[i] = 1.0f / numberOfLanes;
+    }
+}
+
+void FmUnisonEngine::prepare(double newSampleRate)
+{
+    sampleRate = newSampleRate;
+    reset();
+}
+
+void FmUnisonEngine::setPatch(const Dx7Patch &newPatch)
+{
+    patch = newPatch;
+}
+
+void FmUnisonEngine::setLanes(int newNumberOfLanes, const float *tunings, const float *leftGains, const float *rightGains)
+{
+    numberOfLanes = juce::jlimit(1, maximumNumberOfLanes, newNumberOfLanes);
+
+    // Lanes beyond the last one are rendered along with the others, but not heard
+    for (int i = 0; i < maximumNumberOfLanes; i++) {
+        const bool used = i < numberOfLanes;
+        const double semitones = used ? (tunings[i] - 0.5) * 2.0 * tuningRangeSemitones : 0.0;
+        laneRatios[i] = static_cast<float>(std::exp2(semitones / 12.0));
+        laneLeftGains[i] = used ? leftGains[i] : 0.0f;
+        laneRightGains[i] = used ? rightGains[i] : 0.0f;
+    }
+
+    for (auto &voice : voices) {
+        if (voice.note >= 0) {
+            updateIncrements(voice);
+        }
+    }
+}
+
+void FmUnisonEngine::setLaneFades(const float *startGains, const float *steps, int numberOfFadedLanes)
+{
+    for (int i = 0; i < maximumNumberOfLanes; i++) {
+        const bool faded = i < numberOfFadedLanes;
+        laneFades[i] = faded ? startGains[i] : 1.0f;
+        laneFadeSteps[i] = faded ? steps[i] : 0.0f;
+    }
+}
+
+void FmUnisonEngine::reset()
+{
+    for (auto &voice : voices) {
+        voice.note = -1;
+    }
+    sustainPedalDown = false;
+    pitchBendRatio = 1.0f;
+}
+
+void FmUnisonEngine::updateIncrements(Voice &voice) const
+{
+    for (int k = 0; k < Dx7Patch::numberOfOperators; k++) {
+        const float frequency = static_cast<float>(voice.frequencies[k]) * pitchBendRatio;
+        for (int lane = 0; lane < maximumNumberOfLanes; lane++) {
+            voice.increments[k][lane] = frequency * laneRatios[lane];
+        }
+    }
+}
+
+void FmUnisonEngine::noteOn(int note, int velocity)
+{
+    // Play the note again in the voice it is still sounding in, or else in a free one,
+    // or else in the one that has been playing longest, preferring released ones
+    Voice *target = nullptr;
+    for (auto &voice : voices) {
+        if (voice.note == note) {
+            target = &voice;
+            break;
+        }
+    }
+    for (auto &voice : voices) {
+        if (target == nullptr && voice.note < 0) {
+            target = &voice;
+        }
+    }
+    if (target == nullptr) {
+        for (auto &voice : voices) {
+            const bool released = !voice.keyDown && !voice.sustained;
+            const bool targetReleased = target != nullptr && !target->keyDown && !target->sustained;
+            if (target == nullptr || (released && !targetReleased)
+                || (released == targetReleased && voice.age < target->age)) {
+                target = &voice;
+            }
+        }
+    }
+
+    Voice &voice = *target;
+    const bool retrigger = voice.note >= 0;
+    voice.note = note;
+    voice.keyDown = true;
+    voice.sustained = false;
+    voice.age = nextAge++;
+
+    const int transposedNote = juce::jlimit(0, 127, note + patch.getTranspose() - 24);
+    const double rateFactor = envelopeReferenceSampleRate / sampleRate;
+
+    for (int number = 1; number <= Dx7Patch::numberOfOperators; number++) {
+        const int k = number - 1;
+        const Dx7Patch::Operator &op = patch.operator_(number);
+
+        int outputLevel = juce::jmin(127, scaleOutputLevel(op.outputLevel) + scaleLevel(transposedNote, op));
+        outputLevel = (outputLevel << 5) + scaleVelocity(velocity, op.velocitySensitivity);
+        voice.envelopes[k].start(op, juce::jmax(0, outputLevel), scaleRate(transposedNote, op.rateScaling), rateFactor);
+
+        voice.frequencies[k] = operatorFrequency(op, transposedNote) / sampleRate;
+
+        // Oscillator key sync restarts the waves; otherwise they go on from where they are
+        if (!retrigger || patch.getOscillatorKeySync()) {
+            for (int lane = 0; lane < maximumNumberOfLanes; lane++) {
+                voice.phases[k][lane] = 0.0f;
+                voice.outputs[k][lane] = 0.0f;
+            }
+        }
+        if (!retrigger) {
+            voice.gains[k] = 0.0f;
+        }
+
+        // Switched off operators are skipped, so make sure they do not modulate with what they had
+        if (!(patch.operatorsEnabled & (1 << k))) {
+            for (int lane = 0; lane < maximumNumberOfLanes; lane++) {
+                voice.outputs[k][lane] = 0.0f;
+            }
+        }
+    }
+
+    if (!retrigger) {
+        for (int lane = 0; lane < maximumNumberOfLanes; lane++) {
+            voice.feedback[0][lane] = voice.feedback[1][lane] = 0.0f;
+        }
+    }
+
+    updateIncrements(voice);
+}
+
+void FmUnisonEngine::noteOff(int note)
+{
+    for (auto &voice : voices) {
+        if (voice.note == note && voice.keyDown) {
+            voice.keyDown = false;
+            if (sustainPedalDown) {
+                voice.sustained = true;
+            } else {
+                for (auto &envelope : voice.envelopes) {
+                    envelope.release();
+                }
+            }
+        }
+    }
+}
+
+void FmUnisonEngine::releaseSustainedNotes()
+{
+    for (auto &voice : voices) {
+        if (voice.sustained) {
+            voice.sustained = false;
+            for (auto &envelope : voice.envelopes) {
+                envelope.release();
+            }
+        }
+    }
+}
+
+void FmUnisonEngine::handleMidiEvent(const juce::uint8 *data, int numBytes)
+{
+    // Read from the raw bytes, as a MidiMessage would allocate for SysEx on the audio thread;
+    // everything handled here is a three-byte channel message
+    if (numBytes != 3 || data[0] >= 0xf0) {
+        return;
+    }
+    const int status = data[0] & 0xf0;
+
+    if (status == 0x90 && data[2] != 0) {
+        noteOn(data[1] & 0x7f, data[2] & 0x7f);
+    } else if (status == 0x80 || status == 0x90) {
+        noteOff(data[1] & 0x7f);
+    } else if (status == 0xb0 && data[1] == 64) {
+        // Sustain pedal, down from 64 on
+        sustainPedalDown = data[2] >= 64;
+        if (!sustainPedalDown) {
+            releaseSustainedNotes();
+        }
+    } else if (status == 0xb0 && (data[1] == 120 || data[1] == 123)) {
+        // All sound off, all notes off
+        if (data[1] == 120) {
+            reset();
+        } else {
+            for (auto &voice : voices) {
+                if (voice.note >= 0) {
+                    noteOff(voice.note);
+                }
+            }
+        }
+    } else if (status == 0xe0) {
+        // Two semitones either way, like the DX7 default
+        const int pitchWheelValue = (data[1] & 0x7f) | ((data[2] & 0x7f) << 7);
+        const double semitones = (pitchWheelValue - 8192) / 8192.0 * 2.0;
+        pitchBendRatio = static_cast<float>(std::exp2(semitones / 12.0));
+        for (auto &voice : voices) {
+            if (voice.note >= 0) {
+                updateIncrements(voice);
+            }
+        }
+    }
+}
+
+void FmUnisonEngine::render(const juce::MidiBuffer &midi, juce::AudioBuffer<float> &output)
+{
+    const int numSamples = output.getNumSamples();
+    output.clear();
+    if (output.getNumChannels() < 2) {
+        return;
+    }
+
+    float *left = output.getWritePointer(0);
+    float *right = output.getWritePointer(1);
+
+    // Render up to each event, then apply it
+    int position = 0;
+    for (const auto metadata : midi) {
+        const int eventPosition = juce::jlimit(position, numSamples, metadata.samplePosition);
+        renderVoices(left, right, position, eventPosition);
+        handleMidiEvent(metadata.data, metadata.numBytes);
+        position = eventPosition;
+    }
+    renderVoices(left, right, position, numSamples);
+}
+
+void FmUnisonEngine::renderVoices(float *left, float *right, int startSample, int endSample)
+{
+    for (int start = startSample; start < endSample; start += envelopeInterval) {
+        const int length = juce::jmin(envelopeInterval, endSample - start);
+
+        // Lanes fade in steps of a chunk, like the envelopes
+        for (int lane = 0; lane < maximumNumberOfLanes; lane++) {
+            fadedLeftGains[lane] = laneLeftGains[lane] * laneFades[lane];
+            fadedRightGains[lane] = laneRightGains[lane] * laneFades[lane];
+            if (laneFadeSteps[lane] != 0.0f) {
+                laneFades[lane] = juce::jlimit(0.0f, 1.0f, laneFades[lane] + laneFadeSteps[lane] * static_cast<float>(length));
+            }
+        }
+
+        for (auto &voice : voices) {
+            if (voice.note >= 0) {
+                renderVoice(voice, left + start, right + start, length);
+            }
+        }
+    }
+}
+
+void FmUnisonEngine::renderVoice(Voice &voice, float *left, float *right, int numberOfSamples)
+{
+    const Algorithm &algorithm = algorithms[patch.getAlgorithm()];
+    const int feedbackSource = algorithm.feedbackSource - 1;
+    const int feedbackTarget = algorithm.feedbackTarget - 1;
+    const float feedbackScale = patch.getFeedback() > 0 ? 0.5f * std::exp2(static_cast<float>(patch.getFeedback() - 8)) : 0.0f;
+    const int lanes = (numberOfLanes + laneWidth - 1) / laneWidth * laneWidth;
+
+    // Ramp the gains to where the envelopes are at the end of the chunk
+    float gainSteps[Dx7Patch::numberOfOperators];
+    bool finished = !voice.keyDown && !voice.sustained;
+    for (int k = 0; k < Dx7Patch::numberOfOperators; k++) {
+        const float level = voice.envelopes[k].advance(numberOfSamples);
+        const float gain = (patch.operatorsEnabled & (1 << k)) ? std::exp2(level / 256.0f - 14.0f) : 0.0f;
+        gainSteps[k] = (gain - voice.gains[k]) / numberOfSamples;
+
+        // Voices end once their carriers have been released and are silent
+        if ((algorithm.carriers & (1 << k)) && (!voice.envelopes[k].isFinished() || gain > 1.0e-4f)) {
+            finished = false;
+        }
+    }
+
+    for (int sample = 0; sample < numberOfSamples; sample++) {
+        // Modulators have higher numbers than the operators they modulate
+        for (int k = Dx7Patch::numberOfOperators - 1; k >= 0; k--) {
+            voice.gains[k] += gainSteps[k];
+            if (!(patch.operatorsEnabled & (1 << k))) {
+                continue;
+            }
+
+            const Lanes gain = broadcast(voice.gains[k]);
+            const uint8_t modulators = algorithm.modulators[k];
+
+            for (int lane = 0; lane < lanes; lane += laneWidth) {
+                Lanes modulation = broadcast(0.0f);
+                for (int m = k + 1; m < Dx7Patch::numberOfOperators; m++) {
+                    if (modulators & (1 << m)) {
+                        modulation = add(modulation, load(voice.outputs[m] + lane));
+                    }
+                }
+                if (k == feedbackTarget) {
+                    const Lanes previous = add(load(voice.feedback[0] + lane), load(voice.feedback[1] + lane));
+                    modulation = add(modulation, multiply(previous, broadcast(feedbackScale)));
+                }
+
+                const Lanes phase = load(voice.phases[k] + lane);
+                const Lanes y = multiply(sineOfCycles(fraction(add(phase, modulation))), gain);
+                store(voice.outputs[k] + lane, y);
+                store(voice.phases[k] + lane, fraction(add(phase, load(voice.increments[k] + lane))));
+
+                if (k == feedbackSource) {
+                    store(voice.feedback[1] + lane, load(voice.feedback[0] + lane));
+                    store(voice.feedback[0] + lane, y);
+                }
+            }
+        }
+
+        // Sum the carriers of every lane and pan the lanes
+        Lanes leftSum = broadcast(0.0f);
+        Lanes rightSum = broadcast(0.0f);
+        for (int lane = 0; lane < lanes; lane += laneWidth) {
+            Lanes carriers = broadcast(0.0f);
+            for (int k = 0; k < Dx7Patch::numberOfOperators; k++) {
+                if (algorithm.carriers & (1 << k)) {
+                    carriers = add(carriers, load(voice.outputs[k] + lane));
+                }
+            }
+            leftSum = add(leftSum, multiply(carriers, load(fadedLeftGains + lane)));
+            rightSum = add(rightSum, multiply(carriers, load(fadedRightGains + lane)));
+        }
+        left[sample] += sum(leftSum) * outputScale;
+        right[sample] += sum(rightSum) * outputScale;
+    }
+
+    if (finished) {
+        voice.note = -1;
+    }
+}
@@ -0,0 +1,147 @@
+/*
+  ==============================================================================
+
+    Built-in DX7 style FM engine that renders all unison copies of a note
+    at once, as an alternative to hosting one Dexed per unison voice.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "Dx7Patch.h"
+
+#include <array>
+
+//==============================================================================
+/**
+    Polyphonic six operator FM synth that plays a Dx7Patch in unison.
+
+    Every note is rendered once per lane, where a lane stands for one unison
+    voice, i.e. one Dexed instance of the VST3 backend. All that is the same
+    for the lanes of a note, such as the envelopes, keyboard scaling and the
+    algorithm, is computed once per note; the lanes only differ in their
+    tuning. The phases of an operator are laid out lane by lane so that the
+    lanes are rendered four at a time with SSE or NEON, which makes another
+    unison voice far cheaper than another Dexed instance.
+
+    Envelopes, scaling and frequencies follow the fixed point DX7 emulation
+    that Dexed is based on. The LFO and the pitch envelope are not emulated
+    yet, so patches that rely on them sound different.
+
+    All methods but the constructor are for the audio thread; none of them
+    lock or allocate.
+ */
+class FmUnisonEngine
+{
+public:
+    FmUnisonEngine();
+
+    // Upper bound for the number of lanes, i.e. unison voices
+    static constexpr int maximumNumberOfLanes = 32;
+
+    // Notes that can sound at the same time
+    static constexpr int numberOfVoices = 16;
+
+    // How far a tuning of 0 or 1 detunes a lane, like MASTER TUNE ADJ in Dexed
+    static constexpr double tuningRangeSemitones = 1.0;
+
+    void prepare(double sampleRate);
+
+    // Notes that are already playing keep their envelopes and frequencies
+    void setPatch(const Dx7Patch &newPatch);
+    const Dx7Patch &getPatch() const { return patch; }
+
+    // Sets the number of lanes, the tuning of each lane between 0 and 1, 0.5 being in tune,
+    // and the gain of each lane in the left and right channel
+    void setLanes(int newNumberOfLanes, const float *tunings, const float *leftGains, const float *rightGains);
+
+    // Fades the first numberOfFadedLanes lanes during the next render(): lane i starts at startGains[i] on
+    // top of its gains from setLanes() and moves by steps[i] per sample, within 0 and 1. Other lanes stay at 1.
+    void setLaneFades(const float *startGains, const float *steps, int numberOfFadedLanes);
+
+    // Silences all notes at once
+    void reset();
+
+    // Overwrites channel 0 and 1 of output with the notes played by midi
+    void render(const juce::MidiBuffer &midi, juce::AudioBuffer<float> &output);
+
+private:
+    // Operator envelope in units of 1/256 octave, as in Dexed
+    struct Envelope
+    {
+        void start(const Dx7Patch::Operator &op, int outputLevel, int rateScaling, double rateFactor);
+        void release();
+        float advance(int numberOfSamples);
+        bool isFinished() const { return stage >= 4; }
+
+        int rates[4] = {};
+        int levels[4] = {};
+        int outputLevel = 0;
+        int rateScaling = 0;
+        double rateFactor = 1.0;
+
+        float level = 0.0f;
+        float targetLevel = 0.0f;
+        float increment = 0.0f;
+        int stage = 4;
+        bool rising = false;
+        bool keyDown = false;
+
+    private:
+        void enterStage(int newStage);
+    };
+
+    struct Voice
+    {
+        int note = -1;
+        bool keyDown = false;
+        bool sustained = false;
+        uint32_t age = 0;
+
+        Envelope envelopes[Dx7Patch::numberOfOperators];
+        float gains[Dx7Patch::numberOfOperators] = {};
+
+        // Frequency of every operator in cycles per sample, before the tuning of the lanes
+        double frequencies[Dx7Patch::numberOfOperators] = {};
+
+        // Per operator and lane: phase in cycles, its increment per sample, and the latest output
+        alignas(16) float phases[Dx7Patch::numberOfOperators][maximumNumberOfLanes] = {};
+        alignas(16) float increments[Dx7Patch::numberOfOperators][maximumNumberOfLanes] = {};
+        alignas(16) float outputs[Dx7Patch::numberOfOperators][maximumNumberOfLanes] = {};
+
+        // The two latest outputs of the operator that feeds back
+        alignas(16) float feedback[2][maximumNumberOfLanes] = {};
+    };
+
+    void noteOn(int note, int velocity);
+    void noteOff(int note);
+    void releaseSustainedNotes();
+    void handleMidiEvent(const juce::uint8 *data, int numBytes);
+
+    void updateIncrements(Voice &voice) const;
+    void renderVoices(float *left, float *right, int startSample, int endSample);
+    void renderVoice(Voice &voice, float *left, float *right, int numberOfSamples);
+
+    Dx7Patch patch;
+    std::array<Voice, numberOfVoices> voices;
+    uint32_t nextAge = 0;
+
+    double sampleRate = 44100.0;
+    bool sustainPedalDown = false;
+    float pitchBendRatio = 1.0f;
+
+    int numberOfLanes = 4;
+    alignas(16) float laneRatios[maximumNumberOfLanes] = {};
+    alignas(16) float laneLeftGains[maximumNumberOfLanes] = {};
+    alignas(16) float laneRightGains[maximumNumberOfLanes] = {};
+    float laneFades[maximumNumberOfLanes] = {};
+    float laneFadeSteps[maximumNumberOfLanes] = {};
+
+    // The gains of the lanes with their fades, updated for every chunk of samples
+    alignas(16) float fadedLeftGains[maximumNumberOfLanes] = {};
+    alignas(16) float fadedRightGains[maximumNumberOfLanes] = {};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(FmUnisonEngine)
+};
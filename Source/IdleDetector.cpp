@@ -0,0 +1,87 @@
+#include "IdleDetector.h"
+
+IdleDetector::IdleDetector()
+{
+    reset();
+}
+
+void IdleDetector::reset()
+{
+    for (int channel = 0; channel < 16; channel++) {
+        heldNotes[channel][0] = heldNotes[channel][1] = 0;
+        sustainedNotes[channel][0] = sustainedNotes[channel][1] = 0;
+        sustainPedalDown[channel] = false;
+    }
+    notesAreSounding = false;
+
+    for (int i = 0; i < maximumNumberOfInstances; i++) {
+        quietSeconds[i] = 0.0;
+        requiredQuietSeconds[i] = silenceWindowSeconds;
+    }
+}
+
+void IdleDetector::processMidi(const juce::MidiBuffer &midiMessages, int numSamples)
+{
+    for (const auto metadata : midiMessages) {
+        if (metadata.samplePosition >= numSamples) {
+            break;
+        }
+
+        // Only three-byte channel messages matter; they are read from the raw bytes, as
+        // getMessage() would allocate for SysEx on the audio thread
+        const juce::uint8 *data = metadata.data;
+        if (metadata.numBytes != 3 || data[0] >= 0xf0) {
+            continue;
+        }
+        const int status = data[0] & 0xf0;
+        const int channel = data[0] & 0x0f;
+        const int note = data[1] & 0x7f;
+
+        if (status == 0x90 && data[2] != 0) {
+            heldNotes[channel][note / 64] |= uint64_t(1) << (note % 64);
+        } else if (status == 0x80 || status == 0x90) {
+            heldNotes[channel][note / 64] &= ~(uint64_t(1) << (note % 64));
+            if (sustainPedalDown[channel]) {
+                sustainedNotes[channel][note / 64] |= uint64_t(1) << (note % 64);
+            }
+        } else if (status == 0xb0 && data[1] == 64) {
+            // Sustain pedal, down from 64 on
+            sustainPedalDown[channel] = data[2] >= 64;
+            if (!sustainPedalDown[channel]) {
+                sustainedNotes[channel][0] = sustainedNotes[channel][1] = 0;
+            }
+        } else if (status == 0xb0 && (data[1] == 120 || data[1] == 123)) {
+            // All sound off, all notes off
+            heldNotes[channel][0] = heldNotes[channel][1] = 0;
+            sustainedNotes[channel][0] = sustainedNotes[channel][1] = 0;
+        }
+    }
+
+    notesAreSounding = false;
+    for (int channel = 0; channel < 16; channel++) {
+        if ((heldNotes[channel][0] | heldNotes[channel][1] | sustainedNotes[channel][0] | sustainedNotes[channel][1]) != 0) {
+            notesAreSounding = true;
+        }
+    }
+}
+
+void IdleDetector::recordBlock(int instance, float peak, double blockSeconds, double tailSeconds)
+{
+    if (!juce::isPositiveAndBelow(instance, maximumNumberOfInstances)) {
+        return;
+    }
+
+    // The tail counts from when the last note was released
+    requiredQuietSeconds[instance] = juce::jmax(silenceWindowSeconds, tailSeconds);
+    if (peak > silenceThreshold || hasSoundingNotes()) {
+        quietSeconds[instance] = 0.0;
+    } else {
+        quietSeconds[instance] += blockSeconds;
+    }
+}
+
+bool IdleDetector::isIdle(int instance) const
+{
+    return juce::isPositiveAndBelow(instance, maximumNumberOfInstances)
+        && quietSeconds[instance] >= requiredQuietSeconds[instance];
+}
@@ -0,0 +1,63 @@
+/*
+  ==============================================================================
+
+    Works out which instances have nothing left to play, so that they can
+    sleep instead of rendering silence.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    Tracks the notes sounding in the MIDI stream and the output level of every
+    instance.
+
+    All followers get the same MIDI, so the notes are tracked once, including
+    those held by the sustain pedal. An instance is idle once no note has
+    been sounding and its peak has stayed below silenceThreshold for
+    silenceWindowSeconds, or for the tail length of the instance if that is
+    longer. Used on the audio thread only; does not lock or allocate.
+ */
+class IdleDetector
+{
+public:
+    IdleDetector();
+
+    static constexpr int maximumNumberOfInstances = 64;
+
+    // About -80 dB
+    static constexpr float silenceThreshold = 1.0e-4f;
+    static constexpr double silenceWindowSeconds = 0.2;
+
+    // Forgets the notes and the levels; every instance counts as busy again
+    void reset();
+
+    // Follows the note-ons, note-offs and the sustain pedal in the block
+    void processMidi(const juce::MidiBuffer &midiMessages, int numSamples);
+
+    // Whether any note is held, by a key or by the sustain pedal
+    bool hasSoundingNotes() const { return notesAreSounding; }
+
+    // Records the peak of the block the instance just rendered
+    void recordBlock(int instance, float peak, double blockSeconds, double tailSeconds);
+
+    // Whether the instance can sleep until the next MIDI event
+    bool isIdle(int instance) const;
+
+private:
+    // A bit per note and channel, for the keys held and for the notes only the sustain pedal holds
+    uint64_t heldNotes[16][2] = {};
+    uint64_t sustainedNotes[16][2] = {};
+    bool sustainPedalDown[16] = {};
+    bool notesAreSounding = false;
+
+    // How long every instance has been quiet with no note sounding, and how long it has to be
+    double quietSeconds[maximumNumberOfInstances];
+    double requiredQuietSeconds[maximumNumberOfInstances];
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(IdleDetector)
+};
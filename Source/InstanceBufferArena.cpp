@@ -0,0 +1,180 @@
+#include "InstanceBufferArena.h"
+
+#include <cstdlib>
+#include <new>
+
+void InstanceBufferArena::allocate(int numberOfBuffers, int numberOfChannels, int maximumNumberOfSamples)
+{
+    // Round every channel up to a whole number of cache lines so that each one starts aligned
+    const size_t floatsPerLine = alignment / sizeof(float);
+    const size_t channelStride = (static_cast<size_t>(maximumNumberOfSamples) + floatsPerLine - 1) / floatsPerLine * floatsPerLine;
+    const size_t numberOfFloats = channelStride * static_cast<size_t>(numberOfBuffers * numberOfChannels);
+
+    storage.calloc(numberOfFloats * sizeof(float) + alignment);
+    auto base = reinterpret_cast<uintptr_t>(storage.get());
+    auto *alignedBase = reinterpret_cast<float *>((base + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1));
+
+    channelPointers.resize(static_cast<size_t>(numberOfBuffers * numberOfChannels));
+    for (size_t i = 0; i < channelPointers.size(); i++) {
+        channelPointers[i] = alignedBase + i * channelStride;
+    }
+
+    channelsPerBuffer = numberOfChannels;
+    samplesPerChannel = maximumNumberOfSamples;
+
+    buffers.clear();
+    buffers.reserve(static_cast<size_t>(numberOfBuffers));
+    for (int i = 0; i < numberOfBuffers; i++) {
+        buffers.emplace_back(channelPointers.data() + i * numberOfChannels, numberOfChannels, maximumNumberOfSamples);
+    }
+}
+
+void InstanceBufferArena::prepareBlock(int numberOfBuffers, int numberOfChannels, int numberOfSamples)
+{
+    if (!canHold(numberOfBuffers, numberOfChannels, numberOfSamples)) {
+        // The host sent a bigger block than it announced in prepareToPlay;
+        // we have no choice but to grow the arena here on the audio thread
+        jassertfalse;
+        allocate(juce::jmax(numberOfBuffers, size()), juce::jmax(numberOfChannels, channelsPerBuffer),
+                 juce::jmax(numberOfSamples, samplesPerChannel));
+    }
+
+    // Re-pointing a buffer at its slice only copies the channel pointers
+    for (int i = 0; i < numberOfBuffers; i++) {
+        buffers[static_cast<size_t>(i)].setDataToReferTo(channelPointers.data() + i * channelsPerBuffer,
+                                                         numberOfChannels, numberOfSamples);
+    }
+}
+
+void InstanceBufferArena::clear(int firstBuffer, int numberOfBuffers)
+{
+    jassert(firstBuffer >= 0 && firstBuffer + numberOfBuffers <= size());
+    for (int i = firstBuffer; i < firstBuffer + numberOfBuffers; i++) {
+        buffers[static_cast<size_t>(i)].clear();
+    }
+}
+
+//==============================================================================
+#if MULTIDEXED_COUNT_AUDIO_THREAD_ALLOCATIONS
+
+namespace {
+
+thread_local bool isAudioThread = false;
+std::atomic<int64_t> audioThreadAllocations { 0 };
+
+void *countedAllocate(size_t size)
+{
+    if (isAudioThread) {
+        audioThreadAllocations.fetch_add(1, std::memory_order_relaxed);
+
+#  if MULTIDEXED_ASSERT_ON_AUDIO_THREAD_ALLOCATION
+        // The assertion itself may allocate, so don't count it
+        isAudioThread = false;
+        jassertfalse;
+        isAudioThread = true;
+#  endif
+    }
+
+    if (void *pointer = std::malloc(size == 0 ? 1 : size)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+// Over-allocates and keeps what malloc() returned just before the aligned block, as
+// aligned_alloc() is not available everywhere
+void *countedAllocateAligned(size_t size, std::align_val_t alignment)
+{
+    const size_t bytes = juce::jmax(static_cast<size_t>(alignment), sizeof(void *));
+    auto *base = static_cast<char *>(countedAllocate(size + bytes + sizeof(void *)));
+    const auto start = reinterpret_cast<uintptr_t>(base + sizeof(void *));
+    auto *aligned = reinterpret_cast<void **>((start + bytes - 1) & ~static_cast<uintptr_t>(bytes - 1));
+    aligned[-1] = base;
+    return aligned;
+}
+
+void freeAligned(void *pointer)
+{
+    if (pointer != nullptr) {
+        std::free(static_cast<void **>(pointer)[-1]);
+    }
+}
+
+} // namespace
+
+// Replacing the global allocation functions is the only way to see every allocation made
+// through operator new; the array and nothrow forms end up here as well, the aligned forms
+// have to be replaced on their own
+void *operator new(size_t size)
+{
+    return countedAllocate(size);
+}
+
+void *operator new(size_t size, std::align_val_t alignment)
+{
+    return countedAllocateAligned(size, alignment);
+}
+
+void *operator new[](size_t size, std::align_val_t alignment)
+{
+    return countedAllocateAligned(size, alignment);
+}
+
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::align_val_t) noexcept
+{
+    freeAligned(pointer);
+}
+
+void operator delete(void *pointer, size_t, std::align_val_t) noexcept
+{
+    freeAligned(pointer);
+}
+
+void operator delete[](void *pointer, std::align_val_t) noexcept
+{
+    freeAligned(pointer);
+}
+
+void operator delete[](void *pointer, size_t, std::align_val_t) noexcept
+{
+    freeAligned(pointer);
+}
+
+AudioThreadAllocationCounter::ScopedAudioThread::ScopedAudioThread()
+    : wasAudioThread(isAudioThread)
+{
+    isAudioThread = true;
+}
+
+AudioThreadAllocationCounter::ScopedAudioThread::~ScopedAudioThread()
+{
+    isAudioThread = wasAudioThread;
+}
+
+int64_t AudioThreadAllocationCounter::getCount()
+{
+    return audioThreadAllocations.load(std::memory_order_relaxed);
+}
+
+#else
+
+AudioThreadAllocationCounter::ScopedAudioThread::ScopedAudioThread() { }
+
+AudioThreadAllocationCounter::ScopedAudioThread::~ScopedAudioThread() { }
+
+int64_t AudioThreadAllocationCounter::getCount()
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,97 @@
+/*
+  ==============================================================================
+
+    Preallocated memory for the audio buffers of the Dexed instances, so that
+    processBlock never needs to allocate.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    One contiguous, cache-aligned block of memory holding a buffer for every
+    Dexed instance.
+
+    allocate() is called from prepareToPlay with the maximum block size. Per
+    block, prepareBlock() only points the buffers at their slices again and
+    clear() zeroes the ones that are rendered into, neither of which allocates.
+ */
+class InstanceBufferArena
+{
+public:
+    InstanceBufferArena() = default;
+
+    // Allocates space for the given number of buffers. Must not be called from the audio thread.
+    void allocate(int numberOfBuffers, int numberOfChannels, int maximumNumberOfSamples);
+
+    // Resizes the buffers for a block of the given length, without clearing them. Does not
+    // allocate as long as the block fits into what was allocated.
+    void prepareBlock(int numberOfBuffers, int numberOfChannels, int numberOfSamples);
+
+    // Clears numberOfBuffers buffers from firstBuffer on, as resized by the latest prepareBlock()
+    void clear(int firstBuffer, int numberOfBuffers);
+
+    bool canHold(int numberOfBuffers, int numberOfChannels, int numberOfSamples) const
+    {
+        return numberOfBuffers <= size() && numberOfChannels <= channelsPerBuffer
+                && numberOfSamples <= samplesPerChannel;
+    }
+
+    juce::AudioBuffer<float> &operator[](int index) { return buffers[static_cast<size_t>(index)]; }
+    const juce::AudioBuffer<float> *data() const { return buffers.data(); }
+    int size() const { return static_cast<int>(buffers.size()); }
+
+private:
+    // Alignment of every channel, one cache line
+    static constexpr size_t alignment = 64;
+
+    juce::HeapBlock<char> storage;
+    std::vector<float *> channelPointers;
+    std::vector<juce::AudioBuffer<float>> buffers;
+    int channelsPerBuffer = 0;
+    int samplesPerChannel = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(InstanceBufferArena)
+};
+
+//==============================================================================
+// Test helper that counts heap allocations made on the audio thread and the render threads.
+// Off by default; define MULTIDEXED_COUNT_AUDIO_THREAD_ALLOCATIONS=1 in a test build to turn it on,
+// and MULTIDEXED_ASSERT_ON_AUDIO_THREAD_ALLOCATION=1 to also hit a jassert on every such allocation.
+//
+// It works by replacing the global operator new and delete, including the aligned forms, so it
+// has limits that make it unfit for builds that are given to users:
+// - Whether the replacement is used by the host and the other modules in the process, or only by
+//   this plugin, depends on the platform and on how the plugin is linked; it changes the allocator
+//   of everything that does use it.
+// - Allocations that bypass operator new, such as malloc() in Dexed or in the system libraries,
+//   are not counted.
+// - Only threads inside a ScopedAudioThread count, i.e. processBlock and the render jobs; helper
+//   processes and threads of the host that Dexed uses on its own are not covered.
+#ifndef MULTIDEXED_COUNT_AUDIO_THREAD_ALLOCATIONS
+#  define MULTIDEXED_COUNT_AUDIO_THREAD_ALLOCATIONS 0
+#endif
+
+#ifndef MULTIDEXED_ASSERT_ON_AUDIO_THREAD_ALLOCATION
+#  define MULTIDEXED_ASSERT_ON_AUDIO_THREAD_ALLOCATION 0
+#endif
+
+struct AudioThreadAllocationCounter
+{
+    // Marks the current thread as the audio thread for the lifetime of the object; may be nested
+    struct ScopedAudioThread
+    {
+        ScopedAudioThread();
+        ~ScopedAudioThread();
+
+    private:
+        bool wasAudioThread = false;
+    };
+
+    // Number of allocations made while a ScopedAudioThread was alive; always 0 when disabled
+    static int64_t getCount();
+};
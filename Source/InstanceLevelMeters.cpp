@@ -0,0 +1,165 @@
+#include "InstanceLevelMeters.h"
+
+#include <cmath>
+
+#if JUCE_INTEL
+#  include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#  include <arm_neon.h>
+#  define MULTIDEXED_HAS_NEON 1
+#endif
+
+namespace {
+
+// Adds the peak and the sum of squares of one channel; SSE is always there on the Intel targets
+void measureChannel(const float *samples, int numSamples, float &peak, float &sumOfSquares)
+{
+    int sample = 0;
+    float blockPeak = peak;
+    float blockSum = 0.0f;
+
+#if JUCE_INTEL
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    __m128 peaks = _mm_setzero_ps();
+    __m128 sums = _mm_setzero_ps();
+    for (; sample + 4 <= numSamples; sample += 4) {
+        const __m128 values = _mm_loadu_ps(samples + sample);
+        peaks = _mm_max_ps(peaks, _mm_andnot_ps(signMask, values));
+        sums = _mm_add_ps(sums, _mm_mul_ps(values, values));
+    }
+    alignas(16) float peakLanes[4];
+    alignas(16) float sumLanes[4];
+    _mm_store_ps(peakLanes, peaks);
+    _mm_store_ps(sumLanes, sums);
+    for (int lane = 0; lane < 4; lane++) {
+        blockPeak = juce::jmax(blockPeak, peakLanes[lane]);
+        blockSum += sumLanes[lane];
+    }
+#elif MULTIDEXED_HAS_NEON
+    float32x4_t peaks = vdupq_n_f32(0.0f);
+    float32x4_t sums = vdupq_n_f32(0.0f);
+    for (; sample + 4 <= numSamples; sample += 4) {
+        const float32x4_t values = vld1q_f32(samples + sample);
+        peaks = vmaxq_f32(peaks, vabsq_f32(values));
+        sums = vmlaq_f32(sums, values, values);
+    }
+    blockPeak = juce::jmax(blockPeak, vmaxvq_f32(peaks));
+    blockSum += vaddvq_f32(sums);
+#endif
+
+    for (; sample < numSamples; sample++) {
+        blockPeak = juce::jmax(blockPeak, std::abs(samples[sample]));
+        blockSum += samples[sample] * samples[sample];
+    }
+
+    peak = blockPeak;
+    sumOfSquares += blockSum;
+}
+
+} // namespace
+
+InstanceLevelMeters::InstanceLevelMeters()
+{
+    for (auto &snapshot : snapshots) {
+        for (int i = 0; i < maximumNumberOfInstances; i++) {
+            snapshot.peak[i] = 0.0f;
+            snapshot.rms[i] = 0.0f;
+            snapshot.clipping[i] = false;
+        }
+    }
+}
+
+void InstanceLevelMeters::reset()
+{
+    for (int i = 0; i < maximumNumberOfInstances; i++) {
+        currentLevels[i] = {};
+        clipHoldRemaining[i] = 0.0;
+        meanSquare[i] = 0.0f;
+    }
+    publish(0);
+}
+
+float InstanceLevelMeters::measureBlock(int instance, const juce::AudioBuffer<float> &buffer, int numSamples, double blockSeconds)
+{
+    float peak = 0.0f;
+    float sumOfSquares = 0.0f;
+    const int numChannels = buffer.getNumChannels();
+    for (int channel = 0; channel < numChannels; channel++) {
+        measureChannel(buffer.getReadPointer(channel), numSamples, peak, sumOfSquares);
+    }
+
+    if (numChannels > 0 && numSamples > 0) {
+        updateLevels(instance, peak, sumOfSquares / static_cast<float>(numChannels * numSamples), blockSeconds);
+    }
+    return peak;
+}
+
+void InstanceLevelMeters::recordSilence(int instance, double blockSeconds)
+{
+    updateLevels(instance, 0.0f, 0.0f, blockSeconds);
+}
+
+void InstanceLevelMeters::updateLevels(int instance, float blockPeak, float blockMeanSquare, double blockSeconds)
+{
+    if (!juce::isPositiveAndBelow(instance, maximumNumberOfInstances)) {
+        return;
+    }
+
+    auto &levels = currentLevels[instance];
+
+    // Peaks show at once and then fall back; -20 dB per second is a factor of 0.1 per second
+    const float fallback = static_cast<float>(std::pow(10.0, -peakFallbackDecibelsPerSecond / 20.0 * blockSeconds));
+    levels.peak = juce::jmax(blockPeak, levels.peak * fallback);
+
+    const float weight = static_cast<float>(1.0 - std::exp(-blockSeconds / rmsWindowSeconds));
+    meanSquare[instance] += weight * (blockMeanSquare - meanSquare[instance]);
+    levels.rms = std::sqrt(meanSquare[instance]);
+
+    if (blockPeak >= 1.0f) {
+        clipHoldRemaining[instance] = clipHoldSeconds;
+    } else {
+        clipHoldRemaining[instance] = juce::jmax(0.0, clipHoldRemaining[instance] - blockSeconds);
+    }
+    levels.clipping = clipHoldRemaining[instance] > 0.0;
+}
+
+void InstanceLevelMeters::publish(int numberOfInstances)
+{
+    numberOfInstances = juce::jlimit(0, maximumNumberOfInstances, numberOfInstances);
+
+    // Announce the write before touching the snapshot, so that a reader of it knows to retry
+    const uint32_t publication = finishedPublications.load(std::memory_order_relaxed) + 1;
+    startedPublications.store(publication, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    auto &snapshot = snapshots[publication & 1];
+    for (int i = 0; i < numberOfInstances; i++) {
+        snapshot.peak[i].store(currentLevels[i].peak, std::memory_order_relaxed);
+        snapshot.rms[i].store(currentLevels[i].rms, std::memory_order_relaxed);
+        snapshot.clipping[i].store(currentLevels[i].clipping, std::memory_order_relaxed);
+    }
+    snapshot.numberOfInstances.store(numberOfInstances, std::memory_order_relaxed);
+
+    finishedPublications.store(publication, std::memory_order_release);
+}
+
+int InstanceLevelMeters::getLevels(Levels *destination, int maximumNumberOfLevels) const
+{
+    for (;;) {
+        const uint32_t publication = finishedPublications.load(std::memory_order_acquire);
+        const auto &snapshot = snapshots[publication & 1];
+
+        const int numberOfLevels = juce::jmin(maximumNumberOfLevels, snapshot.numberOfInstances.load(std::memory_order_relaxed));
+        for (int i = 0; i < numberOfLevels; i++) {
+            destination[i].peak = snapshot.peak[i].load(std::memory_order_relaxed);
+            destination[i].rms = snapshot.rms[i].load(std::memory_order_relaxed);
+            destination[i].clipping = snapshot.clipping[i].load(std::memory_order_relaxed);
+        }
+
+        // The snapshot is only written again by publication + 2
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (startedPublications.load(std::memory_order_relaxed) - publication < 2) {
+            return numberOfLevels;
+        }
+    }
+}
@@ -0,0 +1,92 @@
+/*
+  ==============================================================================
+
+    Peak and RMS level of every instance, measured on the audio thread and
+    read by the editor.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <atomic>
+
+//==============================================================================
+/**
+    Measures the buffer every instance rendered and publishes the levels once
+    per block.
+
+    measureBlock(), recordSilence() and publish() are called on the audio
+    thread only and do not lock or allocate. The levels are written into one of
+    two snapshots while the editor reads the other; getLevels() may be called
+    from any one other thread and only retries in the rare case that the audio
+    thread has published twice while it was copying.
+
+    The peak falls back at a fixed rate and the RMS is smoothed over
+    rmsWindowSeconds, so that a reader that only looks a few times per second
+    still sees every transient.
+ */
+class InstanceLevelMeters
+{
+public:
+    InstanceLevelMeters();
+
+    static constexpr int maximumNumberOfInstances = 64;
+
+    // How fast the shown peak falls back, in dB per second
+    static constexpr float peakFallbackDecibelsPerSecond = 20.0f;
+
+    // Time constant of the RMS
+    static constexpr double rmsWindowSeconds = 0.3;
+
+    // How long an instance counts as clipping after a sample reached full scale
+    static constexpr double clipHoldSeconds = 1.0;
+
+    struct Levels
+    {
+        float peak = 0.0f;
+        float rms = 0.0f;
+        bool clipping = false;
+    };
+
+    // Forgets all levels, e.g. in prepareToPlay
+    void reset();
+
+    // Measures the block the instance rendered and returns its peak over all channels
+    float measureBlock(int instance, const juce::AudioBuffer<float> &buffer, int numSamples, double blockSeconds);
+
+    // Lets the levels of an instance that did not render fall back
+    void recordSilence(int instance, double blockSeconds);
+
+    // Makes the levels of the first numberOfInstances instances visible to getLevels()
+    void publish(int numberOfInstances);
+
+    // Copies the latest published levels and returns for how many instances they are
+    int getLevels(Levels *destination, int maximumNumberOfLevels) const;
+
+private:
+    void updateLevels(int instance, float blockPeak, float blockMeanSquare, double blockSeconds);
+
+    // Levels as the audio thread sees them
+    Levels currentLevels[maximumNumberOfInstances];
+    double clipHoldRemaining[maximumNumberOfInstances] = {};
+    float meanSquare[maximumNumberOfInstances] = {};
+
+    struct Snapshot
+    {
+        std::atomic<float> peak[maximumNumberOfInstances];
+        std::atomic<float> rms[maximumNumberOfInstances];
+        std::atomic<bool> clipping[maximumNumberOfInstances];
+        std::atomic<int> numberOfInstances { 0 };
+    };
+
+    // Snapshot n & 1 holds publication n; the reader checks that the writer has not started on its
+    // snapshot again while it was copying
+    Snapshot snapshots[2];
+    std::atomic<uint32_t> startedPublications { 0 };
+    std::atomic<uint32_t> finishedPublications { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(InstanceLevelMeters)
+};
@@ -0,0 +1,74 @@
+#include "InstanceLoader.h"
+#include "DexedLocator.h"
+#include "RealtimeLog.h"
+
+InstanceLoader::InstanceLoader(juce::AudioPluginFormatManager &manager)
+    : juce::Thread("Dexed scan"), formatManager(manager)
+{
+}
+
+InstanceLoader::~InstanceLoader()
+{
+    // A scan cannot be cut short, and it must not outlive the format manager
+    signalThreadShouldExit();
+    waitForThreadToExit(-1);
+}
+
+void InstanceLoader::startScan()
+{
+    jassert(!isThreadRunning() && !hasScanned());
+
+    startThread(juce::Thread::Priority::normal);
+}
+
+void InstanceLoader::run()
+{
+    const juce::FileSearchPath searchPath = DexedLocator::getSearchPath();
+    const juce::File module = DexedLocator::findModule(searchPath);
+
+    // Log the plugin path or error if not found
+    if (!module.exists()) {
+        RealtimeLog::write(RealtimeLog::Level::error, "Dexed not found in {}", searchPath.toString());
+    } else {
+        RealtimeLog::write(RealtimeLog::Level::info, "Dexed found at {}", module.getFullPathName());
+        if (formatManager.getNumFormats() > 0) {
+            description = DexedLocator::getDescription(module, *formatManager.getFormat(0));
+        }
+    }
+    scanned.store(true, std::memory_order_release);
+}
+
+bool InstanceLoader::requestInstance(int index, double sampleRate, int blockSize)
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+    jassert(getDescription() != nullptr);
+
+    // Formats that can only create instances synchronously create them one at a time
+    int maximumCreations = 1;
+    for (int i = 0; i < formatManager.getNumFormats(); i++) {
+        auto *format = formatManager.getFormat(i);
+        if (format->getName() == description->pluginFormatName && format->requiresUnblockedMessageThreadDuringCreation(*description)) {
+            maximumCreations = maximumConcurrentCreations;
+        }
+    }
+
+    if (pendingCreations >= maximumCreations) {
+        return false;
+    }
+
+    pendingCreations++;
+    juce::WeakReference<InstanceLoader> weakThis(this);
+    formatManager.createPluginInstanceAsync(*description, sampleRate, blockSize,
+        [weakThis, index](std::unique_ptr<juce::AudioPluginInstance> instance, const juce::String &error) {
+            // The instance is deleted with the callback if we are gone
+            if (weakThis == nullptr) {
+                return;
+            }
+
+            weakThis->pendingCreations--;
+            if (weakThis->onInstanceCreated != nullptr) {
+                weakThis->onInstanceCreated(index, std::move(instance), error);
+            }
+        });
+    return true;
+}
@@ -0,0 +1,65 @@
+/*
+  ==============================================================================
+
+    Finds Dexed and creates its instances without blocking the host while
+    a project with many MultiDexed tracks is being loaded.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <atomic>
+#include <functional>
+
+//==============================================================================
+/**
+    Finds and scans the Dexed module on a background thread, see DexedLocator,
+    then creates instances of it with
+    AudioPluginFormatManager::createPluginInstanceAsync().
+
+    Formats that create their instances asynchronously get up to
+    maximumConcurrentCreations of them at a time. The others, VST3 among
+    them, are created on the message thread one at a time, and the message
+    thread is free between one instance and the next. Everything but the
+    scan happens on the message thread.
+ */
+class InstanceLoader : private juce::Thread
+{
+public:
+    explicit InstanceLoader(juce::AudioPluginFormatManager &formatManager);
+    ~InstanceLoader() override;
+
+    static constexpr int maximumConcurrentCreations = 4;
+
+    // Starts looking for Dexed in the background
+    void startScan();
+
+    // Whether the scan has finished; getDescription() is nullptr if it did not find Dexed
+    bool hasScanned() const { return scanned.load(std::memory_order_acquire); }
+    const juce::PluginDescription *getDescription() const { return hasScanned() ? description.get() : nullptr; }
+
+    // Starts creating the instance with the given index, unless as many creations as the format
+    // allows are under way already; returns whether it was started
+    bool requestInstance(int index, double sampleRate, int blockSize);
+
+    // Called on the message thread with every instance created, or with nullptr and the error.
+    // May be called from within requestInstance().
+    std::function<void(int index, std::unique_ptr<juce::AudioPluginInstance> instance, const juce::String &error)> onInstanceCreated;
+
+private:
+    void run() override;
+
+    juce::AudioPluginFormatManager &formatManager;
+
+    std::unique_ptr<juce::PluginDescription> description;
+    std::atomic<bool> scanned { false };
+
+    // Creations requested but not finished yet
+    int pendingCreations = 0;
+
+    JUCE_DECLARE_WEAK_REFERENCEABLE(InstanceLoader)
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(InstanceLoader)
+};
@@ -0,0 +1,215 @@
+#include "InstanceRenderPool.h"
+#include "TraceRecorder.h"
+
+#include <thread>
+
+#if JUCE_INTEL
+#  include <immintrin.h>
+#endif
+
+namespace {
+
+// How often a waiting thread polls before it backs off
+constexpr int spinIterations = 4000;
+
+inline void spinPause()
+{
+#if JUCE_INTEL
+    _mm_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+} // namespace
+
+//==============================================================================
+class InstanceRenderPool::Worker : public juce::Thread
+{
+public:
+    Worker(InstanceRenderPool &p, int i)
+        : juce::Thread("MultiDexed Render " + juce::String(i)), pool(p), index(i)
+    {
+    }
+
+    ~Worker() override { stop(); }
+
+    void start()
+    {
+        // Prefer real-time scheduling, but keep going with a high priority thread
+        // if the system does not allow it (e.g. no rtprio limit on Linux)
+        if (!startRealtimeThread(juce::Thread::RealtimeOptions {})) {
+            startThread(juce::Thread::Priority::highest);
+        }
+    }
+
+    void stop()
+    {
+        signalThreadShouldExit();
+        wake();
+        stopThread(1000);
+    }
+
+    // Called by the audio thread after a new batch has been published
+    void wake()
+    {
+        if (parked.exchange(false, std::memory_order_acq_rel)) {
+            wakeEvent.signal();
+        }
+    }
+
+    void run() override
+    {
+        uint32_t lastGeneration = generationOf(pool.state.load(std::memory_order_acquire));
+
+        while (!threadShouldExit()) {
+            uint32_t generation = waitForNextGeneration(lastGeneration);
+            if (generation == lastGeneration) {
+                continue;
+            }
+            lastGeneration = generation;
+
+            // Only the first workersToUse workers take part in a batch
+            if (index < pool.workersToUse.load(std::memory_order_acquire)) {
+                pool.participate(generation);
+            }
+        }
+
+        TraceRecorder::releaseThreadBuffer();
+    }
+
+private:
+    // Spins for a while, then parks until the audio thread publishes a new batch
+    uint32_t waitForNextGeneration(uint32_t lastGeneration)
+    {
+        for (int i = 0; i < spinIterations; i++) {
+            uint32_t generation = generationOf(pool.state.load(std::memory_order_acquire));
+            if (generation != lastGeneration || threadShouldExit()) {
+                return generation;
+            }
+            spinPause();
+        }
+
+        parked.store(true, std::memory_order_release);
+
+        // Re-check after announcing that we park, so that a batch published in
+        // between is not missed
+        uint32_t generation = generationOf(pool.state.load(std::memory_order_acquire));
+        if (generation != lastGeneration || threadShouldExit()) {
+            parked.store(false, std::memory_order_release);
+            return generation;
+        }
+
+        wakeEvent.wait(100);
+        parked.store(false, std::memory_order_release);
+        return generationOf(pool.state.load(std::memory_order_acquire));
+    }
+
+    InstanceRenderPool &pool;
+    const int index;
+    std::atomic<bool> parked { false };
+    juce::WaitableEvent wakeEvent;
+};
+
+//==============================================================================
+InstanceRenderPool::InstanceRenderPool() { }
+
+InstanceRenderPool::~InstanceRenderPool()
+{
+    stop();
+}
+
+void InstanceRenderPool::start(int numberOfWorkers)
+{
+    numberOfWorkers = juce::jlimit(0, maximumNumberOfWorkers, numberOfWorkers);
+
+    if (numberOfWorkers == workers.size()) {
+        return;
+    }
+
+    stop();
+
+    for (int i = 0; i < numberOfWorkers; i++) {
+        workers.add(new Worker(*this, i));
+    }
+
+    for (auto *worker : workers) {
+        worker->start();
+    }
+}
+
+void InstanceRenderPool::stop()
+{
+    for (auto *worker : workers) {
+        worker->stop();
+    }
+    workers.clear();
+}
+
+void InstanceRenderPool::run(Job &job, int numberOfJobs, int numberOfWorkersToUse)
+{
+    jassert(numberOfJobs >= 0 && numberOfJobs < 0x10000);
+
+    numberOfWorkersToUse = juce::jlimit(0, workers.size(), numberOfWorkersToUse);
+
+    // Nothing to hand off, render everything right here
+    if (numberOfWorkersToUse == 0 || numberOfJobs < 2) {
+        for (int i = 0; i < numberOfJobs; i++) {
+            job.renderJob(i);
+        }
+        return;
+    }
+
+    // Publish the batch; the previous one is complete, so nobody reads these fields now
+    uint32_t generation = generationOf(state.load(std::memory_order_relaxed)) + 1;
+    currentJob.store(&job, std::memory_order_relaxed);
+    jobsDone.store(0, std::memory_order_relaxed);
+    workersToUse.store(numberOfWorkersToUse, std::memory_order_relaxed);
+    state.store((static_cast<uint64_t>(generation) << 32)
+                        | (static_cast<uint64_t>(numberOfJobs) << 16),
+                std::memory_order_release);
+
+    for (int i = 0; i < numberOfWorkersToUse; i++) {
+        workers.getUnchecked(i)->wake();
+    }
+
+    // The audio thread renders as well instead of just waiting
+    participate(generation);
+
+    // Barrier: spin until the workers have finished the jobs they claimed.
+    // The audio thread never blocks here, it only yields after a while.
+    int spins = 0;
+    while (jobsDone.load(std::memory_order_acquire) < numberOfJobs) {
+        if (++spins < spinIterations) {
+            spinPause();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void InstanceRenderPool::participate(uint32_t generation)
+{
+    uint64_t current = state.load(std::memory_order_acquire);
+
+    for (;;) {
+        if (generationOf(current) != generation) {
+            return;
+        }
+
+        int numberOfJobs = static_cast<int>((current >> 16) & 0xffff);
+        int nextJob = static_cast<int>(current & 0xffff);
+        if (nextJob >= numberOfJobs) {
+            return;
+        }
+
+        if (state.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel,
+                                        std::memory_order_acquire)) {
+            // The batch cannot complete before this job is counted as done,
+            // so the job stays valid while we render it
+            currentJob.load(std::memory_order_acquire)->renderJob(nextJob);
+            jobsDone.fetch_add(1, std::memory_order_release);
+            current = state.load(std::memory_order_acquire);
+        }
+    }
+}
@@ -0,0 +1,74 @@
+/*
+  ==============================================================================
+
+    A small pool of pre-spawned real-time worker threads that render the
+    Dexed instances in parallel inside processBlock.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <atomic>
+
+//==============================================================================
+/**
+    Fixed pool of worker threads used to spread the per-instance renders of a
+    block over several cores.
+
+    The audio thread publishes a batch of jobs with run(), renders jobs itself
+    as well, and then waits on a lock-free barrier until every job of the batch
+    has finished. Workers spin for a short while after each batch and then
+    park on an event, so an idle pool costs nothing.
+ */
+class InstanceRenderPool
+{
+public:
+    // Implemented by whoever owns the work; renderJob() is called exactly once
+    // per job index, on the audio thread or on one of the workers
+    struct Job
+    {
+        virtual ~Job() = default;
+        virtual void renderJob(int jobIndex) = 0;
+    };
+
+    InstanceRenderPool();
+    ~InstanceRenderPool();
+
+    // Spawns the worker threads. Must not be called from the audio thread.
+    void start(int numberOfWorkers);
+
+    // Stops and joins all worker threads. Must not be called from the audio thread.
+    void stop();
+
+    int getNumberOfWorkers() const { return workers.size(); }
+
+    // Renders jobs 0..numberOfJobs-1 using the audio thread and up to
+    // numberOfWorkersToUse workers, and returns once all of them are done.
+    // Does not lock or allocate.
+    void run(Job &job, int numberOfJobs, int numberOfWorkersToUse);
+
+    // Upper bound for the number of workers, regardless of the number of cores
+    static constexpr int maximumNumberOfWorkers = 8;
+
+private:
+    class Worker;
+
+    // Claims and renders jobs of the given generation until there are none left
+    void participate(uint32_t generation);
+
+    static uint32_t generationOf(uint64_t state) { return static_cast<uint32_t>(state >> 32); }
+
+    // Generation, number of jobs and index of the next unclaimed job, packed
+    // into one word so that a job can only be claimed for the current batch
+    std::atomic<uint64_t> state { 0 };
+    std::atomic<Job *> currentJob { nullptr };
+    std::atomic<int> jobsDone { 0 };
+    std::atomic<int> workersToUse { 0 };
+
+    juce::OwnedArray<Worker> workers;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(InstanceRenderPool)
+};
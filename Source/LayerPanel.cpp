@@ -0,0 +1,79 @@
+#include "LayerPanel.h"
+
+namespace {
+
+const char *const columnNames[] = { "Voices", "Detune", "Pan", "Lowest key", "Highest key", "Lowest vel.", "Highest vel." };
+
+// The parameters of the main group, and those of layer N with "layerN" in front
+const char *const mainParameterIDs[] = { "unisonVoices", "detuneSpread", "panSpread",
+                                         "keyRangeLow", "keyRangeHigh", "velocityRangeLow", "velocityRangeHigh" };
+const char *const layerParameterIDs[] = { "Voices", "DetuneSpread", "PanSpread",
+                                          "KeyRangeLow", "KeyRangeHigh", "VelocityRangeLow", "VelocityRangeHigh" };
+
+bool isKeyColumn(int column)
+{
+    return column == 3 || column == 4;
+}
+
+} // namespace
+
+LayerPanel::LayerPanel(juce::AudioProcessorValueTreeState &apvts, int numberOfLayers)
+{
+    for (int column = 0; column < numberOfColumns; column++) {
+        auto &label = columnLabels[static_cast<size_t>(column)];
+        addAndMakeVisible(label);
+        label.setText(columnNames[column], juce::dontSendNotification);
+        label.setJustificationType(juce::Justification::centred);
+    }
+
+    for (int layer = 0; layer < numberOfLayers; layer++) {
+        auto *row = rows.add(new Row());
+
+        addAndMakeVisible(row->nameLabel);
+        row->nameLabel.setText("Layer " + juce::String(layer + 1), juce::dontSendNotification);
+
+        for (int column = 0; column < numberOfColumns; column++) {
+            auto &slider = row->sliders[static_cast<size_t>(column)];
+            addAndMakeVisible(slider);
+            slider.setSliderStyle(juce::Slider::SliderStyle::LinearBar);
+
+            // Keys by name, e.g. C3 as in Dexed; must be set before the attachment, which keeps it then
+            if (isKeyColumn(column)) {
+                slider.textFromValueFunction = [](double value) {
+                    return juce::MidiMessage::getMidiNoteName(static_cast<int>(value), true, true, 3);
+                };
+            }
+
+            const juce::String parameterID = layer == 0 ? juce::String(mainParameterIDs[column])
+                                                        : "layer" + juce::String(layer + 1) + layerParameterIDs[column];
+            row->attachments[static_cast<size_t>(column)] = std::make_unique<juce::AudioProcessorValueTreeState::SliderAttachment>(apvts, parameterID, slider);
+        }
+    }
+}
+
+void LayerPanel::paint(juce::Graphics &g)
+{
+    // Lies over the Dexed editor like the performance HUD
+    g.fillAll(juce::Colours::black.withAlpha(0.8f));
+}
+
+void LayerPanel::resized()
+{
+    auto area = getLocalBounds().reduced(10);
+    const int columnWidth = juce::jmax(0, (area.getWidth() - nameWidth) / numberOfColumns);
+
+    auto header = area.removeFromTop(rowHeight);
+    header.removeFromLeft(nameWidth);
+    for (auto &label : columnLabels) {
+        label.setBounds(header.removeFromLeft(columnWidth));
+    }
+
+    for (auto *row : rows) {
+        area.removeFromTop(4);
+        auto line = area.removeFromTop(rowHeight);
+        row->nameLabel.setBounds(line.removeFromLeft(nameWidth));
+        for (auto &slider : row->sliders) {
+            slider.setBounds(line.removeFromLeft(columnWidth).reduced(2, 0));
+        }
+    }
+}
@@ -0,0 +1,53 @@
+/*
+  ==============================================================================
+
+    Panel with the voices, spreads and note ranges of the main group and of
+    the unison layers.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <array>
+#include <memory>
+
+//==============================================================================
+/**
+    A row of sliders per layer, attached to the apvts parameters: layer 1 is
+    the main group, whose unisonVoices, detuneSpread and panSpread are also on
+    the main controls, and layers 2 and up are the UnisonLayer objects of the
+    processor. A layer plays the keys and velocities within its ranges, so
+    layers with ranges that overlap are stacked and layers whose key ranges
+    are apart split the keyboard.
+ */
+class LayerPanel : public juce::Component
+{
+public:
+    LayerPanel(juce::AudioProcessorValueTreeState &apvts, int numberOfLayers);
+
+    void paint(juce::Graphics &g) override;
+    void resized() override;
+
+private:
+    static constexpr int numberOfColumns = 7;
+
+    struct Row
+    {
+        juce::Label nameLabel;
+        std::array<juce::Slider, numberOfColumns> sliders;
+
+        // Declared after the sliders, so that they are destroyed first
+        std::array<std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment>, numberOfColumns> attachments;
+    };
+
+    juce::OwnedArray<Row> rows;
+    std::array<juce::Label, numberOfColumns> columnLabels;
+
+    static constexpr int rowHeight = 24;
+    static constexpr int nameWidth = 70;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LayerPanel)
+};
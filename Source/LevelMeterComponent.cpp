@@ -0,0 +1,46 @@
+#include "LevelMeterComponent.h"
+
+LevelMeterComponent::LevelMeterComponent()
+{
+    // Clicks go to the tab the meter is on
+    setInterceptsMouseClicks(false, false);
+}
+
+void LevelMeterComponent::setLevels(const InstanceLevelMeters::Levels &newLevels)
+{
+    const float newPeak = toProportion(newLevels.peak);
+    const float newRms = toProportion(newLevels.rms);
+
+    // Less than a pixel of change is not worth a repaint
+    const float pixel = 1.0f / static_cast<float>(juce::jmax(1, getWidth()));
+    if (std::abs(newPeak - peakProportion) < pixel && std::abs(newRms - rmsProportion) < pixel && newLevels.clipping == clipping) {
+        return;
+    }
+
+    peakProportion = newPeak;
+    rmsProportion = newRms;
+    clipping = newLevels.clipping;
+    repaint();
+}
+
+float LevelMeterComponent::toProportion(float level)
+{
+    const float decibels = juce::Decibels::gainToDecibels(level, minimumDecibels);
+    return juce::jlimit(0.0f, 1.0f, juce::jmap(decibels, minimumDecibels, 0.0f, 0.0f, 1.0f));
+}
+
+void LevelMeterComponent::paint(juce::Graphics &g)
+{
+    auto area = getLocalBounds().toFloat();
+    g.setColour(juce::Colours::black.withAlpha(0.4f));
+    g.fillRect(area);
+
+    const juce::Colour colour = clipping ? juce::Colours::red : juce::Colours::limegreen;
+    g.setColour(colour.withAlpha(0.8f));
+    g.fillRect(area.withWidth(area.getWidth() * rmsProportion));
+
+    if (peakProportion > 0.0f) {
+        g.setColour(colour);
+        g.fillRect(area.getX() + juce::jmax(0.0f, area.getWidth() * peakProportion - 1.0f), area.getY(), 1.0f, area.getHeight());
+    }
+}
@@ -0,0 +1,40 @@
+/*
+  ==============================================================================
+
+    A small level meter, shown next to the name of an instance's tab.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "InstanceLevelMeters.h"
+
+//==============================================================================
+/**
+    Draws the RMS as a bar and the peak as a line on a decibel scale, in red
+    while the instance is clipping. Only repaints when what it shows changes.
+ */
+class LevelMeterComponent : public juce::Component
+{
+public:
+    LevelMeterComponent();
+
+    // Lowest level shown
+    static constexpr float minimumDecibels = -60.0f;
+
+    void setLevels(const InstanceLevelMeters::Levels &newLevels);
+
+    void paint(juce::Graphics &g) override;
+
+private:
+    // Share of the width the level takes up
+    static float toProportion(float level);
+
+    float peakProportion = 0.0f;
+    float rmsProportion = 0.0f;
+    bool clipping = false;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LevelMeterComponent)
+};
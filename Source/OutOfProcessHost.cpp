@@ -0,0 +1,484 @@
+#include "OutOfProcessHost.h"
+#include "RealtimeLog.h"
+
+class OutOfProcessHost::Helper : public juce::ChildProcessCoordinator
+{
+public:
+    Helper()
+    {
+        missedMidi.ensureSize(SharedRenderChannel::midiCapacity * 2);
+    }
+
+    ~Helper() override
+    {
+        killWorkerProcess();
+    }
+
+    // Called on the connection thread when the helper exits or crashes
+    void handleConnectionLost() override
+    {
+        connected = false;
+    }
+
+    void handleMessageFromWorker(const juce::MemoryBlock &) override {}
+
+    SharedRenderChannel channel;
+
+    // Set while the process runs and channel is open; cleared under lock
+    std::atomic<bool> running { false };
+    std::atomic<bool> connected { false };
+
+    // Held by the audio thread from startBlock() to finishBlock(), and by the message thread while it stops the helper
+    juce::SpinLock lock;
+
+    // Message thread: the followers it was sent, and the state generation they were sent with
+    uint64_t assignedInstances = 0;
+    uint32_t sentStateGeneration = 0;
+
+    // Audio thread
+    bool isLocked = false;
+    uint64_t postedInstances = 0;
+    uint32_t postedRequest = 0;
+
+    // MIDI of the blocks the helper was too late for, played at the start of its next one; no more
+    // than the channel takes in one block, missedMidiSize counting it the way the channel does
+    juce::MidiBuffer missedMidi;
+    int missedMidiSize = 0;
+    bool needsAllNotesOff = false;
+};
+
+namespace {
+
+void addAllNotesOff(juce::MidiBuffer &midi)
+{
+    for (int channel = 1; channel <= 16; channel++) {
+        midi.addEvent(juce::MidiMessage::allNotesOff(channel), 0);
+    }
+}
+
+juce::String createChannelName()
+{
+    const juce::String id = juce::String::toHexString(juce::Random::getSystemRandom().nextInt64());
+
+#if JUCE_WINDOWS
+    return "Local\\multidexed-" + id;
+#else
+    // Short, macOS allows no more than 31 characters
+    return "/mdx-" + id;
+#endif
+}
+
+} // namespace
+
+OutOfProcessHost::OutOfProcessHost()
+{
+    // All helpers exist from the start, so that the audio thread never sees one go away
+    for (int i = 0; i < maximumNumberOfHelpers; i++) {
+        helpers.add(new Helper());
+    }
+}
+
+OutOfProcessHost::~OutOfProcessHost()
+{
+    release();
+}
+
+juce::File OutOfProcessHost::findHelperExecutable()
+{
+#if JUCE_WINDOWS
+    const juce::String name = "MultiDexed.exe";
+#elif JUCE_MAC
+    const juce::String name = "MultiDexed.app/Contents/MacOS/MultiDexed";
+#else
+    const juce::String name = "MultiDexed";
+#endif
+
+    // The standalone build sits next to the plugin in the build folder, and when we are the
+    // standalone application ourselves the helpers are copies of us
+    auto directory = juce::File::getSpecialLocation(juce::File::currentExecutableFile).getParentDirectory();
+    for (int level = 0; level < 4 && directory.exists(); level++) {
+        const auto file = directory.getChildFile(name);
+        if (file.existsAsFile()) {
+            return file;
+        }
+        directory = directory.getParentDirectory();
+    }
+
+    juce::Array<juce::File> installed;
+#if JUCE_WINDOWS
+    installed.add(juce::File::getSpecialLocation(juce::File::globalApplicationsDirectory).getChildFile("MultiDexed").getChildFile(name));
+#elif JUCE_MAC
+    installed.add(juce::File("/Applications").getChildFile(name));
+#else
+    installed.add(juce::File("/usr/local/bin").getChildFile(name));
+    installed.add(juce::File("/usr/bin").getChildFile(name));
+#endif
+
+    for (const auto &file : installed) {
+        if (file.existsAsFile()) {
+            return file;
+        }
+    }
+
+    return {};
+}
+
+void OutOfProcessHost::setPluginDescription(const juce::PluginDescription &description)
+{
+    pluginDescription = description.createXml();
+}
+
+void OutOfProcessHost::prepare(double newSampleRate, int newMaximumBlockSize, int newNumberOfChannels)
+{
+    // The channels are sized for the block size, so start over
+    release();
+
+    sampleRate = newSampleRate;
+    maximumBlockSize = newMaximumBlockSize;
+    numberOfChannels = newNumberOfChannels;
+    isPrepared = true;
+    launchFailed = false;
+}
+
+void OutOfProcessHost::release()
+{
+    isPrepared = false;
+    for (auto *helper : helpers) {
+        stop(*helper);
+    }
+}
+
+bool OutOfProcessHost::launch(Helper &helper)
+{
+    const auto executable = findHelperExecutable();
+    if (!executable.existsAsFile() || pluginDescription == nullptr) {
+        return false;
+    }
+
+    const auto name = createChannelName();
+    if (!helper.channel.create(name, numberOfChannels, maximumBlockSize)) {
+        return false;
+    }
+
+    helper.connected = true;
+    if (!helper.launchWorkerProcess(executable, commandLineUniqueID, 2000)) {
+        helper.connected = false;
+        helper.channel.close();
+        return false;
+    }
+
+    juce::MemoryOutputStream message;
+    message.writeInt(static_cast<int>(MessageType::initialise));
+    message.writeString(name);
+    message.writeString(pluginDescription->toString());
+    message.writeDouble(sampleRate);
+    message.writeInt(maximumBlockSize);
+    if (!helper.sendMessageToWorker(message.getMemoryBlock())) {
+        stop(helper);
+        return false;
+    }
+
+    helper.assignedInstances = 0;
+    helper.sentStateGeneration = 0;
+    helper.running.store(true, std::memory_order_release);
+    return true;
+}
+
+void OutOfProcessHost::stop(Helper &helper)
+{
+    {
+        // Waits for the audio thread to be done with the channel
+        const juce::SpinLock::ScopedLockType lock(helper.lock);
+        helper.running.store(false, std::memory_order_release);
+    }
+
+    helper.killWorkerProcess();
+    helper.channel.close();
+    helper.connected = false;
+
+    // Whichever helper gets them next needs their states
+    for (int i = 0; i < SharedRenderChannel::maximumNumberOfInstances; i++) {
+        if (helper.assignedInstances & (uint64_t(1) << i)) {
+            sentParameters[static_cast<size_t>(i)].clear();
+        }
+    }
+    helper.assignedInstances = 0;
+}
+
+void OutOfProcessHost::update(int numberOfHelpers, int numberOfInstances, juce::AudioProcessor *const *instances,
+                              const ParameterSync &parameterSync)
+{
+    numberOfHelpers = juce::jlimit(0, maximumNumberOfHelpers, numberOfHelpers);
+    if (numberOfHelpers != wantedNumberOfHelpers) {
+        wantedNumberOfHelpers = numberOfHelpers;
+        launchFailed = false;
+    }
+
+    if (!isPrepared || pluginDescription == nullptr || !parameterSync.isAttached()) {
+        numberOfHelpers = 0;
+    }
+
+    // Stop what is not wanted any more, and clean up after helpers that crashed; those are launched again below
+    for (int i = 0; i < maximumNumberOfHelpers; i++) {
+        auto &helper = *helpers[i];
+        if (helper.running && (i >= numberOfHelpers || !helper.connected)) {
+            if (!helper.connected) {
+                RealtimeLog::write(RealtimeLog::Level::warning, "Render helper {} exited, starting it again", i);
+            }
+            stop(helper);
+        }
+    }
+
+    for (int i = 0; i < numberOfHelpers && !launchFailed; i++) {
+        if (!helpers[i]->running && !launch(*helpers[i])) {
+            RealtimeLog::write(RealtimeLog::Level::warning, "Could not start a render helper, rendering in this process");
+            launchFailed = true;
+        }
+    }
+
+    int runningHelpers[maximumNumberOfHelpers];
+    int numberOfRunningHelpers = 0;
+    for (int i = 0; i < maximumNumberOfHelpers; i++) {
+        if (helpers[i]->running) {
+            runningHelpers[numberOfRunningHelpers++] = i;
+        }
+    }
+
+    // Deal out the followers; instance 0 and instances that are fading out stay here
+    uint64_t assignments[maximumNumberOfHelpers] = {};
+    const int lastInstance = juce::jmin(numberOfInstances, SharedRenderChannel::maximumNumberOfInstances);
+    for (int instance = 1; instance < lastInstance && numberOfRunningHelpers > 0; instance++) {
+        if (instances[instance] != nullptr) {
+            assignments[runningHelpers[(instance - 1) % numberOfRunningHelpers]] |= uint64_t(1) << instance;
+        }
+    }
+
+    const uint32_t generation = stateGeneration.load(std::memory_order_acquire);
+    for (int h = 0; h < numberOfRunningHelpers; h++) {
+        auto &helper = *helpers[runningHelpers[h]];
+        const uint64_t assigned = assignments[runningHelpers[h]];
+
+        if (assigned != helper.assignedInstances || generation != helper.sentStateGeneration) {
+            sendStates(helper, assigned, instances, parameterSync, generation);
+            continue;
+        }
+
+        for (int instance = 1; instance < lastInstance; instance++) {
+            if (assigned & (uint64_t(1) << instance)) {
+                sendParameterChanges(helper, instance, parameterSync);
+            }
+        }
+    }
+}
+
+void OutOfProcessHost::sendStates(Helper &helper, uint64_t assignedInstances, juce::AudioProcessor *const *instances,
+                                  const ParameterSync &parameterSync, uint32_t generation)
+{
+    int numberOfStates = 0;
+    for (int instance = 1; instance < SharedRenderChannel::maximumNumberOfInstances; instance++) {
+        if (assignedInstances & (uint64_t(1) << instance)) {
+            numberOfStates++;
+        }
+    }
+
+    juce::MemoryOutputStream message;
+    message.writeInt(static_cast<int>(MessageType::states));
+    message.writeInt(static_cast<int>(generation));
+    message.writeInt(numberOfStates);
+
+    for (int instance = 1; instance < SharedRenderChannel::maximumNumberOfInstances; instance++) {
+        if (!(assignedInstances & (uint64_t(1) << instance))) {
+            continue;
+        }
+
+        juce::MemoryBlock state;
+        instances[instance]->getStateInformation(state);
+        message.writeInt(instance);
+        message.writeInt(static_cast<int>(state.getSize()));
+        message.write(state.getData(), state.getSize());
+
+        // The state includes the parameters, so this is what the helper has from now on
+        auto &sent = sentParameters[static_cast<size_t>(instance)];
+        sent.resize(static_cast<size_t>(parameterSync.getNumberOfParameters()));
+        for (int index = 0; index < parameterSync.getNumberOfParameters(); index++) {
+            auto *parameter = parameterSync.getParameter(instance, index);
+            sent[static_cast<size_t>(index)] = parameter != nullptr ? parameter->getValue() : 0.0f;
+        }
+    }
+
+    if (helper.sendMessageToWorker(message.getMemoryBlock())) {
+        helper.assignedInstances = assignedInstances;
+        helper.sentStateGeneration = generation;
+    }
+}
+
+void OutOfProcessHost::sendParameterChanges(Helper &helper, int instance, const ParameterSync &parameterSync)
+{
+    auto &sent = sentParameters[static_cast<size_t>(instance)];
+    if (sent.size() != static_cast<size_t>(parameterSync.getNumberOfParameters())) {
+        return;
+    }
+
+    // The detune and the overrides of every follower, and leader changes the helper missed
+    juce::MemoryOutputStream changes;
+    int numberOfChanges = 0;
+    for (int index = 0; index < parameterSync.getNumberOfParameters(); index++) {
+        auto *parameter = parameterSync.getParameter(instance, index);
+        if (parameter == nullptr) {
+            continue;
+        }
+
+        const float value = parameter->getValue();
+        if (value != sent[static_cast<size_t>(index)]) {
+            changes.writeInt(index);
+            changes.writeFloat(value);
+            sent[static_cast<size_t>(index)] = value;
+            numberOfChanges++;
+        }
+    }
+
+    if (numberOfChanges == 0) {
+        return;
+    }
+
+    juce::MemoryOutputStream message;
+    message.writeInt(static_cast<int>(MessageType::parameters));
+    message.writeInt(instance);
+    message.writeInt(numberOfChanges);
+    message.write(changes.getData(), changes.getDataSize());
+    helper.sendMessageToWorker(message.getMemoryBlock());
+}
+
+int OutOfProcessHost::getNumberOfRunningHelpers() const
+{
+    int count = 0;
+    for (auto *helper : helpers) {
+        if (helper->running && helper->connected) {
+            count++;
+        }
+    }
+    return count;
+}
+
+uint64_t OutOfProcessHost::startBlock(const juce::MidiBuffer &midi, int numberOfSamples, bool allNotesOff,
+                                      const ParameterSync::Change *changes, int numberOfChanges, uint64_t instancesInUse)
+{
+    uint64_t remoteInstances = 0;
+    const uint32_t generation = stateGeneration.load(std::memory_order_acquire);
+
+    for (auto *helperPointer : helpers) {
+        auto &helper = *helperPointer;
+        helper.postedInstances = 0;
+        helper.isLocked = false;
+
+        if (!helper.running.load(std::memory_order_acquire) || !helper.lock.tryEnter()) {
+            continue;
+        }
+        helper.isLocked = true;
+
+        // Stopped meanwhile, or the block does not fit into the channel
+        if (!helper.running.load(std::memory_order_acquire) || !helper.connected.load(std::memory_order_relaxed)
+            || numberOfSamples > maximumBlockSize) {
+            continue;
+        }
+
+        auto &header = helper.channel.getHeader();
+        const uint32_t requested = header.requested.load(std::memory_order_relaxed);
+
+        if (header.completed.load(std::memory_order_acquire) != requested) {
+            // Still busy with a block it was too late for; keep the MIDI for its next block. If that
+            // is more than it could get at once, it gets all notes off instead.
+            for (const auto metadata : midi) {
+                if (metadata.samplePosition >= numberOfSamples) {
+                    break;
+                }
+
+                const int eventSize = SharedRenderChannel::getEventSize(metadata.numBytes);
+                if (helper.missedMidiSize + eventSize > SharedRenderChannel::midiCapacity) {
+                    helper.missedMidi.clear();
+                    helper.missedMidiSize = 0;
+                    helper.needsAllNotesOff = true;
+                    break;
+                }
+                helper.missedMidi.addEvent(metadata.data, metadata.numBytes, 0);
+                helper.missedMidiSize += eventSize;
+            }
+            helper.needsAllNotesOff = helper.needsAllNotesOff || allNotesOff;
+            continue;
+        }
+
+        // Until the helper has the current states its instances are rendered here
+        const uint64_t hosted = header.hostedInstances.load(std::memory_order_acquire) & instancesInUse;
+        if (header.loadedStateGeneration.load(std::memory_order_acquire) != generation || hosted == 0) {
+            helper.missedMidi.clear();
+            helper.missedMidiSize = 0;
+            helper.needsAllNotesOff = true;
+            continue;
+        }
+
+        if (helper.needsAllNotesOff || allNotesOff) {
+            addAllNotesOff(helper.missedMidi);
+            helper.needsAllNotesOff = false;
+        }
+        helper.missedMidi.addEvents(midi, 0, numberOfSamples, 0);
+        helper.channel.writeMidi(helper.missedMidi, numberOfSamples);
+        helper.missedMidi.clear();
+        helper.missedMidiSize = 0;
+
+        header.numberOfParameterChanges = juce::jmin(numberOfChanges, SharedRenderChannel::maximumNumberOfParameterChanges);
+        for (int i = 0; i < header.numberOfParameterChanges; i++) {
+            header.parameterChanges[i] = { changes[i].index, changes[i].value };
+        }
+        header.numberOfSamples = numberOfSamples;
+
+        helper.postedRequest = requested + 1;
+        helper.postedInstances = hosted;
+        header.requested.store(helper.postedRequest, std::memory_order_release);
+        helper.channel.wake(header.requested);
+
+        remoteInstances |= hosted;
+    }
+
+    return remoteInstances;
+}
+
+uint64_t OutOfProcessHost::finishBlock(InstanceBufferArena &buffers, int numberOfSamples, double deadline)
+{
+    uint64_t deliveredInstances = 0;
+
+    for (auto *helperPointer : helpers) {
+        auto &helper = *helperPointer;
+        if (!helper.isLocked) {
+            continue;
+        }
+
+        if (helper.postedInstances != 0) {
+            auto &header = helper.channel.getHeader();
+            const double timeout = juce::jmax(0.0, deadline - juce::Time::getMillisecondCounterHiRes()) / 1000.0;
+
+            if (helper.channel.waitWhileEqual(header.completed, helper.postedRequest - 1, timeout)) {
+                const uint64_t rendered = header.renderedInstances.load(std::memory_order_acquire) & helper.postedInstances;
+                for (int instance = 1; instance < SharedRenderChannel::maximumNumberOfInstances; instance++) {
+                    if (!(rendered & (uint64_t(1) << instance))) {
+                        continue;
+                    }
+
+                    auto &buffer = buffers[instance];
+                    const int channels = juce::jmin(buffer.getNumChannels(), header.numberOfChannels);
+                    for (int channel = 0; channel < channels; channel++) {
+                        buffer.copyFrom(channel, 0, helper.channel.getChannel(instance, channel), numberOfSamples);
+                    }
+                }
+                deliveredInstances |= rendered;
+            } else {
+                // Its instances stay silent in this block
+                lateBlocks.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        helper.isLocked = false;
+        helper.lock.exit();
+    }
+
+    return deliveredInstances;
+}
@@ -0,0 +1,142 @@
+/*
+  ==============================================================================
+
+    Renders follower instances in helper processes, so that a crashing Dexed
+    takes down a helper instead of the host, and so that the followers are
+    rendered on other cores than the one the host gives us.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "InstanceBufferArena.h"
+#include "ParameterSync.h"
+#include "SharedRenderChannel.h"
+
+#include <array>
+#include <atomic>
+#include <vector>
+
+//==============================================================================
+/**
+    Starts helper processes, each running the MultiDexed executable in helper
+    mode (see RenderHelperWorker), and hands each of them a share of the
+    follower instances.
+
+    A helper hosts copies of its followers. The followers in this process
+    stay what the editors, the session state and ParameterSync work with;
+    the message thread sends their states and parameter changes to the
+    helpers through a pipe, and the changes ParameterSync copies from the
+    leader travel along with every block.
+
+    Every block is exchanged through a SharedRenderChannel: startBlock()
+    posts the MIDI to all helpers that are done with their previous block,
+    the audio thread renders the rest of the instances meanwhile, and
+    finishBlock() waits for the helpers until a deadline within the block.
+    This adds no latency. A helper that misses the deadline leaves its
+    instances silent for the block and gets the MIDI it missed with its
+    next block; these late blocks are counted and shown in the editor.
+
+    Followers whose helper is not ready, is restarting or has crashed are
+    rendered locally instead.
+ */
+class OutOfProcessHost
+{
+public:
+    OutOfProcessHost();
+    ~OutOfProcessHost();
+
+    static constexpr int maximumNumberOfHelpers = 8;
+
+    // Passed on the command line so that the executable knows it is to run as a helper
+    static constexpr const char *commandLineUniqueID = "multidexed-render-helper";
+
+    // Messages sent to the helpers
+    enum class MessageType
+    {
+        // Channel name, PluginDescription as XML, sample rate, maximum block size
+        initialise,
+
+        // State generation, number of instances, then instance index and state of each
+        states,
+
+        // Instance index, number of changes, then parameter index and value of each
+        parameters
+    };
+
+    // The executable to run as a helper, next to the plugin or installed; a non-existing file if there is none
+    static juce::File findHelperExecutable();
+
+    //==============================================================================
+    // Message thread
+
+    void setPluginDescription(const juce::PluginDescription &description);
+
+    // Stops the helpers; they are started again with the new settings by update()
+    void prepare(double sampleRate, int maximumBlockSize, int numberOfChannels);
+    void release();
+
+    // Starts, restarts or stops helpers until numberOfHelpers are running, spreads followers 1 to
+    // numberOfInstances - 1 over them and sends them what changed in the followers since the last call.
+    // instances has one entry per instance index. Call regularly, e.g. from a timer.
+    void update(int numberOfHelpers, int numberOfInstances, juce::AudioProcessor *const *instances,
+                const ParameterSync &parameterSync);
+
+    // Number of helpers running and blocks they did not deliver in time
+    int getNumberOfRunningHelpers() const;
+    int64_t getNumberOfLateBlocks() const { return lateBlocks.load(std::memory_order_relaxed); }
+
+    //==============================================================================
+    // Audio thread; none of these lock or allocate
+
+    // The states of the followers changed, e.g. because a state was loaded; their
+    // copies are not used until the helpers have the new states
+    void invalidateStates() { stateGeneration.fetch_add(1, std::memory_order_acq_rel); }
+
+    // Posts a block to every helper that is ready for one and returns a bit for every
+    // instance that a helper renders; instancesInUse has a bit for each instance to render
+    uint64_t startBlock(const juce::MidiBuffer &midi, int numberOfSamples, bool allNotesOff,
+                        const ParameterSync::Change *changes, int numberOfChanges, uint64_t instancesInUse);
+
+    // Waits until deadline, in Time::getMillisecondCounterHiRes() units, for the blocks posted
+    // by startBlock() and copies them into buffers. Returns the instances that were delivered.
+    uint64_t finishBlock(InstanceBufferArena &buffers, int numberOfSamples, double deadline);
+
+private:
+    class Helper;
+
+    // Sends the states of the followers assigned to a helper, which replace the copies it has
+    void sendStates(Helper &helper, uint64_t assignedInstances, juce::AudioProcessor *const *instances,
+                    const ParameterSync &parameterSync, uint32_t generation);
+
+    // Sends the parameters of a follower that differ from what the helper was last sent
+    void sendParameterChanges(Helper &helper, int instance, const ParameterSync &parameterSync);
+
+    // Starts the helper process; returns false if that failed
+    bool launch(Helper &helper);
+    void stop(Helper &helper);
+
+    juce::OwnedArray<Helper> helpers;
+
+    std::unique_ptr<juce::XmlElement> pluginDescription;
+    double sampleRate = 0.0;
+    int maximumBlockSize = 0;
+    int numberOfChannels = 2;
+    bool isPrepared = false;
+
+    // Launching is not retried once it failed, until the number of helpers changes
+    bool launchFailed = false;
+    int wantedNumberOfHelpers = 0;
+
+    // Bumped by invalidateStates(); the helpers report the generation of the states they have
+    std::atomic<uint32_t> stateGeneration { 1 };
+
+    // The parameter values last sent for every instance, empty if its state still has to be sent
+    std::array<std::vector<float>, SharedRenderChannel::maximumNumberOfInstances> sentParameters;
+
+    std::atomic<int64_t> lateBlocks { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(OutOfProcessHost)
+};
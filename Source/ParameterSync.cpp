@@ -0,0 +1,303 @@
+#include "ParameterSync.h"
+
+//==============================================================================
+// Keeps the mute flag of one follower up to date when its own parameter changes,
+// e.g. because the user turned down the output in the editor of that instance
+class ParameterSync::MuteListener : public juce::AudioProcessorParameter::Listener
+{
+public:
+    MuteListener(ParameterSync &s, int i, juce::AudioProcessorParameter &p)
+        : sync(s), instance(i), parameter(p)
+    {
+        parameter.addListener(this);
+    }
+
+    ~MuteListener() override { parameter.removeListener(this); }
+
+    void parameterValueChanged(int, float newValue) override { sync.setMuted(instance, newValue <= 0.0f); }
+
+    void parameterGestureChanged(int, bool) override { }
+
+private:
+    ParameterSync &sync;
+    const int instance;
+    juce::AudioProcessorParameter &parameter;
+};
+
+//==============================================================================
+ParameterSync::ParameterSync() { }
+
+ParameterSync::~ParameterSync()
+{
+    detach();
+}
+
+void ParameterSync::excludeParameter(int parameterIndex)
+{
+    excludedParameterIndices.push_back(parameterIndex);
+}
+
+void ParameterSync::attach(juce::AudioProcessor *leaderToAttach, int maximumNumberOfInstances)
+{
+    detach();
+
+    jassert(maximumNumberOfInstances <= 64);
+
+    leader = leaderToAttach;
+    numberOfFollowers = maximumNumberOfInstances - 1;
+
+    // Parameter indices are not necessarily positions in getParameters(), so map them explicitly
+    const auto &parameters = leader->getParameters();
+    numberOfParameters = 0;
+    for (auto *parameter : parameters) {
+        numberOfParameters = juce::jmax(numberOfParameters, parameter->getParameterIndex() + 1);
+    }
+
+    leaderParameters.assign(static_cast<size_t>(numberOfParameters), nullptr);
+    for (auto *parameter : parameters) {
+        leaderParameters[static_cast<size_t>(parameter->getParameterIndex())] = parameter;
+    }
+
+    followerParameters.assign(static_cast<size_t>(numberOfParameters * numberOfFollowers), nullptr);
+
+    numberOfWords = (numberOfParameters + 63) / 64;
+    dirty.reset(new std::atomic<uint64_t>[static_cast<size_t>(numberOfWords)]());
+
+    excluded.assign(static_cast<size_t>(numberOfWords), 0);
+    for (int index : excludedParameterIndices) {
+        if (index < numberOfParameters) {
+            excluded[static_cast<size_t>(index / 64)] |= uint64_t(1) << (index % 64);
+        }
+    }
+
+    unmutedInstances.store(0);
+    for (int follower = 0; follower < numberOfFollowers; follower++) {
+        muteListeners.add(nullptr);
+    }
+}
+
+void ParameterSync::setFollower(int instance, juce::AudioProcessor *followerToSet)
+{
+    jassert(juce::isPositiveAndBelow(instance - 1, numberOfFollowers));
+    jassert(instance >= getNumberOfInstancesInUse());
+
+    const int follower = instance - 1;
+    muteListeners.set(follower, nullptr);
+    for (int index = 0; index < numberOfParameters; index++) {
+        followerParameters[static_cast<size_t>(index * numberOfFollowers + follower)] = nullptr;
+    }
+    setMuted(instance, true);
+
+    if (followerToSet == nullptr) {
+        return;
+    }
+
+    for (auto *parameter : followerToSet->getParameters()) {
+        int index = parameter->getParameterIndex();
+        if (index < numberOfParameters) {
+            followerParameters[static_cast<size_t>(index * numberOfFollowers + follower)] = parameter;
+        }
+    }
+
+    if (auto *parameter = followerParameters[static_cast<size_t>(muteParameterIndex * numberOfFollowers + follower)]) {
+        muteListeners.set(follower, new MuteListener(*this, instance, *parameter));
+        setMuted(instance, parameter->getValue() <= 0.0f);
+    }
+}
+
+void ParameterSync::setNumberOfInstancesInUse(int numberOfInstances)
+{
+    instancesInUse.store(juce::jlimit(1, numberOfFollowers + 1, numberOfInstances), std::memory_order_release);
+}
+
+void ParameterSync::detach()
+{
+    muteListeners.clear();
+    leader = nullptr;
+    leaderParameters.clear();
+    followerParameters.clear();
+    numberOfParameters = 0;
+    numberOfFollowers = 0;
+    instancesInUse = 1;
+    numberOfWords = 0;
+    dirty.reset();
+    excluded.clear();
+}
+
+juce::AudioProcessorParameter *ParameterSync::getParameter(int instance, int parameterIndex) const
+{
+    if (!juce::isPositiveAndBelow(parameterIndex, numberOfParameters) || !juce::isPositiveAndBelow(instance, numberOfFollowers + 1)) {
+        return nullptr;
+    }
+
+    if (instance == 0) {
+        return leaderParameters[static_cast<size_t>(parameterIndex)];
+    }
+    return followerParameters[static_cast<size_t>(parameterIndex * numberOfFollowers + instance - 1)];
+}
+
+void ParameterSync::markDirty(int parameterIndex)
+{
+    if (!juce::isPositiveAndBelow(parameterIndex, numberOfParameters)) {
+        return;
+    }
+
+    dirty[parameterIndex / 64].fetch_or(uint64_t(1) << (parameterIndex % 64), std::memory_order_release);
+}
+
+void ParameterSync::markAllDirty()
+{
+    for (int word = 0; word < numberOfWords; word++) {
+        // Only the bits of parameters that exist, flush() looks them up by index
+        const int bitsInWord = juce::jmin(64, numberOfParameters - word * 64);
+        const uint64_t bits = bitsInWord == 64 ? ~uint64_t(0) : (uint64_t(1) << bitsInWord) - 1;
+        dirty[word].fetch_or(bits, std::memory_order_release);
+    }
+}
+
+void ParameterSync::flush()
+{
+    flush(nullptr, 0);
+}
+
+int ParameterSync::flush(Change *changes, int maximumNumberOfChanges)
+{
+    int numberOfChanges = 0;
+    const int followersInUse = getNumberOfInstancesInUse() - 1;
+
+    for (int word = 0; word < numberOfWords; word++) {
+        uint64_t bits = dirty[word].exchange(0, std::memory_order_acquire) & ~excluded[static_cast<size_t>(word)];
+
+        while (bits != 0) {
+            int bit = 0;
+            while ((bits & (uint64_t(1) << bit)) == 0) {
+                bit++;
+            }
+            bits &= ~(uint64_t(1) << bit);
+
+            const int index = word * 64 + bit;
+            auto *leaderParameter = leaderParameters[static_cast<size_t>(index)];
+            if (leaderParameter == nullptr) {
+                continue;
+            }
+
+            // Only the latest value matters, however often it changed since the last block
+            const float value = leaderParameter->getValue();
+            if (numberOfChanges < maximumNumberOfChanges) {
+                changes[numberOfChanges++] = { index, value };
+            }
+
+            for (int follower = 0; follower < followersInUse; follower++) {
+                if (auto *parameter = followerParameters[static_cast<size_t>(index * numberOfFollowers + follower)]) {
+                    // Not notifying: nobody but us listens to the followers, and the host never sees them
+                    parameter->setValue(value);
+                }
+            }
+
+            // setValue() does not notify our mute listeners, so update the flags here
+            if (index == muteParameterIndex) {
+                for (int follower = 0; follower < followersInUse; follower++) {
+                    setMuted(follower + 1, value <= 0.0f);
+                }
+            }
+        }
+    }
+
+    return numberOfChanges;
+}
+
+void ParameterSync::resynchronize()
+{
+    const int followersInUse = getNumberOfInstancesInUse() - 1;
+
+    for (int index = 0; index < numberOfParameters; index++) {
+        auto *leaderParameter = leaderParameters[static_cast<size_t>(index)];
+        if (leaderParameter == nullptr || (excluded[static_cast<size_t>(index / 64)] & (uint64_t(1) << (index % 64)))) {
+            continue;
+        }
+
+        const float value = leaderParameter->getValue();
+        for (int follower = 0; follower < followersInUse; follower++) {
+            auto *parameter = followerParameters[static_cast<size_t>(index * numberOfFollowers + follower)];
+            if (parameter != nullptr && parameter->getValue() != value) {
+                parameter->setValue(value);
+            }
+        }
+    }
+
+    refreshMuteFlags();
+}
+
+void ParameterSync::resynchronize(int instance)
+{
+    if (!juce::isPositiveAndBelow(instance - 1, numberOfFollowers)) {
+        return;
+    }
+
+    for (int index = 0; index < numberOfParameters; index++) {
+        auto *leaderParameter = leaderParameters[static_cast<size_t>(index)];
+        if (leaderParameter == nullptr || (excluded[static_cast<size_t>(index / 64)] & (uint64_t(1) << (index % 64)))) {
+            continue;
+        }
+
+        auto *parameter = followerParameters[static_cast<size_t>(index * numberOfFollowers + instance - 1)];
+        if (parameter != nullptr && parameter->getValue() != leaderParameter->getValue()) {
+            parameter->setValue(leaderParameter->getValue());
+        }
+    }
+}
+
+int ParameterSync::findChanges(const float *values, Change *changes) const
+{
+    int numberOfChanges = 0;
+
+    for (int index = 0; index < numberOfParameters; index++) {
+        auto *leaderParameter = leaderParameters[static_cast<size_t>(index)];
+        if (leaderParameter == nullptr || (excluded[static_cast<size_t>(index / 64)] & (uint64_t(1) << (index % 64)))) {
+            continue;
+        }
+
+        if (leaderParameter->getValue() != values[index]) {
+            changes[numberOfChanges++] = { index, values[index] };
+        }
+    }
+
+    return numberOfChanges;
+}
+
+void ParameterSync::applyChanges(const Change *changes, int numberOfChanges)
+{
+    const int followersInUse = getNumberOfInstancesInUse() - 1;
+
+    for (int i = 0; i < numberOfChanges; i++) {
+        const auto &change = changes[i];
+        for (int follower = 0; follower < followersInUse; follower++) {
+            auto *parameter = followerParameters[static_cast<size_t>(change.index * numberOfFollowers + follower)];
+            if (parameter != nullptr && parameter->getValue() != change.value) {
+                parameter->setValue(change.value);
+            }
+        }
+    }
+
+    refreshMuteFlags();
+}
+
+void ParameterSync::refreshMuteFlags()
+{
+    const int followersInUse = getNumberOfInstancesInUse() - 1;
+
+    for (int follower = 0; follower < followersInUse; follower++) {
+        auto *parameter = followerParameters[static_cast<size_t>(muteParameterIndex * numberOfFollowers + follower)];
+        setMuted(follower + 1, parameter == nullptr || parameter->getValue() <= 0.0f);
+    }
+}
+
+void ParameterSync::setMuted(int instance, bool muted)
+{
+    const uint64_t bit = uint64_t(1) << instance;
+    if (muted) {
+        unmutedInstances.fetch_and(~bit, std::memory_order_acq_rel);
+    } else {
+        unmutedInstances.fetch_or(bit, std::memory_order_acq_rel);
+    }
+}
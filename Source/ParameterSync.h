@@ -0,0 +1,138 @@
+/*
+  ==============================================================================
+
+    Propagates parameter changes of instance 0 to the other Dexed instances.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+//==============================================================================
+/**
+    Parameter fan-out from the leader (instance 0) to the follower instances.
+
+    Changes are only marked in a dirty bitset when they happen, which is
+    lock-free and may be done on any thread. flush() then copies the latest
+    value of every dirty parameter into the followers once per block, using
+    a precomputed index map and without notifying anyone, so that a sweep
+    coalesces into at most one write per parameter and block.
+
+    It also keeps track of which followers are muted, so that processBlock
+    does not have to query their parameters.
+ */
+class ParameterSync
+{
+public:
+    ParameterSync();
+    ~ParameterSync();
+
+    // Builds the index maps of the leader and makes room for up to maximumNumberOfInstances - 1
+    // followers, which are added with setFollower(). Must not run concurrently with flush().
+    void attach(juce::AudioProcessor *leader, int maximumNumberOfInstances);
+    void detach();
+
+    // Adds the follower with the given instance index, or removes it if follower is nullptr, and
+    // listens to its mute parameter. The instance must not be in use, see setNumberOfInstancesInUse().
+    void setFollower(int instance, juce::AudioProcessor *follower);
+
+    // Number of instances, including the leader, that flush() and resynchronize() write to
+    void setNumberOfInstancesInUse(int numberOfInstances);
+    int getNumberOfInstancesInUse() const { return instancesInUse.load(std::memory_order_acquire); }
+
+    bool isAttached() const { return leader != nullptr; }
+
+    int getNumberOfParameters() const { return numberOfParameters; }
+
+    // The parameter with the given index of an instance (0 is the leader), or nullptr. Does not lock or allocate.
+    juce::AudioProcessorParameter *getParameter(int instance, int parameterIndex) const;
+
+    // Parameters that are never copied to the followers, e.g. because every
+    // instance has its own value. Takes effect with the next attach().
+    void excludeParameter(int parameterIndex);
+
+    // Remembers that a leader parameter has changed. Lock-free, may be called on any thread.
+    void markDirty(int parameterIndex);
+
+    // Same for every parameter, e.g. when the leader switched programs without reporting all changes
+    void markAllDirty();
+
+    // A leader parameter with its new value, e.g. one that flush() copied
+    struct Change
+    {
+        int index;
+        float value;
+    };
+
+    // Copies the dirty leader parameters into the followers. Call at the start of a block.
+    void flush();
+
+    // As flush(), and also records up to maximumNumberOfChanges of the copied parameters in changes,
+    // e.g. for followers that live elsewhere. Returns the number of changes recorded.
+    int flush(Change *changes, int maximumNumberOfChanges);
+
+    // Copies every leader parameter whose value differs into the followers, e.g. after their
+    // state was loaded or after changes to the leader were held back. Does not lock or allocate.
+    void resynchronize();
+
+    // As resynchronize(), for one instance that is not in use yet, e.g. right before it is put in use.
+    // Nothing else may write to its parameters meanwhile.
+    void resynchronize(int instance);
+
+    // Records the parameters whose value in the leader differs from the given values, one per parameter
+    // index, e.g. those of a program the leader is about to be switched to. Excluded parameters are left
+    // out. changes needs room for getNumberOfParameters() records; returns the number recorded.
+    int findChanges(const float *values, Change *changes) const;
+
+    // Sets the changed parameters in the followers. Does not lock or allocate.
+    void applyChanges(const Change *changes, int numberOfChanges);
+
+    // Bit i is set if follower i is not muted; bit 0 (the leader) is never set
+    uint64_t getUnmutedInstances() const { return unmutedInstances.load(std::memory_order_acquire); }
+
+    // Re-reads the mute state of all followers, e.g. after their state was replaced
+    void refreshMuteFlags();
+
+    // Index of the Dexed parameter that mutes an instance when it is 0 ("Output")
+    static constexpr int muteParameterIndex = 2;
+
+    // Index of the Dexed parameter used to detune the instances ("MASTER TUNE ADJ")
+    static constexpr int detuneParameterIndex = 3;
+
+    // Index of the parameter Dexed reports a change of when a cartridge is loaded
+    static constexpr int cartridgeParameterIndex = 2236;
+
+private:
+    class MuteListener;
+
+    void setMuted(int instance, bool muted);
+
+    juce::AudioProcessor *leader = nullptr;
+    int numberOfParameters = 0;
+
+    // Leader parameters by parameter index
+    std::vector<juce::AudioProcessorParameter *> leaderParameters;
+
+    // For every parameter index, the matching parameter of each follower, numberOfFollowers per index
+    std::vector<juce::AudioProcessorParameter *> followerParameters;
+    int numberOfFollowers = 0;
+    std::atomic<int> instancesInUse { 1 };
+
+    // One bit per parameter index
+    std::unique_ptr<std::atomic<uint64_t>[]> dirty;
+    std::vector<uint64_t> excluded;
+    int numberOfWords = 0;
+
+    std::vector<int> excludedParameterIndices;
+
+    std::atomic<uint64_t> unmutedInstances { 0 };
+    juce::OwnedArray<MuteListener> muteListeners;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ParameterSync)
+};
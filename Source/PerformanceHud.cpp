@@ -0,0 +1,68 @@
+#include "PerformanceHud.h"
+
+namespace {
+
+juce::String toMicroseconds(float seconds)
+{
+    return juce::String(juce::roundToInt(seconds * 1.0e6f)) + " us";
+}
+
+juce::String toPercent(float share)
+{
+    return juce::String(100.0f * share, 1) + " %";
+}
+
+} // namespace
+
+PerformanceHud::PerformanceHud(PerformanceMonitor &monitorToShow)
+    : monitor(monitorToShow)
+{
+    addAndMakeVisible(resetButton);
+    resetButton.setButtonText("Reset");
+    resetButton.onClick = [this] {
+        monitor.resetWorstCases();
+    };
+}
+
+void PerformanceHud::update(int numberOfInstances)
+{
+    summary.clear();
+    summary << "Block load " << toPercent(monitor.getAverageBlockLoad())
+            << ", worst " << toPercent(monitor.getWorstBlockLoad())
+            << ", mixdown " << toPercent(monitor.getAverageMixdownLoad())
+            << ", over budget " << juce::String(monitor.getNumberOfOverBudgetBlocks())
+            << " of " << juce::String(monitor.getNumberOfBlocks()) << " blocks";
+
+    voiceLines.clearQuick();
+    for (int i = 1; i < numberOfInstances; i++) {
+        voiceLines.add("Dexed " + juce::String(i) + ": " + toMicroseconds(monitor.getAverageRenderSeconds(i))
+                       + ", worst " + toMicroseconds(monitor.getWorstRenderSeconds(i)));
+    }
+
+    repaint();
+}
+
+void PerformanceHud::paint(juce::Graphics &g)
+{
+    // Lies over the Dexed editor, which stays recognisable underneath
+    g.fillAll(juce::Colours::black.withAlpha(0.8f));
+    g.setColour(juce::Colours::white);
+    g.setFont(juce::Font(juce::Font::getDefaultMonospacedFontName(), 13.0f, juce::Font::plain));
+
+    auto area = getLocalBounds().reduced(10);
+    g.drawText(summary, area.removeFromTop(lineHeight + 4), juce::Justification::centredLeft);
+    area.removeFromTop(lineHeight / 2);
+
+    // As many columns as it takes
+    const int linesPerColumn = juce::jmax(1, area.getHeight() / lineHeight);
+    for (int i = 0; i < voiceLines.size(); i++) {
+        const int x = area.getX() + (i / linesPerColumn) * columnWidth;
+        const int y = area.getY() + (i % linesPerColumn) * lineHeight;
+        g.drawText(voiceLines[i], x, y, columnWidth, lineHeight, juce::Justification::centredLeft);
+    }
+}
+
+void PerformanceHud::resized()
+{
+    resetButton.setBounds(getWidth() - 70, 10, 60, 20);
+}
@@ -0,0 +1,43 @@
+/*
+  ==============================================================================
+
+    Panel with the render time of every voice and the load of the blocks,
+    for choosing the number of voices and the buffer size on a machine.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "PerformanceMonitor.h"
+
+//==============================================================================
+/**
+    Shows the figures of a PerformanceMonitor as of the last call to update(),
+    which the editor makes from its timer. "Reset" starts the worst cases and
+    the block counts over, e.g. after changing the buffer size.
+ */
+class PerformanceHud : public juce::Component
+{
+public:
+    explicit PerformanceHud(PerformanceMonitor &monitorToShow);
+
+    // Takes the current figures for the voices 1 to numberOfInstances - 1
+    void update(int numberOfInstances);
+
+    void paint(juce::Graphics &g) override;
+    void resized() override;
+
+private:
+    PerformanceMonitor &monitor;
+    juce::TextButton resetButton;
+
+    juce::String summary;
+    juce::StringArray voiceLines;
+
+    static constexpr int lineHeight = 16;
+    static constexpr int columnWidth = 260;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PerformanceHud)
+};
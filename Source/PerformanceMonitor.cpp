@@ -0,0 +1,162 @@
+#include "PerformanceMonitor.h"
+
+#if JUCE_WINDOWS
+#  include <windows.h>
+#  include <psapi.h>
+#  if JUCE_MSVC
+#    pragma comment(lib, "psapi.lib")
+#  endif
+#elif JUCE_MAC
+#  include <mach/mach.h>
+#elif JUCE_LINUX
+#  include <unistd.h>
+#  include <cstdio>
+#else
+#  include <sys/resource.h>
+#endif
+
+namespace {
+
+// Weight of the newest block in the smoothed load, about half a second at 512 samples and 48 kHz
+constexpr float smoothing = 0.02f;
+
+void smooth(std::atomic<float> &average, float value)
+{
+    const float previous = average.load(std::memory_order_relaxed);
+    average.store(previous + smoothing * (value - previous), std::memory_order_relaxed);
+}
+
+// Only one thread records each figure, so this does not need a compare-and-swap
+void keepLargest(std::atomic<float> &worst, float value)
+{
+    if (value > worst.load(std::memory_order_relaxed)) {
+        worst.store(value, std::memory_order_relaxed);
+    }
+}
+
+} // namespace
+
+PerformanceMonitor::PerformanceMonitor()
+{
+    for (int i = 0; i < maximumNumberOfInstances; i++) {
+        averageLoad[i] = 0.0f;
+        averageRenderSeconds[i] = 0.0f;
+        worstRenderSeconds[i] = 0.0f;
+        memoryUsage[i] = 0;
+    }
+}
+
+void PerformanceMonitor::recordRender(int instance, double renderSeconds, double blockSeconds)
+{
+    if (!juce::isPositiveAndBelow(instance, maximumNumberOfInstances) || blockSeconds <= 0.0) {
+        return;
+    }
+
+    smooth(averageLoad[instance], static_cast<float>(renderSeconds / blockSeconds));
+    smooth(averageRenderSeconds[instance], static_cast<float>(renderSeconds));
+    keepLargest(worstRenderSeconds[instance], static_cast<float>(renderSeconds));
+}
+
+float PerformanceMonitor::getAverageRenderSeconds(int instance) const
+{
+    return juce::isPositiveAndBelow(instance, maximumNumberOfInstances) ? averageRenderSeconds[instance].load(std::memory_order_relaxed) : 0.0f;
+}
+
+float PerformanceMonitor::getWorstRenderSeconds(int instance) const
+{
+    return juce::isPositiveAndBelow(instance, maximumNumberOfInstances) ? worstRenderSeconds[instance].load(std::memory_order_relaxed) : 0.0f;
+}
+
+void PerformanceMonitor::recordBlock(double processSeconds, double blockSeconds)
+{
+    if (blockSeconds <= 0.0) {
+        return;
+    }
+
+    const float load = static_cast<float>(processSeconds / blockSeconds);
+    smooth(averageBlockLoad, load);
+    keepLargest(worstBlockLoad, load);
+    numberOfBlocks.fetch_add(1, std::memory_order_relaxed);
+    if (load > 1.0f) {
+        numberOfOverBudgetBlocks.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void PerformanceMonitor::recordMixdown(double mixSeconds, double blockSeconds)
+{
+    if (blockSeconds > 0.0) {
+        smooth(averageMixdownLoad, static_cast<float>(mixSeconds / blockSeconds));
+    }
+}
+
+void PerformanceMonitor::resetWorstCases()
+{
+    for (int i = 0; i < maximumNumberOfInstances; i++) {
+        worstRenderSeconds[i] = 0.0f;
+    }
+    worstBlockLoad = 0.0f;
+    numberOfBlocks = 0;
+    numberOfOverBudgetBlocks = 0;
+}
+
+float PerformanceMonitor::getAverageLoad(int instance) const
+{
+    return juce::isPositiveAndBelow(instance, maximumNumberOfInstances) ? averageLoad[instance].load(std::memory_order_relaxed) : 0.0f;
+}
+
+void PerformanceMonitor::resetInstance(int instance)
+{
+    if (juce::isPositiveAndBelow(instance, maximumNumberOfInstances)) {
+        averageLoad[instance] = 0.0f;
+        averageRenderSeconds[instance] = 0.0f;
+        worstRenderSeconds[instance] = 0.0f;
+        memoryUsage[instance] = 0;
+    }
+}
+
+void PerformanceMonitor::setMemoryUsage(int instance, int64_t bytes)
+{
+    if (juce::isPositiveAndBelow(instance, maximumNumberOfInstances)) {
+        memoryUsage[instance] = bytes;
+    }
+}
+
+int64_t PerformanceMonitor::getMemoryUsage(int instance) const
+{
+    return juce::isPositiveAndBelow(instance, maximumNumberOfInstances) ? memoryUsage[instance].load() : 0;
+}
+
+int64_t PerformanceMonitor::getProcessMemoryUsage()
+{
+#if JUCE_WINDOWS
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return static_cast<int64_t>(counters.WorkingSetSize);
+    }
+    return 0;
+#elif JUCE_MAC
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) == KERN_SUCCESS) {
+        return static_cast<int64_t>(info.resident_size);
+    }
+    return 0;
+#elif JUCE_LINUX
+    // The second field is the resident set size in pages
+    long pages = 0;
+    if (FILE *file = std::fopen("/proc/self/statm", "r")) {
+        if (std::fscanf(file, "%*s %ld", &pages) != 1) {
+            pages = 0;
+        }
+        std::fclose(file);
+    }
+    return static_cast<int64_t>(pages) * sysconf(_SC_PAGESIZE);
+#else
+    // Only the peak is available here, in kilobytes, which still grows with every instance created
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        return static_cast<int64_t>(usage.ru_maxrss) * 1024;
+    }
+    return 0;
+#endif
+}
@@ -0,0 +1,86 @@
+/*
+  ==============================================================================
+
+    Per-instance CPU and memory figures, for sizing the number of instances
+    a machine can run.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <atomic>
+
+//==============================================================================
+/**
+    Collects how much of the block time each instance takes to render, and
+    roughly how much memory it took to create it, along with how long whole
+    blocks and the mixdown take.
+
+    recordRender() is called on the audio thread and on the render workers,
+    one writer per instance; recordBlock() and recordMixdown() are called on
+    the audio thread. None of them locks or allocates. The getters and
+    resetWorstCases() may be called from any thread.
+ */
+class PerformanceMonitor
+{
+public:
+    PerformanceMonitor();
+
+    static constexpr int maximumNumberOfInstances = 64;
+
+    // Records that rendering the instance took the given share of the block time
+    void recordRender(int instance, double renderSeconds, double blockSeconds);
+
+    // Smoothed share of the block time the instance takes to render, 1.0 being the whole block
+    float getAverageLoad(int instance) const;
+
+    // Smoothed and longest time the instance took to render a block, in seconds
+    float getAverageRenderSeconds(int instance) const;
+    float getWorstRenderSeconds(int instance) const;
+
+    // Records how long processBlock took for a block of the given duration
+    void recordBlock(double processSeconds, double blockSeconds);
+
+    // Records how long mixing the instances down took for a block of the given duration
+    void recordMixdown(double mixSeconds, double blockSeconds);
+
+    // Smoothed and largest share of the block time processBlock takes
+    float getAverageBlockLoad() const { return averageBlockLoad.load(std::memory_order_relaxed); }
+    float getWorstBlockLoad() const { return worstBlockLoad.load(std::memory_order_relaxed); }
+
+    // Smoothed share of the block time the mixdown takes
+    float getAverageMixdownLoad() const { return averageMixdownLoad.load(std::memory_order_relaxed); }
+
+    // Blocks recorded, and how many of them took longer than they last
+    uint32_t getNumberOfBlocks() const { return numberOfBlocks.load(std::memory_order_relaxed); }
+    uint32_t getNumberOfOverBudgetBlocks() const { return numberOfOverBudgetBlocks.load(std::memory_order_relaxed); }
+
+    // Starts over with the worst figures and the block counts
+    void resetWorstCases();
+
+    // Forgets the figures of an instance, e.g. when it is torn down
+    void resetInstance(int instance);
+
+    void setMemoryUsage(int instance, int64_t bytes);
+    int64_t getMemoryUsage(int instance) const;
+
+    // Resident memory of the whole process in bytes, or 0 where it cannot be determined
+    static int64_t getProcessMemoryUsage();
+
+private:
+    std::atomic<float> averageLoad[maximumNumberOfInstances];
+    std::atomic<float> averageRenderSeconds[maximumNumberOfInstances];
+    std::atomic<float> worstRenderSeconds[maximumNumberOfInstances];
+    std::atomic<int64_t> memoryUsage[maximumNumberOfInstances];
+
+    std::atomic<float> averageBlockLoad { 0.0f };
+    std::atomic<float> worstBlockLoad { 0.0f };
+    std::atomic<float> averageMixdownLoad { 0.0f };
+    std::atomic<uint32_t> numberOfBlocks { 0 };
+    std::atomic<uint32_t> numberOfOverBudgetBlocks { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PerformanceMonitor)
+};
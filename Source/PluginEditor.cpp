@@ -20,29 +20,26 @@ PluginAudioProcessorEditor::PluginAudioProcessorEditor(PluginAudioProcessor &p)
     tabbedComponent = std::make_unique<juce::TabbedComponent>(juce::TabbedButtonBar::TabsAtTop);
     addAndMakeVisible(*tabbedComponent);
 
-    // Get the background color of the window
-    auto backgroundColor = getLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId);
+    // Create a tab for each instance of Dexed and each layer; only the editor of the selected one is created now
+    updateTabs();
+    showInstanceEditor(tabbedComponent->getCurrentTabIndex());
+
+    // Follow the instances being created and torn down when unisonVoices changes, and the selected tab
+    audioProcessor.addChangeListener(this);
+    tabbedComponent->getTabbedButtonBar().addChangeListener(this);
 
-    // Create a tab for each instance of Dexed
-    for (int i = 0; i < pluginAudioProcessor->numberOfInstances; i++) {
-        dexedComponents[i] = std::make_unique<juce::Component>();
-        pluginAudioProcessor->dexedPluginInstances[i]->createEditorIfNeeded();
-        dexedComponents[i]->addAndMakeVisible(pluginAudioProcessor->dexedPluginInstances[i]->getActiveEditor());
-        // Name the first tab "Master", and the rest "Dexed 1", "Dexed 2", etc.
-        if (i == 0) {
-            tabbedComponent->addTab(juce::String("Master"), backgroundColor, dexedComponents[i].get(), true);
-        }
-        else {
-            tabbedComponent->addTab(juce::String("Dexed ") + juce::String(i), backgroundColor, dexedComponents[i].get(), true);
-        }
-        dexedEditors[i] = pluginAudioProcessor->dexedPluginInstances[i]->getActiveEditor();
-        dexedComponents[i]->setSize(dexedEditors[i]->getWidth(), dexedEditors[i]->getHeight());
-        tabbedComponent->setSize(dexedComponents[i]->getWidth(), dexedComponents[i]->getHeight() + tabbedComponent->getTabBarDepth());
-    }
-        
     // Make the tabbed component visible
     tabbedComponent->setVisible(true);
 
+    // Until the instances are loaded, there is a message where their tabs will be
+    addChildComponent(loadingLabel);
+    loadingLabel.setJustificationType(juce::Justification::centred);
+    loadingLabel.setFont(juce::Font(20.0f));
+    if (tabbedComponent->getWidth() == 0) {
+        tabbedComponent->setSize(loadingWidth, loadingHeight);
+    }
+    updateLoadingLabel();
+
     // Set the size of the editor window
     setSize(tabbedComponent->getWidth(), tabbedComponent->getHeight() + 100);
 
@@ -61,18 +58,415 @@ PluginAudioProcessorEditor::PluginAudioProcessorEditor(PluginAudioProcessor &p)
     panLabel.setText("Pan", juce::dontSendNotification);
     panLabel.attachToComponent(&panSlider, false);
 
+    addAndMakeVisible(renderThreadsSlider);
+    renderThreadsSlider.setSliderStyle(juce::Slider::SliderStyle::RotaryVerticalDrag);
+    renderThreadsSlider.setTextBoxStyle(juce::Slider::TextBoxAbove, true, 50, 20);
+    renderThreadsSliderAttachment = std::make_unique<juce::AudioProcessorValueTreeState::SliderAttachment>(pluginAudioProcessor->apvts, "renderThreads", renderThreadsSlider);
+    addAndMakeVisible(renderThreadsLabel);
+    renderThreadsLabel.setText("Threads", juce::dontSendNotification);
+    renderThreadsLabel.attachToComponent(&renderThreadsSlider, false);
+
+    addAndMakeVisible(parallelRenderingButton);
+    parallelRenderingButton.setButtonText("Parallel");
+    parallelRenderingButtonAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ButtonAttachment>(pluginAudioProcessor->apvts, "parallelRendering", parallelRenderingButton);
+
+    addAndMakeVisible(unisonGovernorButton);
+    unisonGovernorButton.setButtonText("Adaptive");
+    unisonGovernorButtonAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ButtonAttachment>(pluginAudioProcessor->apvts, "unisonGovernor", unisonGovernorButton);
+
+    addAndMakeVisible(programFadeButton);
+    programFadeButton.setButtonText("Fade");
+    programFadeButtonAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ButtonAttachment>(pluginAudioProcessor->apvts, "programFade", programFadeButton);
+
+    // Not a parameter: a trace is for this session only
+    addAndMakeVisible(traceButton);
+    traceButton.setButtonText("Trace");
+    traceButton.setToggleState(TraceRecorder::isEnabled(), juce::dontSendNotification);
+    traceButton.onClick = [this] {
+        audioProcessor.traceRecorder->setEnabled(traceButton.getToggleState());
+        traceButton.setToggleState(TraceRecorder::isEnabled(), juce::dontSendNotification);
+        traceButton.setTooltip(audioProcessor.traceRecorder->getTraceFile().getFullPathName());
+    };
+
+    // The figures of every voice, over the Dexed editor
+    addChildComponent(performanceHud);
+    addAndMakeVisible(performanceHudButton);
+    performanceHudButton.setButtonText("HUD");
+    performanceHudButton.onClick = [this] {
+        performanceHud.setVisible(performanceHudButton.getToggleState());
+        performanceHud.update(audioProcessor.numberOfInstances);
+    };
+
+    // Voices of the cartridge library, over the Dexed editor as well
+    addChildComponent(cartridgeLibraryPanel);
+    cartridgeLibraryPanel.onLoadVoice = [this](const juce::MemoryBlock &cartridge, int voiceIndex) {
+        return audioProcessor.loadCartridgeVoice(cartridge, voiceIndex);
+    };
+    addAndMakeVisible(cartridgeLibraryButton);
+    cartridgeLibraryButton.setButtonText("Library");
+    cartridgeLibraryButton.onClick = [this] {
+        cartridgeLibraryPanel.setVisible(cartridgeLibraryButton.getToggleState());
+        cartridgeLibraryPanel.toFront(true);
+    };
+
+    // The layers, over the Dexed editor as well
+    addChildComponent(layerPanel);
+    addAndMakeVisible(layerPanelButton);
+    layerPanelButton.setButtonText("Layers");
+    layerPanelButton.onClick = [this] {
+        layerPanel.setVisible(layerPanelButton.getToggleState());
+        layerPanel.toFront(false);
+    };
+
+    // The items must be there before the attachment selects one
+    addAndMakeVisible(ecoModeBox);
+    ecoModeBox.addItemList({ "Eco off", "Eco 48 kHz", "Eco 24 kHz" }, 1);
+    ecoModeBoxAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ComboBoxAttachment>(pluginAudioProcessor->apvts, "ecoMode", ecoModeBox);
+
+    addAndMakeVisible(unisonVoicesSlider);
+    unisonVoicesSlider.setSliderStyle(juce::Slider::SliderStyle::RotaryVerticalDrag);
+    unisonVoicesSlider.setTextBoxStyle(juce::Slider::TextBoxAbove, true, 50, 20);
+    unisonVoicesSliderAttachment = std::make_unique<juce::AudioProcessorValueTreeState::SliderAttachment>(pluginAudioProcessor->apvts, "unisonVoices", unisonVoicesSlider);
+    addAndMakeVisible(unisonVoicesLabel);
+    unisonVoicesLabel.setText("Voices", juce::dontSendNotification);
+    unisonVoicesLabel.attachToComponent(&unisonVoicesSlider, false);
+
+    addAndMakeVisible(helperProcessesSlider);
+    helperProcessesSlider.setSliderStyle(juce::Slider::SliderStyle::RotaryVerticalDrag);
+    helperProcessesSlider.setTextBoxStyle(juce::Slider::TextBoxAbove, true, 50, 20);
+    helperProcessesSliderAttachment = std::make_unique<juce::AudioProcessorValueTreeState::SliderAttachment>(pluginAudioProcessor->apvts, "helperProcesses", helperProcessesSlider);
+    addAndMakeVisible(helperProcessesLabel);
+    helperProcessesLabel.setText("Processes", juce::dontSendNotification);
+    helperProcessesLabel.attachToComponent(&helperProcessesSlider, false);
+
+    addAndMakeVisible(statsLabel);
+    statsLabel.setJustificationType(juce::Justification::topLeft);
+    statsLabel.setFont(juce::Font(12.0f));
+
+    // The meters need a steady refresh, the figures are smoothed over about half a second anyway
+    updateStats();
+    startTimerHz(levelMeterRefreshRate);
 }
 
 PluginAudioProcessorEditor::~PluginAudioProcessorEditor() {
-    // Clean up Dexed components and detach slider attachments
-    for (int i = 0; i < audioProcessor.numberOfInstances; i++) {
-        dexedEditors[i] = nullptr;
-        dexedComponents[i] = nullptr;
+    stopTimer();
+    audioProcessor.removeChangeListener(this);
+    tabbedComponent->getTabbedButtonBar().removeChangeListener(this);
+    audioProcessor.masterEditorVisible = false;
+
+    // The Dexed editors go with the window, so that they don't keep running while it is closed
+    for (int i = 0; i < dexedEditors.size(); i++) {
+        releaseInstanceEditor(i);
     }
 
+    // Clean up Dexed components and detach slider attachments; the meters go with the tabs
+    layerTabs.clear();
+    levelMeters.clear();
+    dexedEditors.clear();
     tabbedComponent = nullptr;
+    dexedComponents.clear();
+
     detuneSliderAttachment = nullptr;
     panSliderAttachment = nullptr;
+    renderThreadsSliderAttachment = nullptr;
+    unisonVoicesSliderAttachment = nullptr;
+    helperProcessesSliderAttachment = nullptr;
+    parallelRenderingButtonAttachment = nullptr;
+    unisonGovernorButtonAttachment = nullptr;
+    programFadeButtonAttachment = nullptr;
+    ecoModeBoxAttachment = nullptr;
+}
+
+void PluginAudioProcessorEditor::addInstanceTab(int index)
+{
+    // Get the background color of the window
+    auto backgroundColor = getLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId);
+
+    auto *component = dexedComponents.add(new juce::Component());
+
+    // Name the first tab "Master", and the rest "Dexed 1", "Dexed 2", etc.
+    // The components are owned by dexedComponents, not by the tabs
+    if (index == 0) {
+        tabbedComponent->addTab(juce::String("Master"), backgroundColor, component, false);
+    }
+    else {
+        tabbedComponent->addTab(juce::String("Dexed ") + juce::String(index), backgroundColor, component, false);
+    }
+    dexedEditors.add(nullptr);
+
+    // The followers show their level next to their name; the tab button owns the meter
+    LevelMeterComponent *meter = nullptr;
+    if (index > 0) {
+        meter = new LevelMeterComponent();
+        meter->setSize(levelMeterWidth, levelMeterHeight);
+        tabbedComponent->getTabbedButtonBar().getTabButton(index)->setExtraComponent(meter, juce::TabBarButton::afterText);
+    }
+    levelMeters.add(meter);
+
+    // The first tab is selected by default
+    if (tabbedComponent->getCurrentTabIndex() < 0) {
+        tabbedComponent->setCurrentTabIndex(0, false);
+    }
+}
+
+void PluginAudioProcessorEditor::addLayerTab(int layer)
+{
+    auto backgroundColor = getLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId);
+
+    // "Layer 2" and up; the main group is layer 1
+    auto *component = dexedComponents.add(new juce::Component());
+    tabbedComponent->addTab(juce::String("Layer ") + juce::String(layer + 2), backgroundColor, component, false);
+    dexedEditors.add(nullptr);
+    layerTabs.add(layer);
+
+    // Voice 0 of a layer is played, so its level is shown like that of a follower
+    auto *meter = new LevelMeterComponent();
+    meter->setSize(levelMeterWidth, levelMeterHeight);
+    tabbedComponent->getTabbedButtonBar().getTabButton(dexedComponents.size() - 1)->setExtraComponent(meter, juce::TabBarButton::afterText);
+    levelMeters.add(meter);
+}
+
+void PluginAudioProcessorEditor::removeLastTab()
+{
+    const int last = dexedComponents.size() - 1;
+    if (tabbedComponent->getCurrentTabIndex() == last) {
+        tabbedComponent->setCurrentTabIndex(0);
+    }
+    tabbedComponent->removeTab(last);
+    levelMeters.removeLast();
+    releaseInstanceEditor(last);
+    dexedEditors.removeLast();
+    dexedComponents.removeLast();
+}
+
+juce::AudioProcessor *PluginAudioProcessorEditor::getTabInstance(int tab) const
+{
+    const int numberOfInstanceTabs = dexedComponents.size() - layerTabs.size();
+    if (tab < numberOfInstanceTabs) {
+        return audioProcessor.dexedPluginInstances[static_cast<size_t>(tab)].get();
+    }
+    return audioProcessor.layers[static_cast<size_t>(layerTabs[tab - numberOfInstanceTabs])].getVoice(0);
+}
+
+int PluginAudioProcessorEditor::getTabSlot(int tab) const
+{
+    const int numberOfInstanceTabs = dexedComponents.size() - layerTabs.size();
+    if (tab < numberOfInstanceTabs) {
+        return tab;
+    }
+    return PluginAudioProcessor::getLayerSlot(layerTabs[tab - numberOfInstanceTabs], 0);
+}
+
+void PluginAudioProcessorEditor::showInstanceEditor(int index)
+{
+    if (!juce::isPositiveAndBelow(index, dexedComponents.size())) {
+        return;
+    }
+
+    // The hidden editors are taken out of the window so that they no longer paint,
+    // and only the most recently shown of them are kept for switching back quickly
+    for (int i = 0; i < dexedEditors.size(); i++) {
+        if (i != index && dexedEditors[i] != nullptr && dexedEditors[i]->getParentComponent() != nullptr) {
+            dexedComponents[i]->removeChildComponent(dexedEditors[i]);
+            editorHiddenTimes.remove(recentlyShownTabs.indexOf(i));
+            recentlyShownTabs.removeFirstMatchingValue(i);
+            recentlyShownTabs.add(i);
+            editorHiddenTimes.add(juce::Time::getMillisecondCounter());
+        }
+    }
+    editorHiddenTimes.remove(recentlyShownTabs.indexOf(index));
+    recentlyShownTabs.removeFirstMatchingValue(index);
+    while (recentlyShownTabs.size() > maximumNumberOfHiddenEditors) {
+        releaseInstanceEditor(recentlyShownTabs.getFirst());
+    }
+
+    // Instance 0 only needs to be rendered while its editor can be seen
+    audioProcessor.masterEditorVisible = index == 0;
+
+    auto *editor = dexedEditors[index];
+    if (editor == nullptr) {
+        auto *instance = getTabInstance(index);
+        if (instance == nullptr) {
+            return;
+        }
+        editor = instance->createEditorIfNeeded();
+        if (editor == nullptr) {
+            return;
+        }
+        dexedEditors.set(index, editor);
+    }
+    dexedComponents[index]->addAndMakeVisible(editor);
+    dexedComponents[index]->setSize(editor->getWidth(), editor->getHeight());
+
+    // The first editor gives the window its size; all instances are Dexed, so they are the same size
+    if (!isSizedForEditors) {
+        isSizedForEditors = true;
+        tabbedComponent->setSize(editor->getWidth(), editor->getHeight() + tabbedComponent->getTabBarDepth());
+        setSize(tabbedComponent->getWidth(), tabbedComponent->getHeight() + 100);
+    }
+}
+
+void PluginAudioProcessorEditor::releaseInstanceEditor(int index)
+{
+    editorHiddenTimes.remove(recentlyShownTabs.indexOf(index));
+    recentlyShownTabs.removeFirstMatchingValue(index);
+
+    auto *editor = dexedEditors[index];
+    if (editor == nullptr) {
+        return;
+    }
+
+    dexedComponents[index]->removeChildComponent(editor);
+    dexedEditors.set(index, nullptr);
+
+    // The editor tells its instance that it is gone
+    delete editor;
+}
+
+void PluginAudioProcessorEditor::releaseExpiredEditors()
+{
+    // The least recently shown editor has been hidden the longest
+    const juce::uint32 now = juce::Time::getMillisecondCounter();
+    while (!recentlyShownTabs.isEmpty() && now - editorHiddenTimes.getFirst() >= hiddenEditorLifetimeMilliseconds) {
+        releaseInstanceEditor(recentlyShownTabs.getFirst());
+    }
+}
+
+void PluginAudioProcessorEditor::changeListenerCallback(juce::ChangeBroadcaster *source)
+{
+    if (source == &tabbedComponent->getTabbedButtonBar()) {
+        showInstanceEditor(tabbedComponent->getCurrentTabIndex());
+        return;
+    }
+
+    updateTabs();
+    showInstanceEditor(tabbedComponent->getCurrentTabIndex());
+
+    updateLoadingLabel();
+}
+
+void PluginAudioProcessorEditor::updateTabs()
+{
+    const int numberOfInstances = audioProcessor.numberOfInstances;
+
+    // A layer has a tab while it has voices; the message about the last one going comes before voice 0 is torn down
+    juce::Array<int> wantedLayerTabs;
+    for (int layer = 0; layer < PluginAudioProcessor::maximumNumberOfLayers - 1; layer++) {
+        const UnisonLayer &unisonLayer = audioProcessor.layers[static_cast<size_t>(layer)];
+        if (unisonLayer.numberOfVoices > 0 && unisonLayer.getVoice(0) != nullptr) {
+            wantedLayerTabs.add(layer);
+        }
+    }
+
+    if (dexedComponents.size() - layerTabs.size() == numberOfInstances && layerTabs == wantedLayerTabs) {
+        return;
+    }
+
+    // Tabs are only ever added or removed at the end, so the layer tabs make way for the instance tabs
+    while (!layerTabs.isEmpty()) {
+        removeLastTab();
+        layerTabs.removeLast();
+    }
+
+    while (dexedComponents.size() > numberOfInstances) {
+        removeLastTab();
+    }
+
+    while (dexedComponents.size() < numberOfInstances) {
+        addInstanceTab(dexedComponents.size());
+    }
+
+    for (int layer : wantedLayerTabs) {
+        addLayerTab(layer);
+    }
+}
+
+void PluginAudioProcessorEditor::updateLoadingLabel()
+{
+    if (audioProcessor.loadingHasFailed) {
+        loadingLabel.setText("Dexed could not be loaded", juce::dontSendNotification);
+    } else {
+        loadingLabel.setText("Loading Dexed...", juce::dontSendNotification);
+    }
+    loadingLabel.setVisible(!audioProcessor.instancesAreReady);
+}
+
+void PluginAudioProcessorEditor::timerCallback()
+{
+    updateLevelMeters();
+
+    if (++timerTicksSinceStatsUpdate >= levelMeterRefreshRate / statsRefreshRate) {
+        timerTicksSinceStatsUpdate = 0;
+        updateStats();
+        releaseExpiredEditors();
+    }
+}
+
+void PluginAudioProcessorEditor::updateLevelMeters()
+{
+    InstanceLevelMeters::Levels levels[InstanceLevelMeters::maximumNumberOfInstances];
+    const int numberOfLevels = audioProcessor.levelMeters.getLevels(levels, InstanceLevelMeters::maximumNumberOfInstances);
+
+    // Instances that are not rendered any more have no levels
+    for (int i = 1; i < levelMeters.size(); i++) {
+        const int slot = getTabSlot(i);
+        levelMeters[i]->setLevels(slot < numberOfLevels ? levels[slot] : InstanceLevelMeters::Levels());
+    }
+}
+
+void PluginAudioProcessorEditor::updateStats()
+{
+    const int numberOfInstances = audioProcessor.numberOfInstances;
+    const auto &monitor = audioProcessor.performanceMonitor;
+
+    if (!audioProcessor.instancesAreReady) {
+        statsLabel.setText(audioProcessor.loadingHasFailed ? "Dexed not found" : "Loading...", juce::dontSendNotification);
+        return;
+    }
+
+    if (performanceHud.isVisible()) {
+        performanceHud.update(numberOfInstances);
+    }
+
+    // Instance 0 only counts while its editor is shown, the voices are what scales
+    float voiceLoad = 0.0f;
+    int64_t voiceMemory = 0;
+    for (int i = 1; i < numberOfInstances; i++) {
+        voiceLoad += monitor.getAverageLoad(i);
+        voiceMemory += monitor.getMemoryUsage(i);
+    }
+    const int numberOfVoices = juce::jmax(1, numberOfInstances - 1);
+
+    juce::String text;
+    text << "Voices: " << (numberOfInstances - 1);
+
+    // The governor leaves out voices while the block takes too long
+    const int effectiveVoices = audioProcessor.effectiveVoices;
+    if (effectiveVoices < numberOfInstances - 1) {
+        text << " (" << effectiveVoices << " playing, load " << juce::String(100.0f * audioProcessor.governor.getLoad(), 0) << " %)";
+    }
+
+    text << "\n"
+         << "CPU per voice: " << juce::String(100.0f * voiceLoad / numberOfVoices, 1) << " %\n"
+         << "CPU all voices: " << juce::String(100.0f * voiceLoad, 1) << " %\n"
+         << "Memory per voice: " << juce::String(voiceMemory / numberOfVoices / (1024.0 * 1024.0), 1) << " MB\n"
+         << "Memory in total: " << juce::String(PerformanceMonitor::getProcessMemoryUsage() / (1024.0 * 1024.0), 0) << " MB";
+
+    // Helpers add no latency, but a block they are too late for leaves their voices silent
+    const auto &helpers = audioProcessor.outOfProcessHost;
+    if (helpers.getNumberOfRunningHelpers() > 0) {
+        text << "\nHelper processes: " << helpers.getNumberOfRunningHelpers()
+             << ", late blocks: " << juce::String(helpers.getNumberOfLateBlocks());
+    }
+
+    // In eco mode the CPU figures above are for the lower rate
+    const double hostRate = audioProcessor.getSampleRate();
+    const double internalRate = audioProcessor.internalSampleRate;
+    if (hostRate > 0.0 && internalRate < hostRate) {
+        text << "\nEco: voices at " << juce::String(internalRate / 1000.0, 2) << " kHz, latency "
+             << audioProcessor.getLatencySamples() << " samples";
+    }
+    statsLabel.setText(text, juce::dontSendNotification);
 }
 
 //==============================================================================
@@ -88,8 +482,24 @@ void PluginAudioProcessorEditor::resized()
 
     panSlider.setBounds(0, 0, 100, 100);
     detuneSlider.setBounds(100, 0, 100, 100);
+    renderThreadsSlider.setBounds(200, 0, 100, 100);
+    unisonGovernorButton.setBounds(300, 5, 100, 20);
+    parallelRenderingButton.setBounds(300, 30, 100, 20);
+    ecoModeBox.setBounds(300, 55, 100, 20);
+    unisonVoicesSlider.setBounds(400, 0, 100, 100);
+    helperProcessesSlider.setBounds(500, 0, 100, 100);
+    statsLabel.setBounds(620, 0, juce::jmax(0, getWidth() - 760), 100);
+    programFadeButton.setBounds(getWidth() - 140, 5, 70, 20);
+    traceButton.setBounds(getWidth() - 70, 5, 70, 20);
+    performanceHudButton.setBounds(getWidth() - 70, 30, 70, 20);
+    cartridgeLibraryButton.setBounds(getWidth() - 70, 55, 70, 20);
+    layerPanelButton.setBounds(getWidth() - 70, 80, 70, 20);
 
 
     // Add tabbed component to hold the Dexed editors
     tabbedComponent->setBounds(0, 100, getWidth(), getHeight() - 100);
+    loadingLabel.setBounds(0, 100, getWidth(), getHeight() - 100);
+    performanceHud.setBounds(0, 100 + tabbedComponent->getTabBarDepth(), getWidth(), juce::jmax(0, getHeight() - 100 - tabbedComponent->getTabBarDepth()));
+    cartridgeLibraryPanel.setBounds(performanceHud.getBounds());
+    layerPanel.setBounds(performanceHud.getBounds());
 }
@@ -9,12 +9,18 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "CartridgeLibraryPanel.h"
+#include "LayerPanel.h"
+#include "LevelMeterComponent.h"
+#include "PerformanceHud.h"
 #include "PluginProcessor.h"
 
 //==============================================================================
 /**
 */
-class PluginAudioProcessorEditor  : public juce::AudioProcessorEditor
+class PluginAudioProcessorEditor  : public juce::AudioProcessorEditor,
+                                    juce::ChangeListener,
+                                    juce::Timer
 {
 public:
     PluginAudioProcessorEditor (PluginAudioProcessor&);
@@ -25,6 +31,69 @@ public:
     void resized() override;
 
 private:
+    // Adds or removes tabs when the number of instances changes
+    void changeListenerCallback(juce::ChangeBroadcaster *source) override;
+
+    // Updates the level meters, and the CPU and memory figures every few calls
+    void timerCallback() override;
+    void updateLevelMeters();
+    void updateStats();
+
+    static constexpr int levelMeterRefreshRate = 24;
+    static constexpr int statsRefreshRate = 2;
+    int timerTicksSinceStatsUpdate = 0;
+
+    // Adds or removes tabs until there is one per instance, followed by one per layer that is on
+    void updateTabs();
+
+    // Adds the tab with the editor of the instance with the given index
+    void addInstanceTab(int index);
+
+    // Adds a tab with the editor of voice 0 of the layer with the given index in the layers of the processor
+    void addLayerTab(int layer);
+
+    // Removes the last tab and deletes its editor
+    void removeLastTab();
+
+    // The instance whose editor the tab shows, nullptr if there is none
+    juce::AudioProcessor *getTabInstance(int tab) const;
+
+    // The slot of the processor whose level the meter of the tab shows
+    int getTabSlot(int tab) const;
+
+    // The layers that have tabs, in the order of the tabs, which come after those of the instances
+    juce::Array<int> layerTabs;
+
+    // Creates the editor of the instance with the given index if needed, shows it and hides the others
+    void showInstanceEditor(int index);
+
+    // Deletes the editor of the instance with the given index, if it has one
+    void releaseInstanceEditor(int index);
+
+    // Hidden editors kept alive, the least recently shown first; the others are deleted. Their timers
+    // keep running, so they are also deleted once they have been hidden for a while.
+    juce::Array<int> recentlyShownTabs;
+    juce::Array<juce::uint32> editorHiddenTimes;
+    static constexpr int maximumNumberOfHiddenEditors = 2;
+    static constexpr juce::uint32 hiddenEditorLifetimeMilliseconds = 5000;
+
+    // Deletes the hidden editors that have been hidden longer than hiddenEditorLifetimeMilliseconds
+    void releaseExpiredEditors();
+
+    // Set once the window got the size of the Dexed editors
+    bool isSizedForEditors = false;
+
+    // Shows whether the instances are still being loaded
+    void updateLoadingLabel();
+
+    // Size of the meters in the tabs
+    static constexpr int levelMeterWidth = 40;
+    static constexpr int levelMeterHeight = 8;
+
+    // Size of the tabs while the instances are being loaded and their editors are not known yet
+    static constexpr int loadingWidth = 866;
+    static constexpr int loadingHeight = 700;
+
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
     PluginAudioProcessor& audioProcessor;
@@ -35,23 +104,72 @@ private:
     // Pointer to our tabbed component
     std::unique_ptr<juce::TabbedComponent> tabbedComponent;
 
-    // Array with 8 pointers to our Dexed components
-    std::unique_ptr<juce::Component> dexedComponents[8];
+    // One Dexed component per tab, i.e. per instance
+    juce::OwnedArray<juce::Component> dexedComponents;
+
+    // The Dexed editors of the tabs, nullptr until a tab is first selected; owned by the instances
+    juce::Array<juce::AudioProcessorEditor*> dexedEditors;
 
-    // Array with 8 pointers to our Dexed editors
-    juce::AudioProcessorEditor* dexedEditors[8];
+    // The level meter in each tab, nullptr for the Master tab; owned by the tab buttons
+    juce::Array<LevelMeterComponent*> levelMeters;
 
     // Sliders for the MultiDexed parameters
     juce::Slider detuneSlider;
     juce::Slider panSlider;
+    juce::Slider renderThreadsSlider;
+    juce::Slider unisonVoicesSlider;
+    juce::Slider helperProcessesSlider;
+
+    // Toggle for rendering the instances in parallel
+    juce::ToggleButton parallelRenderingButton;
+
+    // Toggle for the governor that sheds voices under CPU pressure
+    juce::ToggleButton unisonGovernorButton;
+
+    // Toggle for fading the output out and in around program changes
+    juce::ToggleButton programFadeButton;
+
+    // Records a trace of the blocks while it is on
+    juce::ToggleButton traceButton;
+
+    // Shows the render time of every voice and the load of the blocks
+    juce::ToggleButton performanceHudButton;
+    PerformanceHud performanceHud { audioProcessor.performanceMonitor };
+
+    // Finds voices in the cartridges on disk and loads them into all instances
+    juce::ToggleButton cartridgeLibraryButton;
+    CartridgeLibraryPanel cartridgeLibraryPanel;
+
+    // Voices, spreads and note ranges of the main group and the layers
+    juce::ToggleButton layerPanelButton;
+    LayerPanel layerPanel { audioProcessor.apvts, PluginAudioProcessor::maximumNumberOfLayers };
+
+    // Rate the instances run at
+    juce::ComboBox ecoModeBox;
 
     // Attach the sliders to the parameters
     std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> detuneSliderAttachment;
     std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> panSliderAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> renderThreadsSliderAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> unisonVoicesSliderAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> helperProcessesSliderAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ButtonAttachment> parallelRenderingButtonAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ButtonAttachment> unisonGovernorButtonAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ButtonAttachment> programFadeButtonAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> ecoModeBoxAttachment;
     
     // Labels for the sliders
     juce::Label detuneLabel;
     juce::Label panLabel;
+    juce::Label renderThreadsLabel;
+    juce::Label unisonVoicesLabel;
+    juce::Label helperProcessesLabel;
+
+    // CPU and memory used by the instances
+    juce::Label statsLabel;
+
+    // Shown instead of the tabs while the instances are being loaded, or if they could not be
+    juce::Label loadingLabel;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PluginAudioProcessorEditor)
 };
@@ -10,308 +10,1633 @@
 // or
 // gmake CONFIG=Debug
 
+namespace {
+
+// Set while the current thread applies control commands. Changes that instance 0 reports
+// meanwhile are caused by the commands themselves, which already cover all instances.
+thread_local bool isApplyingControlCommands = false;
+
+// Set while the message thread changes the program in instance 0; the setProgram command
+// posted before it already covers the followers
+thread_local bool isSwitchingProgram = false;
+
+} // namespace
+
 PluginAudioProcessor::PluginAudioProcessor()
     : apvts(*this, nullptr, "Parameters", createParameterLayout()),
       // juce::AudioProcessor(BusesProperties().withInput("Input", juce::AudioChannelSet::stereo(), true)
     juce::AudioProcessor(BusesProperties().withOutput("Output", juce::AudioChannelSet::stereo(), true))
 {
-    juce::OwnedArray<juce::PluginDescription> pluginDescriptions;
-    juce::KnownPluginList pluginList;
-    juce::AudioPluginFormatManager pluginFormatManager;
+    detuneSpreadParameter = apvts.getRawParameterValue("detuneSpread");
+    unisonVoicesParameter = apvts.getRawParameterValue("unisonVoices");
+    parallelRenderingParameter = apvts.getRawParameterValue("parallelRendering");
+    renderThreadsParameter = apvts.getRawParameterValue("renderThreads");
+    fmEngineParameter = apvts.getRawParameterValue("fmEngine");
+    helperProcessesParameter = apvts.getRawParameterValue("helperProcesses");
+    ecoModeParameter = apvts.getRawParameterValue("ecoMode");
+    unisonGovernorParameter = apvts.getRawParameterValue("unisonGovernor");
+    programFadeParameter = apvts.getRawParameterValue("programFade");
+    noteRange.attach(apvts, {});
+    for (int layer = 0; layer < maximumNumberOfLayers - 1; layer++) {
+        layers[static_cast<size_t>(layer)].attach(apvts, layer + 2);
+    }
+
+    // Every instance has its own detune, so instance 0 must not overwrite it
+    parameterSync.excludeParameter(ParameterSync::detuneParameterIndex);
+
+    juce::VST3PluginFormat *vst3 = new juce::VST3PluginFormat();
+    pluginFormatManager.addFormat(vst3);
+
+    // The instances are created by continueLoading() once the scan is done; until then
+    // processBlock outputs silence and the host's state and MIDI are kept for later
+    instanceLoader.onInstanceCreated = [this](int index, std::unique_ptr<juce::AudioPluginInstance> instance, const juce::String &error) {
+        if (instance == nullptr) {
+            RealtimeLog::write(RealtimeLog::Level::error, "Error loading Dexed: {}", error);
+            loadingHasFailed = true;
+            sendChangeMessage();
+            return;
+        }
+        performanceMonitor.setMemoryUsage(index, juce::jmax<int64_t>(0, PerformanceMonitor::getProcessMemoryUsage() - memoryBeforeLastRequest));
+        dexedPluginInstances[index] = std::move(instance);
+    };
+    instanceLoader.startScan();
+    loadingMidi.ensureSize(loadingMidiCapacity);
+
+    // Watch the loader, and later unisonVoices for instances to create or tear down
+    startTimer(100);
+}
+
+void PluginAudioProcessor::continueLoading()
+{
+    if (loadingHasFailed || !instanceLoader.hasScanned()) {
+        return;
+    }
+
+    if (dexedPluginDescription == nullptr) {
+        const juce::PluginDescription *description = instanceLoader.getDescription();
+        if (description == nullptr) {
+            RealtimeLog::write(RealtimeLog::Level::error, "Dexed not found");
+            loadingHasFailed = true;
+            sendChangeMessage();
+            return;
+        }
+
+        // Keep the description for the instances created when unisonVoices changes
+        dexedPluginDescription = std::make_unique<juce::PluginDescription>(*description);
+        outOfProcessHost.setPluginDescription(*dexedPluginDescription);
+        numberOfInstancesToLoad = static_cast<int>(unisonVoicesParameter->load()) + 1;
+    }
+
+    // As many at a time as the format allows; VST3 instances are created one per timer tick
+    for (int i = 0; i < numberOfInstancesToLoad && !loadingHasFailed; i++) {
+        if (!instanceIsRequested[i]) {
+            memoryBeforeLastRequest = PerformanceMonitor::getProcessMemoryUsage();
+            if (!instanceLoader.requestInstance(i, preparedSampleRate, preparedBlockSize)) {
+                break;
+            }
+            instanceIsRequested[i] = true;
+        }
+    }
+
+    for (int i = 0; i < numberOfInstancesToLoad; i++) {
+        if (dexedPluginInstances[i] == nullptr) {
+            return;
+        }
+    }
+
+    if (!loadingHasFailed) {
+        finishLoading();
+    }
+}
+
+void PluginAudioProcessor::finishLoading()
+{
+    const juce::ScopedLock lock(instanceLock);
+
+    RealtimeLog::write(RealtimeLog::Level::info, "Loaded {} with {} instances", dexedPluginInstances[0]->getName(), numberOfInstancesToLoad);
+
+    juce::AudioProcessor *instances[maximumNumberOfInstances];
+    for (int i = 0; i < numberOfInstancesToLoad; i++) {
+        instances[i] = dexedPluginInstances[i].get();
+    }
+    stateReplicator.setInstances(instances, numberOfInstancesToLoad);
+
+    // Attached here already so that states restored before prepareToPlay can use the index maps
+    parameterSync.attach(instances[0], maximumNumberOfInstances);
+    for (int i = 1; i < numberOfInstancesToLoad; i++) {
+        parameterSync.setFollower(i, instances[i]);
+    }
+    numberOfInstances = numberOfInstancesToLoad;
+    changeNumberOfInstances(numberOfInstancesToLoad);
+
+    if (prepareWhenLoaded) {
+        prepareToPlay(hostSampleRate, hostBlockSize);
+    }
+
+    // From now on processBlock renders, and states from the host go to the instances
+    juce::MemoryBlock waitingState;
+    {
+        const juce::ScopedLock stateLock(latestPostedStateLock);
+        instancesAreReady = true;
+        if (hostStateWaitsForInstances) {
+            waitingState = latestPostedState;
+            hostStateWaitsForInstances = false;
+        }
+    }
+    if (!waitingState.isEmpty()) {
+        setStateInformation(waitingState.getData(), static_cast<int>(waitingState.getSize()));
+        pendingHostStates--;
+    }
+
+    sendChangeMessage();
+}
+
+PluginAudioProcessor::~PluginAudioProcessor()
+{
+    stopTimer();
+    isPrepared = false;
+    renderPool.stop();
+    outOfProcessHost.release();
+    applyPendingControlCommands();
+    programSnapshots.setInstance(nullptr);
+
+    // Release the plugins
+    for (int i = 0; i < maximumNumberOfInstances; i++) {
+        if (dexedPluginInstances[i] != nullptr) {
+            dexedPluginInstances[i]->releaseResources();
+        }
+    }
+}
+
+void PluginAudioProcessor::applyDetune(float range)
+{
+    // Return if any of the plugin instances are null
+    for (int i = 0; i < activeInstances; i++) {
+        if (dexedPluginInstances[i] == nullptr) {
+            return;
+        }
+    }
+
+    // Spread evenly and symmetrically around the center, however many instances there are
+    for (int i = 1; i < activeInstances; i++) {
+        double detune = 0.5 - range/2.0 + i * range/activeInstances;
+        // Not notifying, nobody needs to hear about changes in the follower instances
+        dexedPluginInstances[i]->getParameters()[ParameterSync::detuneParameterIndex]->setValue(static_cast<float>(detune));
+        fmLaneTunings[i - 1] = static_cast<float>(detune);
+    }
+    appliedDetuneSpread = range;
+
+    // The lanes of the FM engine are tuned along with the mixer gains
+    mixGainsAreStale = true;
+}
+
+void PluginAudioProcessor::finishStateLoad()
+{
+    // Followers that were not loaded only got the cartridge of the leader, and changes
+    // to the leader were held back during the load, so copy what differs now
+    parameterSync.resynchronize();
+
+    // Loading a state overwrites the detune of the followers
+    applyDetune(detuneSpreadParameter->load());
+    fmPatchIsStale = true;
+
+    // The state may hold another cartridge
+    programSnapshots.invalidate();
+    programSnapshotsAreStale = true;
+
+    // The copies in the helper processes are not used again until they got the new states
+    outOfProcessHost.invalidateStates();
+
+    followersNeedAllNotesOff = true;
+}
+
+void PluginAudioProcessor::applyOverrides(const juce::MemoryBlock &overrides)
+{
+    const auto *entries = static_cast<const SessionState::Override *>(overrides.getData());
+    const size_t numberOfEntries = overrides.getSize() / sizeof(SessionState::Override);
+
+    for (size_t i = 0; i < numberOfEntries; i++) {
+        // Instance 0 has no overrides, it is what the others are compared to
+        if (entries[i].instance > 0) {
+            if (auto *parameter = parameterSync.getParameter(entries[i].instance, entries[i].parameterIndex)) {
+                parameter->setValue(entries[i].value);
+            }
+        }
+    }
+
+    // The overrides may include the mute parameter, which setValue() does not report
+    parameterSync.refreshMuteFlags();
+    pendingHostStates--;
+}
+
+bool PluginAudioProcessor::postControlCommand(ControlCommandQueue::Type type, int index, float value)
+{
+    const bool posted = controlCommands.post(type, index, value);
+
+    // Without blocks being processed nothing else would apply the command, and
+    // nothing can run concurrently with it either, so apply it right here
+    if (!isPrepared.load(std::memory_order_acquire)) {
+        applyPendingControlCommands();
+    }
+    return posted;
+}
+
+void PluginAudioProcessor::postControlCommand(ControlCommandQueue::Type type, std::unique_ptr<juce::MemoryBlock> state)
+{
+    if (!controlCommands.post(type, std::move(state)) && type == ControlCommandQueue::Type::applyOverrides) {
+        // Dropped, so it will never mark the end of the host state
+        pendingHostStates--;
+    }
+
+    if (!isPrepared.load(std::memory_order_acquire)) {
+        applyPendingControlCommands();
+    }
+}
+
+void PluginAudioProcessor::applyControlCommands()
+{
+    MULTIDEXED_TRACE_SCOPE("applyControlCommands");
+
+    // Whatever was posted after the state being loaded has to wait for it
+    if (stateReplicator.isLoading()) {
+        return;
+    }
+
+    isApplyingControlCommands = true;
+
+    if (juce::MemoryBlock *loadedState = stateReplicator.takeFinishedLoad()) {
+        finishStateLoad();
+        controlCommands.retire(loadedState);
+    }
+
+    // The detuneSpread is picked up here rather than posted, as the host may automate it from the audio thread
+    const float detuneSpread = detuneSpreadParameter->load();
+    if (detuneSpread != appliedDetuneSpread) {
+        applyDetune(detuneSpread);
+    }
+
+    // A faded program change happens once the previous block has faded out
+    if (programIsFadingOut) {
+        switchProgram(pendingProgramChanges);
+        pendingProgramChanges = nullptr;
+        programIsFadingOut = false;
+        programIsFadingIn = true;
+    }
+
+    controlCommands.applyAll([this](const ControlCommandQueue::Command &command) {
+        switch (command.type) {
+        case ControlCommandQueue::Type::setProgram:
+            // Faded programs are switched once the output is silent, see processBlock()
+            if (programFadeParameter->load() > 0.5f && isPrepared.load(std::memory_order_acquire)) {
+                // Another change while one waits: the new one only has what differs from the waiting one
+                if (pendingProgramChanges != nullptr) {
+                    switchProgram(pendingProgramChanges);
+                }
+                pendingProgramChanges = command.state;
+            } else {
+                switchProgram(command.state);
+            }
+            return true;
+        case ControlCommandQueue::Type::setNumberOfInstances:
+            changeNumberOfInstances(command.index);
+            pendingInstanceCountChanges--;
+            return true;
+        case ControlCommandQueue::Type::setLayerVoices:
+            changeLayerVoices(command.index, static_cast<int>(command.value));
+            layers[static_cast<size_t>(command.index)].pendingVoiceCountChanges--;
+            return true;
+        case ControlCommandQueue::Type::applyOverrides:
+            applyOverrides(*command.state);
+            controlCommands.retire(command.state);
+            return true;
+        case ControlCommandQueue::Type::setFmPatch:
+            fmEngine.setPatch(*static_cast<const Dx7Patch *>(command.state->getData()));
+            controlCommands.retire(command.state);
+            return true;
+        case ControlCommandQueue::Type::applyState:
+        case ControlCommandQueue::Type::applyStateToFollowers:
+            break;
+        }
+
+        const int firstInstance = command.type == ControlCommandQueue::Type::applyState ? 0 : 1;
+
+        // Loading takes far longer than a block, so leave it to the replicator and stop here;
+        // the state comes back through takeFinishedLoad() once the instances have it
+        if (isPrepared.load(std::memory_order_acquire)) {
+            stateReplicator.startLoad(command.state, firstInstance);
+            return false;
+        }
+
+        stateReplicator.load(*command.state, firstInstance);
+        finishStateLoad();
+        controlCommands.retire(command.state);
+        return true;
+    });
+
+    isApplyingControlCommands = false;
+}
+
+void PluginAudioProcessor::applyPendingControlCommands()
+{
+    jassert(!isPrepared);
+
+    stateReplicator.waitUntilIdle();
+    applyControlCommands();
+    controlCommands.collectGarbage();
+}
+
+void PluginAudioProcessor::changeNumberOfInstances(int newNumberOfInstances)
+{
+    const bool fade = isPrepared.load(std::memory_order_acquire);
+    updateInstanceTargets(newNumberOfInstances);
+
+    activeInstances = newNumberOfInstances;
+    const int rendered = fade ? juce::jmax(renderedInstances.load(), newNumberOfInstances) : newNumberOfInstances;
+    renderedInstances = rendered;
+    parameterSync.setNumberOfInstancesInUse(rendered);
+    stateReplicator.setNumberOfInstances(newNumberOfInstances);
+
+    // New instances were brought up to date with instance 0 before the command was posted; their
+    // mute parameter may have changed then
+    parameterSync.refreshMuteFlags();
+    applyDetune(detuneSpreadParameter->load());
+    mixGainsAreStale = true;
+}
+
+void PluginAudioProcessor::updateInstanceTargets(int newNumberOfInstances)
+{
+    // Without blocks being processed there is nothing to fade
+    const bool fade = isPrepared.load(std::memory_order_acquire);
+
+    // The governor sheds the outermost detuned voices first, alternating between the lowest and the highest
+    shedInstances = 0;
+    for (int s = 0, low = 1, high = newNumberOfInstances - 1; s < shedVoices && low < high; s++) {
+        shedInstances |= uint64_t(1) << (s % 2 == 0 ? low++ : high--);
+    }
+    effectiveVoices = newNumberOfInstances - 1 - juce::countNumberOfBits(shedInstances);
+
+    for (int i = 1; i < maximumNumberOfInstances; i++) {
+        const float target = i < newNumberOfInstances && !(shedInstances & (uint64_t(1) << i)) ? 1.0f : 0.0f;
+        setFadeTarget(i, target, fade);
+    }
+
+    // if numberOfInstances is 9, pan for instance 1 is 0.0, for instance 2 is 0.14, for instance 3 is 0.28, for instance 4 is 0.42, for instance 5 is 0.57, for instance 6 is 0.71, for instance 7 is 0.85, for instance 8 is 1.0
+    // if numberOfInstances is 8, pan for instance 1 is 0.0, for instance 2 is 0.17, for instance 3 is 0.33, for instance 4 is 0.5, for instance 5 is 0.67, for instance 6 is 0.83, for instance 7 is 1.0
+    // if numberOfInstances is 7, pan for instance 1 is 0.0, for instance 2 is 0.2, for instance 3 is 0.4, for instance 4 is 0.6, for instance 5 is 0.8, for instance 6 is 1.0
+    // if numberOfInstances is 6, pan for instance 1 is 0.0, for instance 2 is 0.25, for instance 3 is 0.5, for instance 4 is 0.75, for instance 5 is 1.0
+    // if numberOfInstances is 5, pan for instance 1 is 0.0, for instance 2 is 0.33, for instance 3 is 0.66, for instance 4 is 1.0
+    // if numberOfInstances is 4, pan for instance 1 is 0.0, for instance 2 is 0.5, for instance 3 is 1.0
+    // if numberOfInstances is 3, pan for instance 1 is 0.0, for instance 2 is 1.0
+    // if numberOfInstances is 2, pan for instance 1 is 0.5
+    // Considering the above, the pan for instance i is (i-1)/(numberOfInstances-2), which spreads the
+    // instances symmetrically around the center so that the stereo image stays balanced.
+    // Instances that are fading out keep their pan. Voices shed by the governor are left out,
+    // and the ones that are left are spread the same way.
+    const int audibleInstances = newNumberOfInstances - juce::countNumberOfBits(shedInstances);
+    for (int i = 1, k = 0; i < newNumberOfInstances; i++) {
+        if (!(shedInstances & (uint64_t(1) << i))) {
+            instancePans[i] = audibleInstances > 2 ? k / (audibleInstances - 2.0f) : 0.5f;
+            k++;
+        }
+    }
+
+}
+
+void PluginAudioProcessor::setFadeTarget(int slot, float target, bool fade)
+{
+    const float step = static_cast<float>(1.0 / (instanceFadeSeconds * preparedSampleRate));
+    if (!fade) {
+        instanceFadeGains[slot] = target;
+        instanceFadeSteps[slot] = 0.0f;
+    } else if (target != instanceFadeGains[slot]) {
+        instanceFadeSteps[slot] = target > instanceFadeGains[slot] ? step : -step;
+    } else {
+        instanceFadeSteps[slot] = 0.0f;
+    }
+}
+
+void PluginAudioProcessor::changeLayerVoices(int layer, int newNumberOfVoices)
+{
+    UnisonLayer &unisonLayer = layers[static_cast<size_t>(layer)];
+
+    // Without blocks being processed there is nothing to fade
+    const bool fade = isPrepared.load(std::memory_order_acquire);
+    for (int v = 0; v < UnisonLayer::maximumNumberOfVoices; v++) {
+        setFadeTarget(getLayerSlot(layer, v), v < newNumberOfVoices ? 1.0f : 0.0f, fade);
+    }
+
+    const int rendered = fade ? juce::jmax(unisonLayer.renderedVoices.load(), newNumberOfVoices) : newNumberOfVoices;
+    unisonLayer.setActiveVoices(newNumberOfVoices, rendered);
+    mixGainsAreStale = true;
+}
+
+void PluginAudioProcessor::updateGovernor(double processSeconds, int numSamples)
+{
+    // Shedding voices does not make the FM engine any cheaper, and offline renders have no deadline
+    if (unisonGovernorParameter->load() > 0.5f && !fmEngineWasUsed && !isNonRealtime()) {
+        governor.update(processSeconds, numSamples / hostSampleRate, activeInstances - 1);
+    } else {
+        governor.reset();
+    }
+
+    if (governor.getNumberOfShedVoices() != shedVoices) {
+        shedVoices = governor.getNumberOfShedVoices();
+        updateInstanceTargets(activeInstances);
+        mixGainsAreStale = true;
+    }
+}
+
+void PluginAudioProcessor::prepareInstance(juce::AudioProcessor &instance, double sampleRate, int samplesPerBlock)
+{
+    instance.releaseResources();
+    instance.setRateAndBufferSizeDetails(sampleRate, samplesPerBlock);
+
+    // sync number of buses
+
+    // TODO: Do we need nuberIfInstances instead of the hardcoded 2?
+    for (int dir = 0; dir < 2; ++dir) {
+        const bool isInput = (dir == 0);
+        int expectedNumBuses = getBusCount(isInput);
+        int requiredNumBuses1 = instance.getBusCount(isInput);
+
+        for (; expectedNumBuses < requiredNumBuses1; expectedNumBuses++)
+            instance.addBus(isInput);
+
+        for (; requiredNumBuses1 < expectedNumBuses; requiredNumBuses1++)
+            instance.removeBus(isInput);
+
+    }
+
+    instance.setBusesLayout(getBusesLayout());
+    instance.prepareToPlay(sampleRate, samplesPerBlock);
+}
+
+bool PluginAudioProcessor::createInstance(int index)
+{
+    juce::String msg("Error Loading Plugin: ");
+    const int64_t memoryBefore = PerformanceMonitor::getProcessMemoryUsage();
+
+    auto instance = pluginFormatManager.createPluginInstance(*dexedPluginDescription, preparedSampleRate, preparedBlockSize, msg);
+    if (instance == nullptr) {
+        RealtimeLog::write(RealtimeLog::Level::error, "{}", msg);
+        return false;
+    }
+
+    if (isPrepared) {
+        prepareInstance(*instance, preparedSampleRate, preparedBlockSize);
+    }
+
+    // Start out as a copy of instance 0
+    juce::MemoryBlock state;
+    stateReplicator.getLeaderState(state);
+    {
+        const juce::ScopedLock dexedLock(StateReplicator::getDexedLock());
+        instance->setStateInformation(state.getData(), static_cast<int>(state.getSize()));
+    }
+
+    performanceMonitor.setMemoryUsage(index, juce::jmax<int64_t>(0, PerformanceMonitor::getProcessMemoryUsage() - memoryBefore));
+    parameterSync.setFollower(index, instance.get());
+    stateReplicator.setInstance(index, instance.get());
+    dexedPluginInstances[index] = std::move(instance);
+    return true;
+}
+
+void PluginAudioProcessor::destroyInstance(int index)
+{
+    auto &instance = dexedPluginInstances[index];
+    if (instance == nullptr) {
+        return;
+    }
+
+    parameterSync.setFollower(index, nullptr);
+    stateReplicator.setInstance(index, nullptr);
+    performanceMonitor.resetInstance(index);
+
+    // The editor has no tab any more, but it still exists
+    delete instance->getActiveEditor();
+    instance->releaseResources();
+    instance.reset();
+}
+
+void PluginAudioProcessor::updateNumberOfInstances()
+{
+    const juce::ScopedLock lock(instanceLock);
+
+    if (dexedPluginInstances[0] == nullptr) {
+        return;
+    }
+
+    const int wantedNumberOfInstances = juce::jlimit(2, maximumNumberOfInstances, static_cast<int>(unisonVoicesParameter->load()) + 1);
+    const int currentNumberOfInstances = numberOfInstances.load();
+
+    if (wantedNumberOfInstances != currentNumberOfInstances && wantedNumberOfInstances != failedNumberOfInstances) {
+        // Create what is missing; instances that are still fading out are simply used again
+        int newNumberOfInstances = juce::jmin(wantedNumberOfInstances, currentNumberOfInstances);
+        for (int i = currentNumberOfInstances; i < wantedNumberOfInstances; i++) {
+            if (dexedPluginInstances[i] == nullptr && !createInstance(i)) {
+                failedNumberOfInstances = wantedNumberOfInstances;
+                break;
+            }
+            newNumberOfInstances = i + 1;
+        }
+        if (newNumberOfInstances == wantedNumberOfInstances) {
+            failedNumberOfInstances = 0;
+        }
+
+        if (newNumberOfInstances != currentNumberOfInstances) {
+            // New instances start out as copies of instance 0, but it may have changed since. Those that
+            // are not rendered any more are left alone by the audio thread until the command puts them in use.
+            for (int i = juce::jmax(currentNumberOfInstances, renderedInstances.load()); i < newNumberOfInstances; i++) {
+                parameterSync.resynchronize(i);
+            }
+
+            numberOfInstances = newNumberOfInstances;
+            pendingInstanceCountChanges++;
+            if (!postControlCommand(ControlCommandQueue::Type::setNumberOfInstances, newNumberOfInstances)) {
+                // The queue is full, e.g. of automation during a long state load; try again on the next tick
+                // and leave the instances alone until then, the audio thread still renders the old number
+                numberOfInstances = currentNumberOfInstances;
+                pendingInstanceCountChanges--;
+                return;
+            }
+
+            // Lets the editor add or remove tabs before any instance goes away
+            sendSynchronousChangeMessage();
+        }
+    }
+
+    // Tear down the instances that have been faded out
+    if (pendingInstanceCountChanges.load() == 0) {
+        const int firstUnusedInstance = juce::jmax(numberOfInstances.load(), renderedInstances.load());
+        for (int i = maximumNumberOfInstances - 1; i >= firstUnusedInstance; i--) {
+            destroyInstance(i);
+        }
+    }
+}
+
+bool PluginAudioProcessor::createLayerVoice(int layer, int voice)
+{
+    UnisonLayer &unisonLayer = layers[static_cast<size_t>(layer)];
+    juce::String msg("Error Loading Plugin: ");
+    const int64_t memoryBefore = PerformanceMonitor::getProcessMemoryUsage();
+
+    auto instance = pluginFormatManager.createPluginInstance(*dexedPluginDescription, preparedSampleRate, preparedBlockSize, msg);
+    if (instance == nullptr) {
+        RealtimeLog::write(RealtimeLog::Level::error, "{}", msg);
+        return false;
+    }
+
+    if (isPrepared) {
+        prepareInstance(*instance, preparedSampleRate, preparedBlockSize);
+    }
+
+    // Copies of voice 0; voice 0 gets the patch of the layer, or starts out as a copy of the main group
+    juce::MemoryBlock state;
+    if (voice > 0) {
+        unisonLayer.getVoice(0)->getStateInformation(state);
+    } else {
+        state = unisonLayer.getState();
+        if (state.isEmpty()) {
+            stateReplicator.getLeaderState(state);
+        }
+    }
+    {
+        const juce::ScopedLock dexedLock(StateReplicator::getDexedLock());
+        instance->setStateInformation(state.getData(), static_cast<int>(state.getSize()));
+    }
+
+    performanceMonitor.setMemoryUsage(getLayerSlot(layer, voice), juce::jmax<int64_t>(0, PerformanceMonitor::getProcessMemoryUsage() - memoryBefore));
+    unisonLayer.addVoice(voice, std::move(instance));
+    return true;
+}
+
+void PluginAudioProcessor::updateLayers()
+{
+    const juce::ScopedLock lock(instanceLock);
+
+    if (dexedPluginInstances[0] == nullptr || dexedPluginDescription == nullptr) {
+        return;
+    }
+
+    for (int layer = 0; layer < maximumNumberOfLayers - 1; layer++) {
+        UnisonLayer &unisonLayer = layers[static_cast<size_t>(layer)];
+
+        // Voices that have to be created again are taken away first
+        const int firstVoiceToReload = unisonLayer.getFirstVoiceToReload();
+        const int wantedNumberOfVoices = juce::jmin(unisonLayer.getWantedNumberOfVoices(), firstVoiceToReload);
+        const int currentNumberOfVoices = unisonLayer.numberOfVoices.load();
+
+        if (wantedNumberOfVoices != currentNumberOfVoices && wantedNumberOfVoices != unisonLayer.failedNumberOfVoices) {
+            // Create what is missing; voices that are still fading out are simply used again
+            int newNumberOfVoices = juce::jmin(wantedNumberOfVoices, currentNumberOfVoices);
+            for (int v = currentNumberOfVoices; v < wantedNumberOfVoices; v++) {
+                if (unisonLayer.getVoice(v) == nullptr && !createLayerVoice(layer, v)) {
+                    unisonLayer.failedNumberOfVoices = wantedNumberOfVoices;
+                    break;
+                }
+                newNumberOfVoices = v + 1;
+            }
+            if (newNumberOfVoices == wantedNumberOfVoices) {
+                unisonLayer.failedNumberOfVoices = 0;
+            }
+
+            if (newNumberOfVoices != currentNumberOfVoices) {
+                // As for the main instances, the voices that are not rendered yet are brought up to date here
+                for (int v = juce::jmax(currentNumberOfVoices, unisonLayer.renderedVoices.load()); v < newNumberOfVoices; v++) {
+                    unisonLayer.resynchronizeVoice(v);
+                }
+
+                unisonLayer.numberOfVoices = newNumberOfVoices;
+                unisonLayer.pendingVoiceCountChanges++;
+                if (!postControlCommand(ControlCommandQueue::Type::setLayerVoices, layer, static_cast<float>(newNumberOfVoices))) {
+                    // As for the main instances: try again on the next tick, without tearing anything down
+                    unisonLayer.numberOfVoices = currentNumberOfVoices;
+                    unisonLayer.pendingVoiceCountChanges--;
+                    continue;
+                }
+
+                // Lets the editor add or remove the tab of the layer before voice 0 goes away
+                if (currentNumberOfVoices == 0 || newNumberOfVoices == 0) {
+                    sendSynchronousChangeMessage();
+                }
+            }
+        }
+
+        // Tear down the voices that have been faded out
+        if (unisonLayer.pendingVoiceCountChanges.load() == 0) {
+            const int firstUnusedVoice = juce::jmax(unisonLayer.numberOfVoices.load(), unisonLayer.renderedVoices.load());
+
+            // After a cartridge change in voice 0 the other voices that are still wanted are kept and get
+            // its state, which is far quicker than creating them again
+            const bool isReloadingFollowers = firstUnusedVoice <= firstVoiceToReload && firstVoiceToReload > 0
+                                           && firstVoiceToReload < UnisonLayer::maximumNumberOfVoices;
+            const int firstVoiceToRemove = isReloadingFollowers ? juce::jmax(firstUnusedVoice, unisonLayer.getWantedNumberOfVoices())
+                                                                : firstUnusedVoice;
+            for (int v = UnisonLayer::maximumNumberOfVoices - 1; v >= firstUnusedVoice; v--) {
+                if (unisonLayer.getVoice(v) == nullptr) {
+                    continue;
+                }
+                if (v > 0 && v < firstVoiceToRemove) {
+                    unisonLayer.reloadVoice(v);
+                } else {
+                    unisonLayer.removeVoice(v);
+                    performanceMonitor.resetInstance(getLayerSlot(layer, v));
+                }
+            }
+
+            // Put in use again, or created again with the new patch, from the next tick on
+            if (firstUnusedVoice <= firstVoiceToReload && firstVoiceToReload < UnisonLayer::maximumNumberOfVoices) {
+                unisonLayer.finishReload();
+            }
+        }
+    }
+}
+
+void PluginAudioProcessor::updateFmPatch()
+{
+    if (fmEngineParameter->load() < 0.5f || dexedPluginInstances[0] == nullptr) {
+        return;
+    }
+
+    // Dexed does not report all program changes, e.g. those it gets through MIDI
+    const int program = dexedPluginInstances[0]->getCurrentProgram();
+    if (program != fmPatchProgram) {
+        fmPatchProgram = program;
+        fmPatchIsStale = true;
+    }
+
+    // While a knob is being turned in the editor of instance 0, wait until it stops rather than read
+    // its whole state on every tick
+    if (juce::Time::getMillisecondCounter() - fmPatchChangeTime.load() < fmPatchSettleMilliseconds) {
+        return;
+    }
+
+    if (!fmPatchIsStale.exchange(false)) {
+        return;
+    }
+
+    juce::MemoryBlock state;
+    stateReplicator.getLeaderState(state);
+
+    Dx7Patch patch;
+    if (patch.readFromDexedState(state)) {
+        postControlCommand(ControlCommandQueue::Type::setFmPatch, std::make_unique<juce::MemoryBlock>(&patch, sizeof(patch)));
+    }
+}
+
+void PluginAudioProcessor::updateProgramSnapshots()
+{
+    programSnapshots.update();
+
+    if (programSnapshotsHaveFailed || !programSnapshotsAreStale || dexedPluginInstances[0] == nullptr) {
+        return;
+    }
+
+    if (!programSnapshots.hasInstance()) {
+        juce::String error;
+        auto instance = pluginFormatManager.createPluginInstance(*dexedPluginDescription, preparedSampleRate, preparedBlockSize, error);
+        if (instance == nullptr) {
+            RealtimeLog::write(RealtimeLog::Level::warning, "No program snapshots, Dexed could not be loaded for them: {}", error);
+            programSnapshotsHaveFailed = true;
+            return;
+        }
+        programSnapshots.setInstance(std::move(instance));
+    }
+
+    programSnapshotsAreStale = false;
+    juce::MemoryBlock state;
+    stateReplicator.getLeaderState(state);
+    programSnapshots.startBuilding(state);
+}
+
+void PluginAudioProcessor::switchProgram(juce::MemoryBlock *changes)
+{
+    const auto *programChanges = static_cast<const ParameterSync::Change *>(changes->getData());
+    const int numberOfChanges = static_cast<int>(changes->getSize() / sizeof(ParameterSync::Change));
+    MULTIDEXED_TRACE_SCOPE("switchProgram", numberOfChanges);
+
+    // Instance 0 has changed its program on the message thread; without snapshots there are no
+    // changes and the other instances follow it through parameterSync
+    if (numberOfChanges > 0) {
+        parameterSync.applyChanges(programChanges, numberOfChanges);
+
+        // The copies in the helper processes catch up through their states
+        outOfProcessHost.invalidateStates();
+    }
+    fmPatchIsStale = true;
+    controlCommands.retire(changes);
+}
+
+bool PluginAudioProcessor::loadCartridgeVoice(const juce::MemoryBlock &cartridge, int voiceIndex)
+{
+    if (!instancesAreReady || dexedPluginInstances[0] == nullptr) {
+        return false;
+    }
+
+    // Everything but the cartridge and the voice stays as the leader has it
+    juce::MemoryBlock currentState;
+    stateReplicator.getLeaderState(currentState);
+
+    auto state = std::make_unique<juce::MemoryBlock>();
+    if (!CartridgeLibrary::makeDexedState(currentState, cartridge, voiceIndex, *state)) {
+        return false;
+    }
+
+    RealtimeLog::write(RealtimeLog::Level::info, "Loading voice {} of a cartridge from the library", voiceIndex + 1);
+    postControlCommand(ControlCommandQueue::Type::applyState, std::move(state));
+    return true;
+}
+
+void PluginAudioProcessor::updateHelperProcesses()
+{
+    const juce::ScopedLock lock(instanceLock);
+
+    juce::AudioProcessor *instances[maximumNumberOfInstances];
+    for (int i = 0; i < maximumNumberOfInstances; i++) {
+        instances[i] = dexedPluginInstances[i].get();
+    }
+
+    // The helpers need the sample rate and block size, so they only run while blocks are processed
+    const int numberOfHelpers = isPrepared ? static_cast<int>(helperProcessesParameter->load()) : 0;
+    outOfProcessHost.update(numberOfHelpers, numberOfInstances, instances, parameterSync);
+}
+
+void PluginAudioProcessor::timerCallback()
+{
+    if (!instancesAreReady) {
+        continueLoading();
+        return;
+    }
+
+    changeRequestedProgram();
+    updateNumberOfInstances();
+    updateLayers();
+    updateFmPatch();
+    updateProgramSnapshots();
+    updateEcoMode();
+    updateHelperProcesses();
+}
+
+int PluginAudioProcessor::getEcoFactor(double sampleRate) const
+{
+    // Choice 1 runs the instances at 44.1 or 48 kHz, choice 2 at 22.05 or 24 kHz
+    const int mode = static_cast<int>(ecoModeParameter->load());
+    if (mode == 0) {
+        return 1;
+    }
+
+    const double lowestRate = mode == 1 ? 44100.0 : 22050.0;
+    return juce::jlimit(1, PolyphaseUpsampler::maximumFactor, static_cast<int>(sampleRate / lowestRate + 1.0e-6));
+}
+
+void PluginAudioProcessor::prepareEcoMode()
+{
+    ecoFactor = getEcoFactor(hostSampleRate);
+    preparedSampleRate = hostSampleRate / ecoFactor;
+    preparedBlockSize = ecoFactor > 1 ? hostBlockSize / ecoFactor + 1 : hostBlockSize;
+    internalSampleRate = preparedSampleRate;
+
+    ecoUpsampler.prepare(ecoFactor, preparedBlockSize);
+    ecoMixBuffer.setSize(2, preparedBlockSize);
+    ecoOutputBuffer.setSize(2, preparedBlockSize * ecoFactor);
+    ecoMidi.ensureSize(4096);
+    ecoMidi.clear();
+    ecoLeftoverStart = 0;
+    ecoLeftover = 0;
+
+    setLatencySamples(ecoFactor > 1 ? ecoUpsampler.getLatency() : 0);
+}
+
+void PluginAudioProcessor::updateEcoMode()
+{
+    if (!isPrepared || getEcoFactor(hostSampleRate) == ecoFactor) {
+        return;
+    }
+
+    const juce::ScopedLock lock(instanceLock);
+
+    // The block load at the rate before the switch, to compare with the one logged at the next switch
+    RealtimeLog::write(RealtimeLog::Level::info, "Average block load at {} Hz: {} %", preparedSampleRate,
+                       static_cast<double>(performanceMonitor.getAverageBlockLoad()) * 100.0);
+
+    // The host outputs silence meanwhile; the instances keep their programs and states
+    suspendProcessing(true);
+    isPrepared = false;
+    applyPendingControlCommands();
+
+    prepareEcoMode();
+    fmEngine.prepare(preparedSampleRate);
+    outOfProcessHost.prepare(preparedSampleRate, preparedBlockSize, juce::jmax(getTotalNumOutputChannels(), 2));
+    previousRemoteInstances = 0;
+
+    for (int i = 0; i < maximumNumberOfInstances; i++) {
+        if (dexedPluginInstances[i] != nullptr) {
+            prepareInstance(*dexedPluginInstances[i], preparedSampleRate, preparedBlockSize);
+        }
+    }
+    prepareLayerVoices();
+
+    isPrepared = true;
+    suspendProcessing(false);
+}
+
+void PluginAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
+{
+    // Return if any of the plugin instances are null
+    for (int i = 0; i < numberOfInstances; i++) {
+        if (dexedPluginInstances[i] == nullptr) {
+            return;
+        }
+    }
+
+    int maximumExpectedSamplesPerBlock = samplesPerBlock;
+
+    // Keeps the instances from being created or torn down meanwhile
+    const juce::ScopedLock lock(instanceLock);
+
+    // Still loading; finishLoading() prepares with these
+    if (numberOfInstances == 0) {
+        hostSampleRate = sampleRate;
+        hostBlockSize = maximumExpectedSamplesPerBlock;
+        prepareWhenLoaded = true;
+        return;
+    }
+
+    // Hosts may prepare again without releasing first; finish what the previous run left behind
+    isPrepared = false;
+    applyPendingControlCommands();
+
+    // Instances created later are prepared with the rate and block size that eco mode derives from these
+    hostSampleRate = sampleRate;
+    hostBlockSize = maximumExpectedSamplesPerBlock;
+    prepareEcoMode();
+
+    fmEngine.prepare(preparedSampleRate);
+
+    // Helper processes are started again for the new block size by the timer
+    outOfProcessHost.prepare(preparedSampleRate, preparedBlockSize, juce::jmax(getTotalNumOutputChannels(), 2));
+    previousRemoteInstances = 0;
+
+    // Followers are not put to sleep before the tail of Dexed has passed
+    instanceTailSeconds = dexedPluginInstances[0]->getTailLengthSeconds();
+    idleDetector.reset();
+    idleInstances = 0;
+    levelMeters.reset();
+
+    // The load of the previous run says nothing about this one; bring back the voices the governor shed
+    governor.reset();
+    previousSleepingInstances = 0;
+    if (shedVoices != 0) {
+        shedVoices = 0;
+        updateInstanceTargets(activeInstances);
+        mixGainsAreStale = true;
+    }
+
+    // Spawn the render workers up front so that enabling parallel rendering
+    // later does not need to create threads; they sleep while unused
+    int numberOfWorkers = juce::jmin(juce::SystemStats::getNumCpus() - 1,
+                                     InstanceRenderPool::maximumNumberOfWorkers,
+                                     maximumNumberOfInstances - 1);
+    renderPool.start(numberOfWorkers);
+
+    // Allocate the buffers for as many instances and layer voices as there can be, so that neither
+    // processBlock nor a change of unisonVoices or of the layers has to
+    dexedPluginBuffers.allocate(maximumNumberOfSlots, juce::jmax(getTotalNumOutputChannels(), 2), maximumExpectedSamplesPerBlock);
+    layerMixBuffer.setSize(2, maximumExpectedSamplesPerBlock);
+
+    // Reserve space for the per-instance MIDI so that copying it in processBlock does not allocate
+    for (int i = 0; i < maximumNumberOfInstances; i++) {
+        dexedPluginMidiBuffers[i].ensureSize(4096);
+    }
+    noteRangeMidi.ensureSize(4096);
+    for (auto &layer : layers) {
+        layer.reserveMidi();
+    }
+
+    // Instances still fading out from before are prepared as well, they are rendered until they are torn down
+    for (int i = 0; i < maximumNumberOfInstances; i++) {
+        
+        if (dexedPluginInstances[i] == nullptr) {
+            continue;
+        }
+
+        prepareInstance(*dexedPluginInstances[i], preparedSampleRate, preparedBlockSize);
+
+        // Set the program for each plugin instance
+        dexedPluginInstances[i]->setCurrentProgram(5);        
+
+    }
+    prepareLayerVoices();
+
+    // Get the plugin state from the first plugin instance
+    // and apply it to all plugin instances, unless they have it already
+    juce::MemoryBlock state;
+    stateReplicator.getLeaderState(state);
+    stateReplicator.load(state, 1);
+
+    // Configure the plugin instances to our liking
+
+    applyDetune(detuneSpreadParameter->load());
+    
+    for (int i = 0; i < dexedPluginInstances[0]->getParameters().size(); i++) {
+        // Print the names of the parameters and their values
+        // if (!dexedPluginInstances[0]->getParameterName(i).contains("MIDI CC")) {
+        //     std::cout << "Parameter " << i << ": " << dexedPluginInstances[0]->getParameterName(i).toStdString() << " = " << dexedPluginInstances[0]->getParameter(i) << std::endl;
+        // }
+        // Add listener to each parameter
+        juce::AudioProcessorParameter* parameter = dexedPluginInstances[0]->getParameters()[i];
+        
+        parameter->addListener(this);   
+    }
+
+    // From now on control commands are applied at the start of each block
+    isPrepared = true;
+
+    // Add apvts listener for panSpread in order to print a message when it changes
+    apvts.addParameterListener("panSpread", this);
+
+    // Add apvts listener for all parameters to update the other instances when they change
+    // for (int i = 0; i < getParameters().size(); i++) {
+    //     juce::AudioProcessorParameter* parameter = getParameters()[i];
+    //     apvts.addParameterListener(parameter->getName(0), this);
+    // }
+
+    // Add aptvs listener for all parameters in instance 0 in order to update the other instances when they change
+    // for (int i = 0; i < dexedPluginInstances[0]->getParameters().size(); i++) {
+    //     juce::AudioProcessorParameter* parameter = dexedPluginInstances[0]->getParameters()[i];
+    //     apvts.addParameterListener(parameter->getName(0), this);
+    // }
+  
+}
+
+void PluginAudioProcessor::releaseResources()
+{
+    prepareWhenLoaded = false;
+    isPrepared = false;
+    renderPool.stop();
+    outOfProcessHost.release();
+
+    // Apply what is still queued, processBlock won't do it any more
+    applyPendingControlCommands();
+
+    // Nor will it finish a faded program change
+    if (pendingProgramChanges != nullptr) {
+        switchProgram(pendingProgramChanges);
+        pendingProgramChanges = nullptr;
+    }
+    programIsFadingOut = false;
+    programIsFadingIn = false;
+
+#if MULTIDEXED_COUNT_AUDIO_THREAD_ALLOCATIONS
+    RealtimeLog::write(RealtimeLog::Level::debug, "Allocations on the audio thread so far: {}",
+                       static_cast<double>(AudioThreadAllocationCounter::getCount()));
+#endif
+
+    // Release the plugins
+    const juce::ScopedLock lock(instanceLock);
+    for (int i = 0; i < maximumNumberOfInstances; i++) {
+        if (dexedPluginInstances[i] != nullptr) {
+            dexedPluginInstances[i]->releaseResources();
+        }
+    }
+    for (auto &layer : layers) {
+        for (int v = 0; v < UnisonLayer::maximumNumberOfVoices; v++) {
+            if (auto *voice = layer.getVoice(v)) {
+                voice->releaseResources();
+            }
+        }
+    }
+}
+
+void PluginAudioProcessor::prepareLayerVoices()
+{
+    // Voices still fading out are prepared as well, like the main instances
+    for (auto &layer : layers) {
+        for (int v = 0; v < UnisonLayer::maximumNumberOfVoices; v++) {
+            if (auto *voice = layer.getVoice(v)) {
+                prepareInstance(*voice, preparedSampleRate, preparedBlockSize);
+            }
+        }
+    }
+}
+
+void PluginAudioProcessor::endLoadingMidiNotes()
+{
+    loadingMidi.clear();
+    for (int channel = 1; channel <= 16; channel++) {
+        loadingMidi.addEvent(juce::MidiMessage::allNotesOff(channel), 0);
+    }
+    numberOfLoadingMidiEvents = 16;
+}
+
+void PluginAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer,
+                                        juce::MidiBuffer &midiMessages)
+{
+    // Count allocations made on this thread while processing the block (debug builds only)
+    AudioThreadAllocationCounter::ScopedAudioThread audioThread;
+    MULTIDEXED_TRACE_SCOPE("processBlock");
+    const juce::int64 start = juce::Time::getHighResolutionTicks();
+
+    // Silence until the instances are loaded; the MIDI is kept for when they are
+    if (!instancesAreReady.load(std::memory_order_acquire)) {
+        for (const auto metadata : midiMessages) {
+            if (metadata.numBytes > 3) {
+                continue;
+            }
+
+            // More than can be kept: what was played so far is dropped, but its notes are ended
+            if (numberOfLoadingMidiEvents == maximumNumberOfLoadingMidiEvents) {
+                endLoadingMidiNotes();
+            }
+            loadingMidi.addEvent(metadata.data, metadata.numBytes, 0);
+            numberOfLoadingMidiEvents++;
+        }
+        buffer.clear();
+        return;
+    }
+
+    // The MIDI received while loading goes first, swapped in so that nothing is allocated
+    if (numberOfLoadingMidiEvents > 0) {
+        // The buffer must not grow on this thread: if the block does not fit, only the notes are ended
+        const int bytesToAppend = (int) midiMessages.data.size();
+        if ((int) loadingMidi.data.size() + bytesToAppend > loadingMidiCapacity) {
+            endLoadingMidiNotes();
+        }
+        if ((int) loadingMidi.data.size() + bytesToAppend <= loadingMidiCapacity) {
+            loadingMidi.addEvents(midiMessages, 0, buffer.getNumSamples(), 0);
+            midiMessages.swapWith(loadingMidi);
+        }
+        loadingMidi.clear();
+        numberOfLoadingMidiEvents = 0;
+    }
 
-    juce::VST3PluginFormat *vst3 = new juce::VST3PluginFormat();
-    pluginFormatManager.addFormat(vst3);
+    // Apply the detune, program and state changes posted since the last block
+    applyControlCommands();
+
+    if (ecoFactor > 1) {
+        renderEcoBlock(buffer, midiMessages);
+    } else {
+        renderBlock(buffer, midiMessages);
+    }
 
-    juce::String pluginPath;
+    // Fade in the new program, or fade out the old one for the program change that is waiting
+    if (programIsFadingIn) {
+        buffer.applyGainRamp(0, buffer.getNumSamples(), 0.0f, 1.0f);
+        programIsFadingIn = false;
+    } else if (programIsFadingOut) {
+        // Still waiting for a state load to finish before the program can be switched
+        buffer.clear();
+    } else if (pendingProgramChanges != nullptr) {
+        buffer.applyGainRamp(0, buffer.getNumSamples(), 1.0f, 0.0f);
+        programIsFadingOut = true;
+    }
 
-    // Check which operating system we are running on
-    // and set the plugin path accordingly
+    // Whatever the governor changes takes effect in the next block
+    const double processSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+    updateGovernor(processSeconds, buffer.getNumSamples());
 
-    // Linux
-    if (juce::SystemStats::getOperatingSystemType() & juce::SystemStats::OperatingSystemType::Linux) {
-        pluginPath = "/usr/lib/vst3/Dexed.vst3";
+    // Offline renders have no deadline to count against
+    if (!isNonRealtime()) {
+        performanceMonitor.recordBlock(processSeconds, buffer.getNumSamples() / hostSampleRate);
     }
+}
+
+void PluginAudioProcessor::renderEcoBlock(juce::AudioBuffer<float> &buffer, juce::MidiBuffer &midiMessages)
+{
+    const int numSamples = buffer.getNumSamples();
 
-    // Windows
-    if (juce::SystemStats::getOperatingSystemType() & juce::SystemStats::OperatingSystemType::Windows) {
-        pluginPath = "C:\\Program Files\\Common Files\\VST3\\Dexed.vst3\\Contents\\x86_64-win\\Dexed.vst3";
+    // Upsampled samples left over from the previous block come first
+    const int fromLeftover = juce::jmin(ecoLeftover, numSamples);
+    for (int channel = 0; channel < 2; channel++) {
+        buffer.copyFrom(channel, 0, ecoOutputBuffer, channel, ecoLeftoverStart, fromLeftover);
     }
+    ecoLeftoverStart += fromLeftover;
+    ecoLeftover -= fromLeftover;
 
-    // MacOS
-    if (juce::SystemStats::getOperatingSystemType() & juce::SystemStats::OperatingSystemType::MacOSX) {
-        pluginPath = "/Library/Audio/Plug-Ins/VST3/Dexed.vst3";
+    // Every event goes to the instance sample it falls into; those within the leftover go to the first one
+    for (const auto metadata : midiMessages) {
+        const int position = juce::jmax(0, metadata.samplePosition - fromLeftover) / ecoFactor;
+        ecoMidi.addEvent(metadata.data, metadata.numBytes, position);
     }
 
-    // FreeBSD
-    if (juce::SystemStats::getOperatingSystemType() == juce::SystemStats::OperatingSystemType::UnknownOS) {
-        pluginPath = "/usr/local/lib/vst3/Dexed.vst3";
+    const int needed = numSamples - fromLeftover;
+    const int internalSamples = (needed + ecoFactor - 1) / ecoFactor;
+    if (internalSamples == 0) {
+        return;
     }
 
-    // Print the plugin path or error if not found
-    if (pluginPath.isEmpty()) {
-        std::cout << "Error: Plugin not found" << std::endl;
+    ecoMixBuffer.setSize(2, internalSamples, false, false, true);
+    renderBlock(ecoMixBuffer, ecoMidi);
+    ecoMidi.clear();
 
-    } else {
-        std::cout << "Plugin Path: " << pluginPath.toStdString() << std::endl;
+    {
+        MULTIDEXED_TRACE_SCOPE("upsample");
+        const float *input[2] = { ecoMixBuffer.getReadPointer(0), ecoMixBuffer.getReadPointer(1) };
+        float *output[2] = { ecoOutputBuffer.getWritePointer(0), ecoOutputBuffer.getWritePointer(1) };
+        ecoUpsampler.process(input, output, internalSamples);
     }
-    
-    pluginList.scanAndAddFile(pluginPath, true, pluginDescriptions,
-                              *pluginFormatManager.getFormat(0));
 
-    // If no plugin was found, print an error
-    if (pluginDescriptions.size() == 0) {
-        std::cout << "Error: Dexed plugin not found" << std::endl;
-        return;
+    for (int channel = 0; channel < 2; channel++) {
+        buffer.copyFrom(channel, fromLeftover, ecoOutputBuffer, channel, 0, needed);
     }
+    ecoLeftoverStart = needed;
+    ecoLeftover = internalSamples * ecoFactor - needed;
 
-    juce::String msg("Error Loading Plugin: ");
+    for (int channel = 2; channel < buffer.getNumChannels(); channel++) {
+        buffer.clear(channel, 0, numSamples);
+    }
+}
 
-    // Create a AudioPluginInstances from the pluginDescriptions
-    // and put them in the dexedPluginInstances array
-    for (int i = 0; i < numberOfInstances; i++) {
-        dexedPluginInstances[i] = pluginFormatManager.createPluginInstance(
-                *pluginDescriptions[0], getSampleRate(), getBlockSize(), msg);
+void PluginAudioProcessor::renderBlock(juce::AudioBuffer<float> &buffer, juce::MidiBuffer &midiMessages)
+{
+    // Helper processes get until here to deliver their part of the block
+    const double helperDeadline = juce::Time::getMillisecondCounterHiRes() + 750.0 * buffer.getNumSamples() / preparedSampleRate;
+
+    // Includes the instances that are still fading out
+    const int rendered = renderedInstances.load(std::memory_order_relaxed);
+
+    // Instances whose state is being loaded are left alone and stay silent; loads always include the followers
+    const bool isLoading = stateReplicator.isLoading();
+    const int renderEnd = isLoading ? stateReplicator.getFirstLoadingInstance() : rendered;
+
+    // Apply the parameter changes made in instance 0 since the last block to the other instances;
+    // during a load they are held back, and finishStateLoad() catches up on them, and while a faded
+    // program change waits they are held back until switchProgram() has run
+    int numberOfLeaderChanges = 0;
+    if (!isLoading && pendingProgramChanges == nullptr) {
+        MULTIDEXED_TRACE_SCOPE("parameterSync");
+        numberOfLeaderChanges = parameterSync.flush(leaderChanges, SharedRenderChannel::maximumNumberOfParameterChanges);
     }
 
-    // Check that the AudioPluginInstances were created, if not print an error
-    for (int i = 0; i < numberOfInstances; i++) {
-        if (dexedPluginInstances[i] == nullptr) {
-            std::cout << msg.toStdString() << std::endl;
-            return;
+    // Work out which instances are audible; instance 0 is never mixed
+    uint64_t unmutedInstances = parameterSync.getUnmutedInstances();
+
+    // With the built-in FM engine the followers are only kept for their editors and not rendered
+    const bool useFmEngine = fmEngineParameter->load() > 0.5f;
+    if (useFmEngine != fmEngineWasUsed) {
+        if (useFmEngine) {
+            // The followers stop where they are, so silence them for when they are used again
+            followersNeedAllNotesOff = true;
+        } else {
+            fmEngine.reset();
         }
-    }
+        fmEngineWasUsed = useFmEngine;
 
-    for (int i = 0; i < numberOfInstances; i++) {
-        // jassert the existence of the AudioPluginInstance
-        jassert(dexedPluginInstances[i] != nullptr);
+        // The mixer only plays the layers while the FM engine plays the main group
+        mixGainsAreStale = true;
     }
 
-    // Print the plugin name and vendor for each plugin instance
-    for (int i = 0; i < numberOfInstances; i++) {
-        std::cout << "Plugin Name: " << dexedPluginInstances[i]->getName().toStdString() << std::endl;
+    // Voices shed by the governor are not rendered once they have faded out; their buffers stay cleared
+    sleepingInstances = 0;
+    for (int i = 1; i < rendered && shedInstances != 0; i++) {
+        if ((shedInstances & (uint64_t(1) << i)) && instanceFadeGains[i] == 0.0f && instanceFadeSteps[i] == 0.0f) {
+            sleepingInstances |= uint64_t(1) << i;
+        }
     }
-}
 
-PluginAudioProcessor::~PluginAudioProcessor()
-{
-    // Release the plugins
-    for (int i = 0; i < numberOfInstances; i++) {
-        if (dexedPluginInstances[i] != nullptr) {
-            dexedPluginInstances[i]->releaseResources();
+    // Followers that have gone quiet sleep until the next MIDI event, which wakes them at the start of the
+    // block; they were silent, so they start again without a click
+    idleDetector.processMidi(midiMessages, buffer.getNumSamples());
+    idleInstances = 0;
+    if (midiMessages.isEmpty() && !followersNeedAllNotesOff && !useFmEngine) {
+        for (int i = 1; i < renderEnd; i++) {
+            if (idleDetector.isIdle(i)) {
+                idleInstances |= uint64_t(1) << i;
+            }
         }
     }
-}
 
-void PluginAudioProcessor::detune()
-{
+    // The main group only plays the notes within its range; the layers filter for themselves
+    const bool filterMainNotes = !noteRange.coversEverything();
+    if (filterMainNotes) {
+        noteRange.filter(midiMessages, noteRangeMidi, buffer.getNumSamples());
+    }
+    const juce::MidiBuffer &mainMidi = filterMainNotes ? noteRangeMidi : midiMessages;
+
+    // The voices of the layers are rendered in the slots after the main instances, and sleep like the followers
+    int numberOfLayerJobs = 0;
+    numberOfSlotsInUse = rendered;
+    for (int layer = 0; layer < maximumNumberOfLayers - 1; layer++) {
+        UnisonLayer &unisonLayer = layers[static_cast<size_t>(layer)];
+        const int voices = unisonLayer.renderedVoices.load(std::memory_order_relaxed);
+        if (voices == 0) {
+            continue;
+        }
 
-    // Return if any of the plugin instances are null
-    for (int i = 0; i < numberOfInstances; i++) {
-        if (dexedPluginInstances[i] == nullptr) {
-            return;
+        unisonLayer.updateDetune(false);
+        unisonLayer.prepareBlock(midiMessages, buffer.getNumSamples());
+        for (int v = 0; v < voices; v++) {
+            const int slot = getLayerSlot(layer, v);
+            if (midiMessages.isEmpty() && idleDetector.isIdle(slot)) {
+                idleInstances |= uint64_t(1) << slot;
+            } else {
+                layerJobSlots[numberOfLayerJobs++] = slot;
+            }
         }
+        numberOfSlotsInUse = getLayerSlot(layer, voices - 1) + 1;
     }
 
-    // Detune the plugin instances in the range determined by the detuneSpread parameter
-    float range = apvts.getRawParameterValue("detuneSpread")->load();
-    std::cout << "Using Detune Spread: " << range << std::endl;
-    for (int i = 1; i < numberOfInstances; i++) {
-        double detune = 0.5 - range/2.0 + i * range/numberOfInstances;
-        std::cout << "Setting instance " << i << " to detune " << detune << std::endl;
-        dexedPluginInstances[i]->getParameters()[3]->setValueNotifyingHost(detune);
+    // Resize the preallocated buffer of each plugin instance and layer voice, and clear only those
+    // that are rendered; the slots in between have no gain in the mixer
+    dexedPluginBuffers.prepareBlock(numberOfSlotsInUse, buffer.getNumChannels(), buffer.getNumSamples());
+    dexedPluginBuffers.clear(0, rendered);
+    for (int layer = 0; layer < maximumNumberOfLayers - 1; layer++) {
+        const int voices = layers[static_cast<size_t>(layer)].renderedVoices.load(std::memory_order_relaxed);
+        if (voices > 0) {
+            dexedPluginBuffers.clear(getLayerSlot(layer, 0), voices);
+        }
     }
 
-}
+    for (int i = 1; i < rendered && !useFmEngine; i++) {
+        // Every instance gets the same MIDI, but in a buffer of its own
+        dexedPluginMidiBuffers[i].clear();
+        dexedPluginMidiBuffers[i].addEvents(mainMidi, 0, buffer.getNumSamples(), 0);
+    }
 
-void PluginAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
-{
-    // Return if any of the plugin instances are null
-    for (int i = 0; i < numberOfInstances; i++) {
-        if (dexedPluginInstances[i] == nullptr) {
-            return;
+    // The followers missed the note-offs sent while they were being loaded
+    const bool sendAllNotesOff = followersNeedAllNotesOff && !isLoading && !useFmEngine;
+    if (sendAllNotesOff) {
+        for (int i = 1; i < rendered; i++) {
+            for (int channel = 1; channel <= 16; channel++) {
+                dexedPluginMidiBuffers[i].addEvent(juce::MidiMessage::allNotesOff(channel), 0);
+            }
         }
+        followersNeedAllNotesOff = false;
     }
 
-    int maximumExpectedSamplesPerBlock = samplesPerBlock;
+    // Hand the followers that helper processes have copies of to them; they render while we render the rest
+    const bool useHelperProcesses = !useFmEngine && !isLoading;
+    remoteInstances = 0;
+    if (useHelperProcesses) {
+        const uint64_t instancesInUse = ((uint64_t(1) << renderEnd) - 1) & ~uint64_t(1) & ~(sleepingInstances | idleInstances);
+        remoteInstances = outOfProcessHost.startBlock(mainMidi, buffer.getNumSamples(), sendAllNotesOff,
+                                                      leaderChanges, numberOfLeaderChanges, instancesInUse);
+    }
 
-    
-    for (int i = 0; i < numberOfInstances; i++) {
-        
-        if (dexedPluginInstances[i] == nullptr) {
-            return;
+    // Followers rendered here again have missed what was played while a helper rendered them or while they slept
+    const uint64_t returningInstances = (previousRemoteInstances & ~remoteInstances) | (previousSleepingInstances & ~sleepingInstances);
+    for (int i = 1; i < rendered && returningInstances != 0 && !useFmEngine; i++) {
+        if (returningInstances & (uint64_t(1) << i)) {
+            for (int channel = 1; channel <= 16; channel++) {
+                dexedPluginMidiBuffers[i].addEvent(juce::MidiMessage::allNotesOff(channel), 0);
+            }
         }
+    }
+    previousRemoteInstances = remoteInstances;
+    previousSleepingInstances = sleepingInstances;
+
+    // Instance 0 is never mixed, it only exists for its GUI, so don't spend a whole render on it
+    firstInstanceToRender = prepareMasterInstance(mainMidi, buffer.getNumSamples()) ? 0 : 1;
+
+    // Process the audio through each plugin instance, in parallel if enabled
+    // and the block is long enough for the handoff to the workers to pay off
+    int numberOfWorkersToUse = 0;
+    if (parallelRenderingParameter->load() > 0.5f && buffer.getNumSamples() >= minimumParallelBlockSize) {
+        // The audio thread renders too, so it counts as one of the render threads
+        numberOfWorkersToUse = static_cast<int>(renderThreadsParameter->load()) - 1;
+    }
+    currentBlockSeconds = buffer.getNumSamples() / preparedSampleRate;
+    numberOfMainJobs = useFmEngine ? 1 - firstInstanceToRender : juce::jmax(0, renderEnd - firstInstanceToRender);
+    const int numberOfJobs = numberOfMainJobs + numberOfLayerJobs;
+    {
+        MULTIDEXED_TRACE_SCOPE("renderInstances");
+        renderPool.run(*this, numberOfJobs, numberOfWorkersToUse);
+    }
 
-        dexedPluginInstances[i]->releaseResources();
-        dexedPluginInstances[i]->setRateAndBufferSizeDetails(sampleRate, maximumExpectedSamplesPerBlock);
+    // Collect what the helpers rendered; instances they were too late for stay silent
+    uint64_t deliveredInstances = 0;
+    if (useHelperProcesses) {
+        MULTIDEXED_TRACE_SCOPE("waitForHelpers");
+        deliveredInstances = outOfProcessHost.finishBlock(dexedPluginBuffers, buffer.getNumSamples(), helperDeadline);
+        for (int i = 1; i < rendered && deliveredInstances != 0; i++) {
+            if (deliveredInstances & (uint64_t(1) << i)) {
+                applyInstanceFade(i);
+            }
+        }
+    }
 
-        // sync number of buses
+    // Meter every follower that was rendered, which also tells when it has gone quiet
+    {
+        MULTIDEXED_TRACE_SCOPE("metering");
+        const uint64_t notRendered = useFmEngine ? ~uint64_t(0) : sleepingInstances | idleInstances | (remoteInstances & ~deliveredInstances);
+        for (int i = 1; i < renderEnd; i++) {
+            if (notRendered & (uint64_t(1) << i)) {
+                levelMeters.recordSilence(i, currentBlockSeconds);
+            } else {
+                const float peak = levelMeters.measureBlock(i, dexedPluginBuffers[i], buffer.getNumSamples(), currentBlockSeconds);
+                idleDetector.recordBlock(i, peak, currentBlockSeconds, instanceTailSeconds);
+            }
+        }
+        for (int layer = 0; layer < maximumNumberOfLayers - 1; layer++) {
+            const int voices = layers[static_cast<size_t>(layer)].renderedVoices.load(std::memory_order_relaxed);
+            for (int v = 0; v < voices; v++) {
+                const int slot = getLayerSlot(layer, v);
+                if (idleInstances & (uint64_t(1) << slot)) {
+                    levelMeters.recordSilence(slot, currentBlockSeconds);
+                } else {
+                    const float peak = levelMeters.measureBlock(slot, dexedPluginBuffers[slot], buffer.getNumSamples(), currentBlockSeconds);
+                    idleDetector.recordBlock(slot, peak, currentBlockSeconds, instanceTailSeconds);
+                }
+            }
+        }
+        levelMeters.publish(numberOfSlotsInUse);
+    }
 
-        // TODO: Do we need nuberIfInstances instead of the hardcoded 2?
-        for (int dir = 0; dir < 2; ++dir) {
-            const bool isInput = (dir == 0);
-            int expectedNumBuses = getBusCount(isInput);
-            int requiredNumBuses1 = dexedPluginInstances[i]->getBusCount(isInput);
+    // The fades were applied by renderJob(), or are applied by the FM engine from where they are now;
+    // move them on to where they are at the end of the block
+    if (useFmEngine) {
+        fmEngine.setLaneFades(instanceFadeGains + 1, instanceFadeSteps + 1, rendered - 1);
+    }
+    const float samples = static_cast<float>(buffer.getNumSamples());
+    for (int i = 1; i < rendered; i++) {
+        if (instanceFadeSteps[i] != 0.0f) {
+            instanceFadeGains[i] = juce::jlimit(0.0f, 1.0f, instanceFadeGains[i] + instanceFadeSteps[i] * samples);
+            if (instanceFadeGains[i] == 0.0f || instanceFadeGains[i] == 1.0f) {
+                instanceFadeSteps[i] = 0.0f;
+
+                // A shed voice that has faded out is no longer mixed
+                if (shedInstances & (uint64_t(1) << i)) {
+                    mixGainsAreStale = true;
+                }
+            }
+        }
+    }
 
-            for (; expectedNumBuses < requiredNumBuses1; expectedNumBuses++)
-                dexedPluginInstances[i]->addBus(isInput);
+    // Stop rendering the instances that have faded out; the message thread tears them down
+    int stillRendered = rendered;
+    while (stillRendered > activeInstances && instanceFadeGains[stillRendered - 1] == 0.0f) {
+        stillRendered--;
+    }
+    if (stillRendered != rendered) {
+        renderedInstances.store(stillRendered, std::memory_order_relaxed);
+        parameterSync.setNumberOfInstancesInUse(stillRendered);
+        mixGainsAreStale = true;
+    }
 
-            for (; requiredNumBuses1 < expectedNumBuses; requiredNumBuses1++)
-                dexedPluginInstances[i]->removeBus(isInput);
+    // The same for the layer voices, whose gains also change with the pan spread and mute state of their layer
+    for (int layer = 0; layer < maximumNumberOfLayers - 1; layer++) {
+        UnisonLayer &unisonLayer = layers[static_cast<size_t>(layer)];
+        const int voices = unisonLayer.renderedVoices.load(std::memory_order_relaxed);
+        if (voices == 0) {
+            continue;
+        }
 
+        for (int v = 0; v < voices; v++) {
+            const int slot = getLayerSlot(layer, v);
+            if (instanceFadeSteps[slot] != 0.0f) {
+                instanceFadeGains[slot] = juce::jlimit(0.0f, 1.0f, instanceFadeGains[slot] + instanceFadeSteps[slot] * samples);
+                if (instanceFadeGains[slot] == 0.0f || instanceFadeGains[slot] == 1.0f) {
+                    instanceFadeSteps[slot] = 0.0f;
+                }
+            }
         }
 
-        dexedPluginInstances[i]->setBusesLayout(getBusesLayout());
-        dexedPluginInstances[i]->prepareToPlay(sampleRate, maximumExpectedSamplesPerBlock);
+        int stillRenderedVoices = voices;
+        while (stillRenderedVoices > unisonLayer.activeVoices && instanceFadeGains[getLayerSlot(layer, stillRenderedVoices - 1)] == 0.0f) {
+            stillRenderedVoices--;
+        }
+        if (stillRenderedVoices != voices) {
+            unisonLayer.setRenderedVoices(stillRenderedVoices);
+            mixGainsAreStale = true;
+        } else if (unisonLayer.getPanSpread() != unisonLayer.gainsPanSpread || unisonLayer.getUnmutedVoices() != unisonLayer.gainsUnmutedVoices) {
+            mixGainsAreStale = true;
+        }
+    }
 
-        // Set the program for each plugin instance
-        dexedPluginInstances[i]->setCurrentProgram(5);        
+    // TODO: If we don't want artifacts when panSpread is automated,
+    // we need to make sure that the panSpread value gets smoothed between its old and new value?
+    float panAmountFactor = apvts.getRawParameterValue("panSpread")->load();
 
+    // The gains only change with panSpread and the mute state, so only recompute them then
+    if (panAmountFactor != mixGainsPanSpread || unmutedInstances != mixGainsUnmutedInstances || mixGainsAreStale) {
+        updateMixGains(panAmountFactor, unmutedInstances);
     }
 
-    // Get the plugin state from the first plugin instance
-    // and apply it to all plugin instances
-    juce::MemoryBlock state;
-    dexedPluginInstances[0]->getStateInformation(state);
-    for (int i = 1; i < numberOfInstances; i++) {
-        dexedPluginInstances[i]->setStateInformation(state.getData(), static_cast<size_t>(state.getSize()));
+    // Combine the sound of all the plugin instances, or have the FM engine play all of them at once
+    const juce::int64 mixdownStart = juce::Time::getHighResolutionTicks();
+    if (useFmEngine) {
+        MULTIDEXED_TRACE_SCOPE("fmEngine");
+        fmEngine.render(mainMidi, buffer);
+
+        // The mixer only has gains for the layers then, which are added on top
+        if (numberOfSlotsInUse > firstLayerSlot) {
+            layerMixBuffer.setSize(2, buffer.getNumSamples(), false, false, true);
+            mixer.mix(dexedPluginBuffers.data(), layerMixBuffer);
+            for (int channel = 0; channel < 2; channel++) {
+                buffer.addFrom(channel, 0, layerMixBuffer, channel, 0, buffer.getNumSamples());
+            }
+        }
+    } else {
+        MULTIDEXED_TRACE_SCOPE("mixdown");
+        mixer.mix(dexedPluginBuffers.data(), buffer);
     }
+    performanceMonitor.recordMixdown(juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - mixdownStart),
+                                     currentBlockSeconds);
+}
 
-    // Configure the plugin instances to our liking
-
-    detune();
-    
-    for (int i = 0; i < dexedPluginInstances[0]->getParameters().size(); i++) {
-        // Print the names of the parameters and their values
-        // if (!dexedPluginInstances[0]->getParameterName(i).contains("MIDI CC")) {
-        //     std::cout << "Parameter " << i << ": " << dexedPluginInstances[0]->getParameterName(i).toStdString() << " = " << dexedPluginInstances[0]->getParameter(i) << std::endl;
-        // }
-        // Add listener to each parameter
-        juce::AudioProcessorParameter* parameter = dexedPluginInstances[0]->getParameters()[i];
-        
-        parameter->addListener(this);   
+void PluginAudioProcessor::updateMixGains(float panAmountFactor, uint64_t unmutedInstances)
+{
+    // Instances fading out, including the voices the governor sheds, no longer count,
+    // so that the level does not jump once they are gone
+    int numberOfUnmutedInstances = 0;
+    for (int i = 1; i < activeInstances; i++) {
+        if ((unmutedInstances & ~shedInstances) & (uint64_t(1) << i)) {
+            numberOfUnmutedInstances++;
+        }
     }
 
-    // Add apvts listener for detuneSpread in order to call detune() when it changes
-    apvts.addParameterListener("detuneSpread", this);
+    float leftGains[UnisonMixer::maximumNumberOfSources] = {};
+    float rightGains[UnisonMixer::maximumNumberOfSources] = {};
 
-    // Add apvts listener for panSpread in order to print a message when it changes
-    apvts.addParameterListener("panSpread", this);
+    // Instance 0 is not mixed, and muted instances are skipped by the mixer
+    const int rendered = renderedInstances.load(std::memory_order_relaxed);
+    for (int i = 1; i < rendered && numberOfUnmutedInstances > 0; i++) {
+        if (!(unmutedInstances & (uint64_t(1) << i))) {
+            continue;
+        }
 
-    // Add apvts listener for all parameters to update the other instances when they change
-    // for (int i = 0; i < getParameters().size(); i++) {
-    //     juce::AudioProcessorParameter* parameter = getParameters()[i];
-    //     apvts.addParameterListener(parameter->getName(0), this);
-    // }
+        // Shed voices that have faded out are not mixed
+        if ((shedInstances & (uint64_t(1) << i)) && instanceFadeGains[i] == 0.0f && instanceFadeSteps[i] == 0.0f) {
+            continue;
+        }
 
-    // Add aptvs listener for all parameters in instance 0 in order to update the other instances when they change
-    // for (int i = 0; i < dexedPluginInstances[0]->getParameters().size(); i++) {
-    //     juce::AudioProcessorParameter* parameter = dexedPluginInstances[0]->getParameters()[i];
-    //     apvts.addParameterListener(parameter->getName(0), this);
-    // }
-  
-}
+        // Set by changeNumberOfInstances()
+        double pan = instancePans[i];
 
-void PluginAudioProcessor::releaseResources()
-{
-    // Release the plugins
-    for (int i = 0; i < numberOfInstances; i++) {
-        if (dexedPluginInstances[i] != nullptr) {
-            dexedPluginInstances[i]->releaseResources();
+        // Don't apply panning fully, only apply it by panSpread %
+
+        // Normalization factor, taking into account the number of unmuted instances and the pan amount factor
+        double normalizationFactor = 1.0 / (numberOfUnmutedInstances * (1.0 - panAmountFactor * pan) + numberOfUnmutedInstances * (panAmountFactor * pan + (1.0 - panAmountFactor)));
+
+        leftGains[i] = static_cast<float>((1.0 - panAmountFactor * pan) * normalizationFactor);
+        rightGains[i] = static_cast<float>((panAmountFactor * pan + (1.0 - panAmountFactor)) * normalizationFactor);
+    }
+
+    // Lane i of the FM engine plays what instance i + 1 would, and then the mixer does not; lanes of
+    // instances that are fading out keep playing until they are silent
+    fmEngine.setLanes(rendered - 1, fmLaneTunings, leftGains + 1, rightGains + 1);
+    if (fmEngineWasUsed) {
+        juce::FloatVectorOperations::clear(leftGains, rendered);
+        juce::FloatVectorOperations::clear(rightGains, rendered);
+    }
+
+    // The voices of every layer are balanced among themselves the same way; voice 0 is mixed too
+    for (int layer = 0; layer < maximumNumberOfLayers - 1; layer++) {
+        UnisonLayer &unisonLayer = layers[static_cast<size_t>(layer)];
+        const int voices = unisonLayer.renderedVoices.load(std::memory_order_relaxed);
+        if (voices == 0) {
+            continue;
+        }
+
+        const float layerPanSpread = unisonLayer.getPanSpread();
+        const uint64_t unmutedVoices = unisonLayer.getUnmutedVoices();
+        const int numberOfUnmutedVoices = juce::countNumberOfBits(unmutedVoices & ((uint64_t(1) << unisonLayer.activeVoices) - 1));
+
+        for (int v = 0; v < voices && numberOfUnmutedVoices > 0; v++) {
+            if (unmutedVoices & (uint64_t(1) << v)) {
+                const double pan = unisonLayer.getPan(v);
+                const double normalizationFactor = 1.0 / (numberOfUnmutedVoices * (1.0 - layerPanSpread * pan) + numberOfUnmutedVoices * (layerPanSpread * pan + (1.0 - layerPanSpread)));
+                const int slot = getLayerSlot(layer, v);
+                leftGains[slot] = static_cast<float>((1.0 - layerPanSpread * pan) * normalizationFactor);
+                rightGains[slot] = static_cast<float>((layerPanSpread * pan + (1.0 - layerPanSpread)) * normalizationFactor);
+            }
         }
+
+        unisonLayer.gainsPanSpread = layerPanSpread;
+        unisonLayer.gainsUnmutedVoices = unmutedVoices;
     }
+
+    mixer.setGains(leftGains, rightGains, numberOfSlotsInUse);
+
+    mixGainsPanSpread = panAmountFactor;
+    mixGainsUnmutedInstances = unmutedInstances;
+    mixGainsAreStale = false;
 }
 
-void PluginAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer,
-                                        juce::MidiBuffer &midiMessages)
+void PluginAudioProcessor::renderJob(int jobIndex)
 {
-    int numberOfUnmutedInstances = 0;
-    for (int i = 1; i < numberOfInstances; i++) {
-        if (dexedPluginInstances[i]->getParameters()[2]->getValue()>0) {
-            numberOfUnmutedInstances++;
-        }
-    }
-    for (int i = 0; i < numberOfInstances; i++) {
-        // NOTE: Even though we don't use the sound of plugin instance 0, we still need to process it for the GUI to work
-        // Make empty initialized buffer for each plugin instance in dexedPluginBuffers
-        dexedPluginBuffers[i] = juce::AudioBuffer<float>(buffer.getNumChannels(), buffer.getNumSamples());
-        // Process the audio through each plugin instance
-        if (dexedPluginInstances[i]) {
-            dexedPluginInstances[i]->processBlock(dexedPluginBuffers[i], midiMessages);
+    // The render workers count as the audio thread while they render
+    AudioThreadAllocationCounter::ScopedAudioThread audioThread;
+
+    // The jobs of the layer voices come after those of the main group
+    if (jobIndex >= numberOfMainJobs) {
+        const int slot = layerJobSlots[jobIndex - numberOfMainJobs];
+        const int layer = (slot - firstLayerSlot) / UnisonLayer::maximumNumberOfVoices;
+        const int voice = (slot - firstLayerSlot) % UnisonLayer::maximumNumberOfVoices;
+        UnisonLayer &unisonLayer = layers[static_cast<size_t>(layer)];
+
+        if (auto *instance = unisonLayer.getVoice(voice)) {
+            MULTIDEXED_TRACE_SCOPE("renderLayerVoice", slot);
+            const juce::int64 start = juce::Time::getHighResolutionTicks();
+            instance->processBlock(dexedPluginBuffers[slot], unisonLayer.getMidiBuffer(voice));
+            performanceMonitor.recordRender(slot, juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start),
+                                            currentBlockSeconds);
+            applyInstanceFade(slot);
         }
+        return;
     }
 
-    // TODO: If we don't want artifacts when panSpread is automated,
-    // we need to make sure that the panSpread value gets smoothed between its old and new value?
-    float panAmountFactor = apvts.getRawParameterValue("panSpread")->load();
-    // std::cout << "Using Pan Spread: " << panAmountFactor << std::endl;
-    // Combine the sound of all the plugin instances
-    for (int channel = 0; channel < buffer.getNumChannels(); ++channel) {
-        for (int sample = 0; sample < buffer.getNumSamples(); ++sample) {
-            double sum = 0;
-            int i;
-            for (i = 1; i < numberOfInstances; i++) {
-                // if numberOfInstances is 9, pan for instance 1 is 0.0, for instance 2 is 0.14, for instance 3 is 0.28, for instance 4 is 0.42, for instance 5 is 0.57, for instance 6 is 0.71, for instance 7 is 0.85, for instance 8 is 1.0
-                // if numberOfInstances is 8, pan for instance 1 is 0.0, for instance 2 is 0.17, for instance 3 is 0.33, for instance 4 is 0.5, for instance 5 is 0.67, for instance 6 is 0.83, for instance 7 is 1.0
-                // if numberOfInstances is 7, pan for instance 1 is 0.0, for instance 2 is 0.2, for instance 3 is 0.4, for instance 4 is 0.6, for instance 5 is 0.8, for instance 6 is 1.0
-                // if numberOfInstances is 6, pan for instance 1 is 0.0, for instance 2 is 0.25, for instance 3 is 0.5, for instance 4 is 0.75, for instance 5 is 1.0
-                // if numberOfInstances is 5, pan for instance 1 is 0.0, for instance 2 is 0.33, for instance 3 is 0.66, for instance 4 is 1.0
-                // if numberOfInstances is 4, pan for instance 1 is 0.0, for instance 2 is 0.5, for instance 3 is 1.0
-                // if numberOfInstances is 3, pan for instance 1 is 0.0, for instance 2 is 1.0
-                // if numberOfInstances is 2, pan for instance 1 is 0.0
-                // if numberOfInstances is 1, pan for instance 1 is 0.0
-                // Considering the above, the pan for instance i is (i-1)/(numberOfInstances-1)
-                double pan = (i-1.0)/(numberOfInstances-1.0);
-                
-                // if (channel == 0) {
-                //     // Left channel
-                //     sum += dexedPluginBuffers[i].getSample(channel, sample) * (1.0 - pan);
-                // }
-                // else {
-                //     // Right channel
-                //     sum += dexedPluginBuffers[i].getSample(channel, sample) * pan;
-                // }
-
-                // Do the same but don't apply panning fully, only apply it by panSpread %
-
-
-
-                // if (channel == 0) {
-                //     // Left channel
-                //     sum += dexedPluginBuffers[i].getSample(channel, sample) * (1.0 - panAmountFactor * pan);
-                // }
-                // else {
-                //     // Right channel
-                //     sum += dexedPluginBuffers[i].getSample(channel, sample) * (panAmountFactor * pan + (1.0 - panAmountFactor));
-                // }
-
-                // Normalization factor, taking into account the number of unmuted instances and the pan amount factor
-                double normalizationFactor = 1.0 / (numberOfUnmutedInstances * (1.0 - panAmountFactor * pan) + numberOfUnmutedInstances * (panAmountFactor * pan + (1.0 - panAmountFactor)));
-
-                // Do the above but also apply normalization
-                if (channel == 0) {
-                    // Left channel
-                    sum += dexedPluginBuffers[i].getSample(channel, sample) * (1.0 - panAmountFactor * pan) * normalizationFactor;
-                }
-                else {
-                    // Right channel
-                    sum += dexedPluginBuffers[i].getSample(channel, sample) * (panAmountFactor * pan + (1.0 - panAmountFactor)) * normalizationFactor;
-                }
+    int i = firstInstanceToRender + jobIndex;
+
+    // Rendered by a helper process, shed by the governor or idle
+    if ((remoteInstances | sleepingInstances | idleInstances) & (uint64_t(1) << i)) {
+        return;
+    }
 
-                // FIXME: Stereo not centered when panSpread is > 0.0
-                // Something must be wrong because when one increases the spread, the stereo is no longer balanced
-                // Maybe something is not linear?
-                // What do we need to change so that the stereo is balanced when the spread is 0.0 and when the spread is 1.0
-                // and for all values in between?
+    if (dexedPluginInstances[i]) {
+        MULTIDEXED_TRACE_SCOPE("renderInstance", i);
+        const juce::int64 start = juce::Time::getHighResolutionTicks();
+        dexedPluginInstances[i]->processBlock(dexedPluginBuffers[i], dexedPluginMidiBuffers[i]);
+        performanceMonitor.recordRender(i, juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start),
+                                        currentBlockSeconds);
+        applyInstanceFade(i);
+    }
+}
 
-            }
+void PluginAudioProcessor::applyInstanceFade(int i)
+{
+    juce::AudioBuffer<float> &output = dexedPluginBuffers[i];
+    if (i > 0 && instanceFadeSteps[i] != 0.0f) {
+        const float endGain = juce::jlimit(0.0f, 1.0f, instanceFadeGains[i] + instanceFadeSteps[i] * output.getNumSamples());
+        output.applyGainRamp(0, output.getNumSamples(), instanceFadeGains[i], endGain);
+    }
+}
 
+bool PluginAudioProcessor::prepareMasterInstance(const juce::MidiBuffer &midiMessages, int numSamples)
+{
+    juce::MidiBuffer &masterMidi = dexedPluginMidiBuffers[0];
+    masterMidi.clear();
+
+    // While its editor is open, instance 0 gets the full MIDI stream so that its keyboard and meters work
+    if (masterEditorVisible.load(std::memory_order_relaxed)) {
+        masterMidi.addEvents(midiMessages, 0, numSamples, 0);
+        masterInstanceIsPlaying = true;
+        return true;
+    }
 
+    // Otherwise it only gets the messages that change its state, such as program changes,
+    // controllers and SysEx, but no notes, so that it stays in sync with the other instances
+    for (const auto metadata : midiMessages) {
+        if (metadata.samplePosition >= numSamples) {
+            break;
+        }
 
-            // buffer.setSample(channel, sample, sum / numberOfUnmutedstances);
-            buffer.setSample(channel, sample, sum);
+        // Classified by the status byte: getMessage() would allocate for SysEx on the audio thread
+        const int status = metadata.numBytes > 0 ? metadata.data[0] & 0xf0 : 0;
+        if (status != 0x80 && status != 0x90 && status != 0xa0) {
+            masterMidi.addEvent(metadata.data, metadata.numBytes, metadata.samplePosition);
+        }
+    }
 
+    // The editor was just closed; silence the notes that are still sounding in instance 0
+    if (masterInstanceIsPlaying) {
+        for (int channel = 1; channel <= 16; channel++) {
+            masterMidi.addEvent(juce::MidiMessage::allNotesOff(channel), 0);
         }
+        masterInstanceIsPlaying = false;
     }
+
+    return !masterMidi.isEmpty();
 }
 
 juce::AudioProcessorEditor *PluginAudioProcessor::createEditor()
@@ -328,26 +1653,122 @@ juce::AudioProcessorEditor *PluginAudioProcessor::createEditor()
 }
 
 void PluginAudioProcessor::getStateInformation(juce::MemoryBlock &destData) {
-    // Return state of instance 0
-    if (dexedPluginInstances[0] != nullptr) {
-        return dexedPluginInstances[0]->getStateInformation(destData);
+    // A state that was posted but not applied yet is what the host expects to get back
+    if (pendingHostStates.load() > 0) {
+        const juce::ScopedLock lock(latestPostedStateLock);
+        destData = latestPostedState;
+        return;
+    }
+
+    if (!instancesAreReady) {
+        return;
+    }
+
+    SessionState session;
+
+    juce::MemoryOutputStream parameters(session.parameters, false);
+    apvts.copyState().writeToStream(parameters);
+    parameters.flush();
+
+    // Keeps the instances from being torn down meanwhile
+    const juce::ScopedLock lock(instanceLock);
+
+    // The state of instance 0 stands for all instances...
+    stateReplicator.getLeaderState(session.dexedState);
+    session.numberOfInstances = numberOfInstances;
+
+    // ...plus whatever was changed in the editors of the others. While their state is
+    // being replaced they are about to become copies of instance 0 anyway.
+    if (controlCommands.getNumberOfPendingStates() == 0) {
+        for (int instance = 1; instance < numberOfInstances; instance++) {
+            for (int index = 0; index < parameterSync.getNumberOfParameters(); index++) {
+                // The detune of every instance follows from detuneSpread
+                if (index == ParameterSync::detuneParameterIndex) {
+                    continue;
+                }
+
+                auto *leaderParameter = parameterSync.getParameter(0, index);
+                auto *parameter = parameterSync.getParameter(instance, index);
+                if (leaderParameter != nullptr && parameter != nullptr && parameter->getValue() != leaderParameter->getValue()) {
+                    session.overrides.push_back({ instance, index, parameter->getValue() });
+                }
+            }
+        }
+    }
+
+    // The patch of every layer; its voices are all copies of voice 0
+    for (const auto &layer : layers) {
+        session.layerStates.push_back(layer.getState());
     }
-    // TODO: Should probably save the state of all instances individually;
-    // how do other plugin hosts save the state of multiple plugin instances?
+
+    session.writeTo(destData);
 }
 
 void PluginAudioProcessor::setStateInformation(const void *data, int sizeInBytes) { 
-    // Set state of all instances, but prevent infinite loop
-    if (dexedPluginInstances[0] != nullptr) {
-        shouldSynchronize = false;
-        for (int i = 0; i < numberOfInstances; i++) {
-            dexedPluginInstances[i]->setStateInformation(data, sizeInBytes);
+    {
+        // Applied by finishLoading(); until then it is what getStateInformation() returns
+        const juce::ScopedLock lock(latestPostedStateLock);
+        if (!instancesAreReady) {
+            latestPostedState.replaceAll(data, static_cast<size_t>(sizeInBytes));
+            if (!hostStateWaitsForInstances) {
+                hostStateWaitsForInstances = true;
+                pendingHostStates++;
+            }
+            return;
+        }
+    }
+
+    if (dexedPluginInstances[0] == nullptr) {
+        return;
+    }
+
+    SessionState session;
+    if (SessionState::isSessionState(data, sizeInBytes)) {
+        if (!session.readFrom(data, sizeInBytes)) {
+            // Damaged, or saved by a newer version
+            jassertfalse;
+            return;
+        }
+
+        juce::ValueTree parameters = juce::ValueTree::readFromData(session.parameters.getData(), session.parameters.getSize());
+        if (parameters.isValid()) {
+            apvts.replaceState(parameters);
+
+            // The session may ask for a different number of unison voices
+            if (juce::MessageManager::getInstance()->isThisTheMessageThread()) {
+                updateNumberOfInstances();
+            }
+        }
+    } else {
+        // Older versions saved nothing but the state of instance 0
+        session.dexedState.append(data, static_cast<size_t>(sizeInBytes));
+    }
+
+    // Sessions without layers leave their patches alone; the layers are off in them anyway
+    {
+        const juce::ScopedLock lock(instanceLock);
+        for (size_t layer = 0; layer < session.layerStates.size() && layer < layers.size(); layer++) {
+            layers[layer].setState(session.layerStates[layer]);
         }
-        detune();
-        shouldSynchronize = true;
     }
-    // TODO: Should probably load the state of all instances from the saved state individually;
-    // how do other plugin hosts save the state of multiple plugin instances?
+
+    {
+        const juce::ScopedLock lock(latestPostedStateLock);
+        latestPostedState.replaceAll(data, static_cast<size_t>(sizeInBytes));
+    }
+    pendingHostStates++;
+
+    // Set state of all instances; the copy is made here so that the audio thread only swaps in a pointer.
+    // Hosts like to push the same state again, e.g. on undo; that does not need a load.
+    auto state = std::make_unique<juce::MemoryBlock>(std::move(session.dexedState));
+    if (controlCommands.getNumberOfPendingStates() > 0 || stateReplicator.wouldChange(*state, 0)) {
+        postControlCommand(ControlCommandQueue::Type::applyState, std::move(state));
+    }
+
+    // The overrides go in once the state is loaded, and mark the end of the host state
+    auto overrides = std::make_unique<juce::MemoryBlock>(session.overrides.data(),
+                                                         session.overrides.size() * sizeof(SessionState::Override));
+    postControlCommand(ControlCommandQueue::Type::applyOverrides, std::move(overrides));
 }
 
 //==============================================================================
@@ -391,22 +1812,36 @@ bool PluginAudioProcessor::isMidiEffect() const
 
 double PluginAudioProcessor::getTailLengthSeconds() const
 {
+    if (!instancesAreReady) {
+        return 0.0;
+    }
     return dexedPluginInstances[0]->getTailLengthSeconds();
 }
 
 int PluginAudioProcessor::getNumPrograms()
 {
+    // Hosts expect at least one program, even while the instances are loading
+    if (!instancesAreReady) {
+        return 1;
+    }
     return dexedPluginInstances[0]->getNumPrograms();
 }
 
 int PluginAudioProcessor::getCurrentProgram()
 {
+    if (!instancesAreReady) {
+        return 0;
+    }
     return dexedPluginInstances[0]->getCurrentProgram();
 }
 
 // setCurrentProgram() is called when the user changes the program in the host
 void PluginAudioProcessor::setCurrentProgram(int index)
 {
+    if (!instancesAreReady) {
+        return;
+    }
+
     // Return if any of the plugin instances are null
     for (int i = 0; i < numberOfInstances; i++) {
         if (dexedPluginInstances[i] == nullptr) {
@@ -414,12 +1849,45 @@ void PluginAudioProcessor::setCurrentProgram(int index)
         }
     }
 
-    // Update the program in instance 0, the other instances will follow
+    // Dexed changes its program on the message thread, where it may also update its editor
+    requestedProgram = index;
+    if (juce::MessageManager::existsAndIsCurrentThread()) {
+        changeRequestedProgram();
+    }
+}
+
+void PluginAudioProcessor::changeRequestedProgram()
+{
+    const int index = requestedProgram.exchange(-1);
+    if (index < 0 || dexedPluginInstances[0] == nullptr) {
+        return;
+    }
+
+    // The parameters that the program changes in instance 0, from the snapshots, which leave out the
+    // detune that every follower keeps; without snapshots there are none
+    auto changes = std::make_unique<juce::MemoryBlock>();
+    if (const float *values = programSnapshots.getValues(index, parameterSync.getNumberOfParameters())) {
+        changes->setSize(sizeof(ParameterSync::Change) * static_cast<size_t>(parameterSync.getNumberOfParameters()));
+        const int numberOfChanges = parameterSync.findChanges(values, static_cast<ParameterSync::Change *>(changes->getData()));
+        changes->setSize(sizeof(ParameterSync::Change) * static_cast<size_t>(numberOfChanges));
+    }
+
+    // Posted first, so that the followers don't pick up the new program of instance 0 through
+    // parameterSync before the command fades the output out
+    postControlCommand(ControlCommandQueue::Type::setProgram, std::move(changes));
+
+    const juce::ScopedLock dexedLock(StateReplicator::getDexedLock());
+    isSwitchingProgram = true;
     dexedPluginInstances[0]->setCurrentProgram(index);
+    isSwitchingProgram = false;
 }
 
 const juce::String PluginAudioProcessor::getProgramName(int index)
 {
+    if (!instancesAreReady) {
+        return "";
+    }
+
     // Return if any of the plugin instances are null
     for (int i = 0; i < numberOfInstances; i++) {
         if (dexedPluginInstances[i] == nullptr) {
@@ -431,6 +1899,10 @@ const juce::String PluginAudioProcessor::getProgramName(int index)
 }
 
 void PluginAudioProcessor::changeProgramName(int index, const juce::String &newName) {
+    if (!instancesAreReady) {
+        return;
+    }
+
     // Return if any of the plugin instances are null
     for (int i = 0; i < numberOfInstances; i++) {
         if (dexedPluginInstances[i] == nullptr) {
@@ -443,7 +1915,10 @@ void PluginAudioProcessor::changeProgramName(int index, const juce::String &newN
 
 bool PluginAudioProcessor::hasEditor() const
 {
-    // Only permit editor to open if plugins instantiated properly
+    // Only permit editor to open if plugins instantiated properly; while they are loading, it says so
+    if (loadingHasFailed) {
+        return false;
+    }
     for (int i = 0; i < numberOfInstances; i++) {
         if (dexedPluginInstances[i] == nullptr) {
             return false;
@@ -467,18 +1942,16 @@ bool PluginAudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts) co
 // // Because we inherit from juce::AudioProcessorValueTreeState::Listener, we need to implement this method
 void PluginAudioProcessor::parameterChanged(const juce::String &parameterID, float newValue)
 {
-    DBG("parameterChanged() called with parameterID = " + parameterID + " and newValue = " + juce::String(newValue));
-    // If the parameterID is "detuneSpread", then we need to call detune()
-    if (parameterID == "detuneSpread") {
-        shouldSynchronize = false;
-        detune();
-        shouldSynchronize = true;
-    }
+    MULTIDEXED_TRACE_SCOPE("parameterChanged");
+    RealtimeLog::write(RealtimeLog::Level::debug, "parameterChanged() called with parameterID = {} and newValue = {}", parameterID, newValue);
+    // The detuneSpread is not listened to: applyControlCommands() picks it up at the start of each block
 }	
 
 // Because we inherit from juce::AudioProcessorParameter::Listener, we need to implement this method
 void PluginAudioProcessor::parameterValueChanged(int parameterIndex, float newValue) // We can't know which set of parameters the index refers to; FIXME
 {
+    MULTIDEXED_TRACE_SCOPE("parameterValueChanged", parameterIndex);
+
     // Return if any of the plugin instances are null
     for (int i = 0; i < numberOfInstances; i++) {
         if (dexedPluginInstances[i] == nullptr) {
@@ -486,53 +1959,34 @@ void PluginAudioProcessor::parameterValueChanged(int parameterIndex, float newVa
         }
     }
     
-    // Get the parameter that changed
-    juce::AudioProcessorParameter* parameter = nullptr;
-    for (int i = 0; i < dexedPluginInstances[0]->getParameters().size(); i++) {
-        if (dexedPluginInstances[0]->getParameters()[i]->getParameterIndex() == parameterIndex) {
-            parameter = dexedPluginInstances[0]->getParameters()[i];
-            break;
-        }
-    }
-
-    if (parameter == nullptr) {
-        // Parameter not found, return
-        return;
-    }
-
-    // Get the name of the parameter
-    juce::String parameterName = parameter->getName(100);
-
     // We cannot distinguish between changes in the plugin instance and changes in the host,
-    // so for now we just call detune() whenever the parameter changes, even if the user
+    // so for now we just propagate the parameter whenever it changes, even if the user
     // changed the parameter with the same index in plugin instance 0 rather than the host
 
-    std::cout << "Parameter " << parameterIndex << ": " << parameterName.toStdString() << " = " << newValue << std::endl;
+    // Mark the parameter for being copied to all other plugin instances at the start of the next block;
+    // this may be called at automation rate, so don't do any more work here than that
+    parameterSync.markDirty(parameterIndex);
+    fmPatchIsStale = true;
 
-    // Update the value of the parameter in all other plugin instances
-    for (int i = 1; i < numberOfInstances; i++) {
-        if (shouldSynchronize) {
-            for (int j = 0; j < dexedPluginInstances[i]->getParameters().size(); j++) {
-                if (dexedPluginInstances[i]->getParameters()[j]->getParameterIndex() == parameterIndex) {
-                    dexedPluginInstances[i]->getParameters()[j]->setValueNotifyingHost(newValue);
-                    break;
-                }
-            }
-        }
-        // FIXME: Why does the above work for some parameters but not others (e.g. "OP1 F COARSE")?
+    // Changes caused by a control command, a program switch or a state load on the replicator thread
+    // already cover all instances
+    const bool isReplicatedChange = isApplyingControlCommands || isSwitchingProgram || StateReplicator::isLoadingOnCurrentThread();
+    if (!isReplicatedChange) {
+        fmPatchChangeTime = juce::Time::getMillisecondCounter();
     }
+    // FIXME: Why does the above work for some parameters but not others (e.g. "OP1 F COARSE")?
 
     // When a cartridge is loaded, update the parameters of all instances
     // TODO: Find a better trigger for this, e.g. when the user clicks "Load Cartridge"
-    if (parameterIndex == 2236) {
+    // A state or program applied by a control command already covers all instances
+    if (parameterIndex == ParameterSync::cartridgeParameterIndex && !isReplicatedChange) {
         // Synchronize the plugin state from instance 0 to all other instances
-        // Get the state of instance 0
-        juce::MemoryBlock state;
-        dexedPluginInstances[0]->getStateInformation(state);
-        for (int i = 1; i < numberOfInstances; i++) {
-            dexedPluginInstances[i]->setStateInformation(state.getData(), static_cast<size_t>(state.getSize()));
+        // Get the state of instance 0 here, the replicator only loads it into the others
+        auto state = std::make_unique<juce::MemoryBlock>();
+        stateReplicator.getLeaderState(*state);
+        if (controlCommands.getNumberOfPendingStates() > 0 || stateReplicator.wouldChange(*state, 1)) {
+            postControlCommand(ControlCommandQueue::Type::applyStateToFollowers, std::move(state));
         }
-        detune();
         // Update the names of all programs exposed by the plugin to the host
         updateHostDisplay(); // TODO: Why does this not work? How can we update the menu containing the progams in the host?
         // dexedPluginInstances[0]->updateHostDisplay(); // Does not work either
@@ -560,5 +2014,40 @@ juce::AudioProcessorValueTreeState::ParameterLayout PluginAudioProcessor::create
                                                         0.0f,   // minimum value
                                                         1.0f,   // maximum value
                                                         1.0f)); // default value
+    parameters.push_back(std::make_unique<juce::AudioParameterBool>("parallelRendering", // parameterID
+                                                        "Parallel Rendering", // parameter name
+                                                        false)); // default value
+    parameters.push_back(std::make_unique<juce::AudioParameterInt>("renderThreads", // parameterID
+                                                        "Render Threads", // parameter name
+                                                        1,   // minimum value
+                                                        InstanceRenderPool::maximumNumberOfWorkers + 1, // maximum value
+                                                        2)); // default value
+    parameters.push_back(std::make_unique<juce::AudioParameterInt>("unisonVoices", // parameterID
+                                                        "Unison Voices", // parameter name
+                                                        1,   // minimum value
+                                                        maximumNumberOfInstances - 1, // maximum value
+                                                        4)); // default value
+    parameters.push_back(std::make_unique<juce::AudioParameterBool>("fmEngine", // parameterID
+                                                        "Built-in FM Engine (no LFO/pitch EG)", // parameter name
+                                                        false)); // default value
+    parameters.push_back(std::make_unique<juce::AudioParameterInt>("helperProcesses", // parameterID
+                                                        "Helper Processes", // parameter name
+                                                        0,   // minimum value
+                                                        OutOfProcessHost::maximumNumberOfHelpers, // maximum value
+                                                        0)); // default value
+    parameters.push_back(std::make_unique<juce::AudioParameterChoice>("ecoMode", // parameterID
+                                                        "Eco Mode", // parameter name
+                                                        juce::StringArray { "Off", "44.1/48 kHz", "22.05/24 kHz" }, // choices
+                                                        0)); // default value
+    parameters.push_back(std::make_unique<juce::AudioParameterBool>("unisonGovernor", // parameterID
+                                                        "Adaptive Voices", // parameter name
+                                                        false)); // default value
+    parameters.push_back(std::make_unique<juce::AudioParameterBool>("programFade", // parameterID
+                                                        "Program Fade", // parameter name
+                                                        false)); // default value
+    NoteRange::addParameters(parameters, {}, {});
+    for (int layer = 0; layer < maximumNumberOfLayers - 1; layer++) {
+        UnisonLayer::addParameters(parameters, layer + 2);
+    }
    return { parameters.begin(), parameters.end() };               
 }
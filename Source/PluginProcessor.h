@@ -9,14 +9,37 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "CartridgeLibrary.h"
+#include "ControlCommandQueue.h"
+#include "FmUnisonEngine.h"
+#include "IdleDetector.h"
+#include "InstanceBufferArena.h"
+#include "InstanceLevelMeters.h"
+#include "InstanceLoader.h"
+#include "InstanceRenderPool.h"
+#include "OutOfProcessHost.h"
+#include "ParameterSync.h"
+#include "PerformanceMonitor.h"
+#include "PolyphaseUpsampler.h"
+#include "ProgramSnapshots.h"
+#include "RealtimeLog.h"
+#include "SessionState.h"
+#include "StateReplicator.h"
+#include "TraceRecorder.h"
+#include "UnisonGovernor.h"
+#include "UnisonLayer.h"
+#include "UnisonMixer.h"
 
 
 //==============================================================================
 /**
  */
 class PluginAudioProcessor : public juce::AudioProcessor,
+                             public juce::ChangeBroadcaster,
                              juce::AudioProcessorParameter::Listener,
-                             juce::AudioProcessorValueTreeState::Listener
+                             juce::AudioProcessorValueTreeState::Listener,
+                             InstanceRenderPool::Job,
+                             juce::Timer
                              // https://www.youtube.com/watch?v=Bw_OkHNpj1M&t=1990s
 #if JucePlugin_Enable_ARA
     ,
@@ -61,15 +84,67 @@ public:
     void getStateInformation(juce::MemoryBlock &destData) override;
     void setStateInformation(const void *data, int sizeInBytes) override;
 
-    const int numberOfInstances = 5;
+    // Upper limit for numberOfInstances: instance 0 plus 32 unison voices
+    static constexpr int maximumNumberOfInstances = 33;
 
-    bool shouldSynchronize = true;
+    // The main group counts as layer 1; layers 2 and up are in layers
+    static constexpr int maximumNumberOfLayers = 4;
 
-    // Make an array that can hold numberOfInstances juce::AudioProcessor instances
-    std::array<std::unique_ptr<juce::AudioProcessor>, 5> dexedPluginInstances;
+    // The buffers, fades, meters and mixer gains of the layer voices come after those of the main instances
+    static constexpr int firstLayerSlot = maximumNumberOfInstances;
+    static constexpr int maximumNumberOfSlots = firstLayerSlot + (maximumNumberOfLayers - 1) * UnisonLayer::maximumNumberOfVoices;
+    static int getLayerSlot(int layer, int voice) { return firstLayerSlot + layer * UnisonLayer::maximumNumberOfVoices + voice; }
 
-    // Buffers for the plugin instances
-    std::array<juce::AudioBuffer<float>, 5> dexedPluginBuffers;
+    // Number of instances, including instance 0, as set by the unisonVoices parameter. Changes on the
+    // message thread once the new instances exist; a change message is sent after every change.
+    // 0 until the instances have been loaded.
+    std::atomic<int> numberOfInstances { 0 };
+
+    // Set once the instances have been loaded in the background; until then processBlock outputs
+    // silence, and a change message is sent when it is set
+    std::atomic<bool> instancesAreReady { false };
+
+    // Set if Dexed could not be found or loaded
+    std::atomic<bool> loadingHasFailed { false };
+
+    // Make an array that can hold maximumNumberOfInstances juce::AudioProcessor instances
+    std::array<std::unique_ptr<juce::AudioProcessor>, maximumNumberOfInstances> dexedPluginInstances;
+
+    // Layers 2 and up, each with a patch of its own; off until their voices parameter is set
+    std::array<UnisonLayer, maximumNumberOfLayers - 1> layers;
+
+    // Buffers for the plugin instances, carved out of memory allocated in prepareToPlay
+    InstanceBufferArena dexedPluginBuffers;
+
+    // Every instance gets its own copy of the incoming MIDI so that they can be rendered in parallel
+    std::array<juce::MidiBuffer, maximumNumberOfInstances> dexedPluginMidiBuffers;
+
+    // CPU and memory used by each instance
+    PerformanceMonitor performanceMonitor;
+
+    // Output level of each follower, for the meters in the tabs
+    InstanceLevelMeters levelMeters;
+
+    // Records the phases of the blocks while tracing is switched on in the editor
+    juce::SharedResourcePointer<TraceRecorder> traceRecorder;
+
+    // Renders followers in helper processes when the helperProcesses parameter is not 0
+    OutOfProcessHost outOfProcessHost;
+
+    // Leaves out the outermost voices while processBlock takes too long, if the unisonGovernor parameter is on
+    UnisonGovernor governor;
+
+    // Number of voices actually played, less than unisonVoices while the governor sheds some. For display.
+    std::atomic<int> effectiveVoices { 4 };
+
+    // Rate the instances run at; below the host's rate in eco mode. For display.
+    std::atomic<double> internalSampleRate { 44100.0 };
+
+    // Set by the editor while the editor of instance 0 ("Master") is open
+    std::atomic<bool> masterEditorVisible { false };
+
+    // Blocks shorter than this are rendered serially because the handoff to the workers would not pay off
+    static constexpr int minimumParallelBlockSize = 32;
 
     // Because we inherit from juce::AudioProcessorValueTreeState::Listener, we need to implement this method
     void parameterChanged(const juce::String &parameterID, float newValue) override;
@@ -78,13 +153,341 @@ public:
     void parameterValueChanged(int parameterIndex, float newValue) override;
     void parameterGestureChanged(int parameterIndex, bool gestureIsStarting) override;
 
-    // Method to detune the plugin instances
-    void detune();
+    // Loads a voice of a cartridge, e.g. from the CartridgeLibrary, into all instances in one state load;
+    // false if there is no leader yet or the data is not a cartridge. Message thread.
+    bool loadCartridgeVoice(const juce::MemoryBlock &cartridge, int voiceIndex);
 
     juce::AudioProcessorValueTreeState apvts;
 
 private:
     //==============================================================================
+    // Writes the log while any MultiDexed exists in the process
+    juce::SharedResourcePointer<RealtimeLog> logWriter;
+
+    // Control operations are queued here and applied by the audio thread between blocks,
+    // so that they never run concurrently with the rendering of the instances
+    ControlCommandQueue controlCommands;
+
+    // Posts a command, and applies it right away if no blocks are being processed.
+    // False if the queue was full and the command was dropped.
+    bool postControlCommand(ControlCommandQueue::Type type, int index = 0, float value = 0.0f);
+    void postControlCommand(ControlCommandQueue::Type type, std::unique_ptr<juce::MemoryBlock> state);
+
+    // Applies the queued control commands in the order they were posted; called at the start of a block.
+    // Commands posted after a state are held back until the state is loaded.
+    void applyControlCommands();
+
+    // Waits for a state load in progress and applies what is still queued. Not for the audio thread.
+    void applyPendingControlCommands();
+
+    // Replaces the MIDI kept while loading by an all notes off on every channel, within the reserved space
+    void endLoadingMidiNotes();
+
+    // Sets the detune of the follower instances for the given detuneSpread
+    void applyDetune(float range);
+
+    // The detuneSpread the followers were last detuned for; audio thread
+    float appliedDetuneSpread = -1.0f;
+
+    // Brings the instances back in line after a state was loaded into them
+    void finishStateLoad();
+
+    // Loads states into the instances, in the background while blocks are being processed
+    StateReplicator stateReplicator;
+
+    // Set when the followers missed MIDI while their state was loaded
+    bool followersNeedAllNotesOff = false;
+
+    // Whether processBlock is being called, i.e. whether someone applies the queued commands
+    std::atomic<bool> isPrepared { false };
+
+    // The rate and largest block of the instances, which run at the host's rate divided by ecoFactor
+    double preparedSampleRate = 44100.0;
+    int preparedBlockSize = 512;
+
+    // What the host prepared us with
+    double hostSampleRate = 44100.0;
+    int hostBlockSize = 512;
+
+    //==============================================================================
+    // Renders a block at the rate of the instances, from applying the leader changes to the mix
+    void renderBlock(juce::AudioBuffer<float> &buffer, juce::MidiBuffer &midiMessages);
+
+    // Renders a block at a fraction of the host's rate and upsamples it, for eco mode
+    void renderEcoBlock(juce::AudioBuffer<float> &buffer, juce::MidiBuffer &midiMessages);
+
+    // The integer factor between the host's rate and the rate the ecoMode parameter asks for
+    int getEcoFactor(double sampleRate) const;
+
+    // Sets the rate of the instances and the upsampler up for the ecoMode parameter. Not for the audio thread.
+    void prepareEcoMode();
+
+    // Message thread: prepares everything again when the ecoMode parameter changed the rate of the instances
+    void updateEcoMode();
+
+    // Host rate divided by the rate of the instances; 1 when eco mode is off
+    int ecoFactor = 1;
+    PolyphaseUpsampler ecoUpsampler;
+
+    // The block at the rate of the instances, and the same block upsampled
+    juce::AudioBuffer<float> ecoMixBuffer;
+    juce::AudioBuffer<float> ecoOutputBuffer;
+
+    // Upsampled samples that did not fit into the previous host block, at ecoLeftoverStart in ecoOutputBuffer
+    int ecoLeftoverStart = 0;
+    int ecoLeftover = 0;
+
+    // MIDI at the positions of the instance samples; events of a block that needed no rendering stay for the next
+    juce::MidiBuffer ecoMidi;
+
+    //==============================================================================
+    // Instances are created and torn down on the message thread, in timerCallback(), and then
+    // added to or removed from what the audio thread renders with a setNumberOfInstances command
+    void timerCallback() override;
+
+    // Creates or tears down instances until there are as many as the unisonVoices parameter asks for
+    void updateNumberOfInstances();
+
+    // Creates the instance with the given index as a copy of instance 0; returns false if that failed
+    bool createInstance(int index);
+
+    // Tears down an instance that the audio thread no longer renders
+    void destroyInstance(int index);
+
+    // Matches the buses of an instance to ours and prepares it for playback
+    void prepareInstance(juce::AudioProcessor &instance, double sampleRate, int samplesPerBlock);
+
+    // Audio thread: starts fading instances in or out for the new number of instances
+    void changeNumberOfInstances(int newNumberOfInstances);
+
+    // Audio thread: sets the fade targets and pans for the number of instances and the shed voices
+    void updateInstanceTargets(int newNumberOfInstances);
+
+    // Audio thread: fades the slot towards target, or sets it right away if fade is false
+    void setFadeTarget(int slot, float target, bool fade);
+
+    // Audio thread: feeds the time processBlock took to the governor and sheds or restores voices
+    void updateGovernor(double processSeconds, int numSamples);
+
+    // The number of voices the governor had shed when the fade targets were last set
+    int shedVoices = 0;
+
+    // Followers left out by the governor, the outermost detuned ones first, and those of them that
+    // have faded out and are not rendered; a bit per instance
+    uint64_t shedInstances = 0;
+    uint64_t sleepingInstances = 0;
+    uint64_t previousSleepingInstances = 0;
+
+    // Followers that have nothing left to play and are not rendered until the next MIDI event; a bit per instance
+    uint64_t idleInstances = 0;
+    IdleDetector idleDetector;
+
+    // Tail length of Dexed, which the followers are rendered for at least after the last note ended
+    double instanceTailSeconds = 0.0;
+
+    // What was used to create instance 0, kept for creating more instances later
+    juce::AudioPluginFormatManager pluginFormatManager;
+    std::unique_ptr<juce::PluginDescription> dexedPluginDescription;
+
+    //==============================================================================
+    // Scans Dexed and creates the first instances, so that the constructor returns right away
+    InstanceLoader instanceLoader { pluginFormatManager };
+
+    // Message thread: requests the instances from instanceLoader and installs them once all exist
+    void continueLoading();
+    void finishLoading();
+
+    // How many instances the loader creates, and which it was asked for already
+    int numberOfInstancesToLoad = 0;
+    bool instanceIsRequested[maximumNumberOfInstances] = {};
+    int64_t memoryBeforeLastRequest = 0;
+
+    // Set when the host prepared us before the instances were loaded, and a state it gave us meanwhile
+    bool prepareWhenLoaded = false;
+    bool hostStateWaitsForInstances = false;
+
+    // MIDI received before the instances were loaded, played at the start of the first block after
+    juce::MidiBuffer loadingMidi;
+    int numberOfLoadingMidiEvents = 0;
+    static constexpr int maximumNumberOfLoadingMidiEvents = 256;
+    static constexpr int loadingMidiCapacity = 4096;
+
+    // Serializes the message thread operations that create, prepare and tear down instances
+    juce::CriticalSection instanceLock;
+
+    // Number of setNumberOfInstances commands posted but not applied yet
+    std::atomic<int> pendingInstanceCountChanges { 0 };
+
+    // The number of instances the audio thread renders, including instance 0, at the latest command
+    int activeInstances = 5;
+
+    // The number of instances the audio thread renders, including instances still fading out
+    std::atomic<int> renderedInstances { 5 };
+
+    // Gain of every slot at the start of the block and its change per sample, for fading in and out
+    float instanceFadeGains[maximumNumberOfSlots] = {};
+    float instanceFadeSteps[maximumNumberOfSlots] = {};
+    static constexpr double instanceFadeSeconds = 0.02;
+
+    //==============================================================================
+    // Plays all unison voices instead of the followers when the fmEngine parameter is on
+    FmUnisonEngine fmEngine;
+
+    // Whether fmEngine played the previous block
+    bool fmEngineWasUsed = false;
+
+    // Tuning of every lane of fmEngine, the same as the detune of the instance it stands for
+    float fmLaneTunings[FmUnisonEngine::maximumNumberOfLanes] = {};
+    static_assert(FmUnisonEngine::maximumNumberOfLanes >= maximumNumberOfInstances - 1, "Every follower needs a lane");
+
+    // Set when instance 0 may have changed since its voice was last handed to fmEngine
+    std::atomic<bool> fmPatchIsStale { true };
+    int fmPatchProgram = -1;
+
+    // When a parameter of instance 0 last changed; its voice is only read again once they have settled
+    std::atomic<juce::uint32> fmPatchChangeTime { 0 };
+    static constexpr juce::uint32 fmPatchSettleMilliseconds = 250;
+
+    // Message thread: hands the current voice of instance 0 to fmEngine if it changed
+    void updateFmPatch();
+
+    //==============================================================================
+    // The values of every program of the current cartridge, so that the followers switch programs
+    // together with instance 0 instead of catching up through a state load
+    ProgramSnapshots programSnapshots;
+
+    // Set when the cartridge may have changed since the snapshots were started
+    std::atomic<bool> programSnapshotsAreStale { true };
+
+    // Set if the instance for the snapshots could not be created; program changes then work as before
+    bool programSnapshotsHaveFailed = false;
+
+    // Message thread: starts building the snapshots when the cartridge changed
+    void updateProgramSnapshots();
+
+    // Host program changes, picked up by timerCallback() when they come from another thread
+    std::atomic<int> requestedProgram { -1 };
+
+    // Message thread: posts the setProgram command and then selects the program in instance 0
+    void changeRequestedProgram();
+
+    // Audio thread: sets the parameters that the program changes in the followers and retires the block
+    void switchProgram(juce::MemoryBlock *changes);
+
+    // With programFade on, a program change waits for the output to fade out over a block and
+    // fades it in over the next one
+    juce::MemoryBlock *pendingProgramChanges = nullptr;
+    bool programIsFadingOut = false;
+    bool programIsFadingIn = false;
+
+    //==============================================================================
+    // Message thread: starts or stops helper processes and keeps their copies of the followers up to date
+    void updateHelperProcesses();
+
+    // Leader parameter changes of the current block, passed on to the helper processes
+    ParameterSync::Change leaderChanges[SharedRenderChannel::maximumNumberOfParameterChanges];
+
+    // Instances rendered by helper processes in the current and in the previous block
+    uint64_t remoteInstances = 0;
+    uint64_t previousRemoteInstances = 0;
+
+    // Fades instance i in or out after it was added or removed
+    void applyInstanceFade(int i);
+
+    // Length of the current block in seconds, for the load figures
+    double currentBlockSeconds = 0.0;
+
+    // Set when creating instances failed, so that it is not retried until unisonVoices changes
+    int failedNumberOfInstances = 0;
+
+    // Pan of every instance between 0 (left) and 1 (right); instances fading out keep theirs
+    float instancePans[maximumNumberOfInstances] = {};
+
+    //==============================================================================
+    // Message thread: creates or tears down layer voices for the voices parameters of the layers,
+    // and creates them again when their patch changed
+    void updateLayers();
+
+    // Creates a voice of a layer as a copy of its voice 0, or voice 0 from the patch of the layer;
+    // returns false if that failed
+    bool createLayerVoice(int layer, int voice);
+
+    // Audio thread: starts fading voices of a layer in or out for its new number of voices
+    void changeLayerVoices(int layer, int newNumberOfVoices);
+
+    // Prepares the layer voices that exist with the rate and block size of the main instances
+    void prepareLayerVoices();
+
+    // Keys and velocities the main group plays, and its MIDI when that is not all of it
+    NoteRange noteRange;
+    juce::MidiBuffer noteRangeMidi;
+
+    // Slots of the layer voices rendered in the current block, after the jobs of the main group
+    int layerJobSlots[maximumNumberOfSlots - firstLayerSlot] = {};
+    int numberOfMainJobs = 0;
+
+    // One more than the last slot in use; the buffers up to it are cleared and mixed
+    int numberOfSlotsInUse = 0;
+
+    // The layers, mixed apart while the built-in FM engine plays the main group
+    juce::AudioBuffer<float> layerMixBuffer;
+
+    static_assert(maximumNumberOfSlots <= UnisonMixer::maximumNumberOfSources
+                  && maximumNumberOfSlots <= InstanceLevelMeters::maximumNumberOfInstances
+                  && maximumNumberOfSlots <= IdleDetector::maximumNumberOfInstances
+                  && maximumNumberOfSlots <= PerformanceMonitor::maximumNumberOfInstances,
+                  "Every layer voice needs a slot");
+
+    // The most recent state the host gave us, returned to the host until it has been applied
+    juce::MemoryBlock latestPostedState;
+    juce::CriticalSection latestPostedStateLock;
+    std::atomic<int> pendingHostStates { 0 };
+
+    // Sets follower parameters from a block of SessionState::Override records
+    void applyOverrides(const juce::MemoryBlock &overrides);
+
+    // Renders the plugin instance with the given index into its buffer; called by renderPool
+    void renderJob(int jobIndex) override;
+
+    // Fills the MIDI for instance 0 and returns whether it needs to be rendered in this block
+    bool prepareMasterInstance(const juce::MidiBuffer &midiMessages, int numSamples);
+
+    // Propagates parameter changes from instance 0 to the other instances and tracks their mute state
+    ParameterSync parameterSync;
+
+    // Worker threads used to render the plugin instances in parallel
+    InstanceRenderPool renderPool;
+
+    // Index of the instance that job 0 of renderPool renders in the current block
+    int firstInstanceToRender = 0;
+
+    // Whether instance 0 got the full MIDI stream, including notes, in the previous block
+    bool masterInstanceIsPlaying = false;
+
+    // Recomputes the per-instance left/right gains used by the mixer
+    void updateMixGains(float panAmountFactor, uint64_t unmutedInstances);
+
+    // Mixes the instance buffers into the output
+    UnisonMixer mixer;
+
+    // The values the mixer gains were last computed for; a bit per unmuted instance
+    float mixGainsPanSpread = -1.0f;
+    uint64_t mixGainsUnmutedInstances = 0;
+
+    // Set when instances were added or removed since the mixer gains were computed
+    bool mixGainsAreStale = true;
+
+    // Cached pointers to our own parameters so that processBlock does not need to look them up
+    std::atomic<float> *detuneSpreadParameter = nullptr;
+    std::atomic<float> *unisonVoicesParameter = nullptr;
+    std::atomic<float> *parallelRenderingParameter = nullptr;
+    std::atomic<float> *renderThreadsParameter = nullptr;
+    std::atomic<float> *fmEngineParameter = nullptr;
+    std::atomic<float> *helperProcessesParameter = nullptr;
+    std::atomic<float> *ecoModeParameter = nullptr;
+    std::atomic<float> *unisonGovernorParameter = nullptr;
+    std::atomic<float> *programFadeParameter = nullptr;
+
     // Declare parameterListener to be a juce::AudioProcessorParameter::Listener
     juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
 
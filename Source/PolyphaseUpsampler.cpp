@@ -0,0 +1,154 @@
+#include "PolyphaseUpsampler.h"
+
+#include <cmath>
+
+#if JUCE_INTEL
+#  include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#  include <arm_neon.h>
+#  define MULTIDEXED_HAS_NEON 1
+#endif
+
+namespace {
+
+constexpr int taps = PolyphaseUpsampler::tapsPerPhase;
+
+float dotScalar(const float *a, const float *b)
+{
+    float sum = 0.0f;
+    for (int i = 0; i < taps; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+#if JUCE_INTEL
+
+float dotSSE(const float *a, const float *b)
+{
+    // Two accumulators to hide the latency of the additions
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    for (int i = 0; i < taps; i += 8) {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+
+    __m128 sum = _mm_add_ps(sum0, sum1);
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+#endif
+
+#if MULTIDEXED_HAS_NEON
+
+float dotNEON(const float *a, const float *b)
+{
+    float32x4_t sum0 = vdupq_n_f32(0.0f);
+    float32x4_t sum1 = vdupq_n_f32(0.0f);
+    for (int i = 0; i < taps; i += 8) {
+        sum0 = vfmaq_f32(sum0, vld1q_f32(a + i), vld1q_f32(b + i));
+        sum1 = vfmaq_f32(sum1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    return vaddvq_f32(vaddq_f32(sum0, sum1));
+}
+
+#endif
+
+// Zeroth order modified Bessel function of the first kind, for the Kaiser window
+double besselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 32; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+} // namespace
+
+static_assert(taps % 8 == 0, "The kernels work on 8 taps at a time");
+
+//==============================================================================
+PolyphaseUpsampler::PolyphaseUpsampler()
+{
+#if JUCE_INTEL
+    dotProduct = dotSSE;
+    kernelName = "SSE";
+#elif MULTIDEXED_HAS_NEON
+    dotProduct = dotNEON;
+    kernelName = "NEON";
+#else
+    dotProduct = dotScalar;
+    kernelName = "Scalar";
+#endif
+    juce::ignoreUnused(dotScalar);
+}
+
+void PolyphaseUpsampler::prepare(int newFactor, int maximumNumberOfInputSamples)
+{
+    factor = juce::jlimit(1, maximumFactor, newFactor);
+    maximumInputSamples = maximumNumberOfInputSamples;
+
+    // Passes up to 90 % of the Nyquist frequency of the input, which is where Dexed has little left anyway
+    const int length = taps * factor;
+    const double cutoff = 0.45 / factor;
+    const double beta = 8.0;
+    const double centre = (length - 1) / 2.0;
+
+    std::vector<double> filter(static_cast<size_t>(length));
+    double sum = 0.0;
+    for (int i = 0; i < length; i++) {
+        const double x = i - centre;
+        const double sinc = x == 0.0 ? 2.0 * cutoff : std::sin(2.0 * juce::MathConstants<double>::pi * cutoff * x) / (juce::MathConstants<double>::pi * x);
+        const double ratio = 2.0 * i / (length - 1) - 1.0;
+        const double window = besselI0(beta * std::sqrt(juce::jmax(0.0, 1.0 - ratio * ratio))) / besselI0(beta);
+        filter[static_cast<size_t>(i)] = sinc * window;
+        sum += sinc * window;
+    }
+
+    // Each phase sums to about 1, so the level stays what it was
+    phases.assign(static_cast<size_t>(length), 0.0f);
+    for (int phase = 0; phase < factor; phase++) {
+        for (int tap = 0; tap < taps; tap++) {
+            const double coefficient = filter[static_cast<size_t>(tap * factor + phase)] * factor / sum;
+            phases[static_cast<size_t>(phase * taps + taps - 1 - tap)] = static_cast<float>(coefficient);
+        }
+    }
+
+    for (auto &channel : history) {
+        channel.assign(static_cast<size_t>(taps - 1 + maximumNumberOfInputSamples), 0.0f);
+    }
+}
+
+void PolyphaseUpsampler::reset()
+{
+    for (auto &channel : history) {
+        std::fill(channel.begin(), channel.end(), 0.0f);
+    }
+}
+
+void PolyphaseUpsampler::process(const float *const *input, float *const *output, int numberOfInputSamples)
+{
+    jassert(numberOfInputSamples <= maximumInputSamples);
+    numberOfInputSamples = juce::jmin(numberOfInputSamples, maximumInputSamples);
+
+    for (int channel = 0; channel < 2; channel++) {
+        float *past = history[channel].data();
+        std::copy(input[channel], input[channel] + numberOfInputSamples, past + taps - 1);
+
+        float *out = output[channel];
+        for (int sample = 0; sample < numberOfInputSamples; sample++) {
+            for (int phase = 0; phase < factor; phase++) {
+                *out++ = dotProduct(phases.data() + phase * taps, past + sample);
+            }
+        }
+
+        // Keep the latest input for the next call
+        std::copy(past + numberOfInputSamples, past + numberOfInputSamples + taps - 1, past);
+    }
+}
@@ -0,0 +1,71 @@
+/*
+  ==============================================================================
+
+    Upsamples the stereo mix by an integer factor, so that the Dexed
+    instances can run at a lower rate than the host in eco mode.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <vector>
+
+//==============================================================================
+/**
+    Polyphase FIR interpolator for two channels.
+
+    The lowpass is a Kaiser windowed sinc of tapsPerPhase taps per output
+    phase, designed in prepare(). Every input sample yields factor output
+    samples, each of which is the dot product of one phase of the filter
+    with the latest input samples, computed with SSE or NEON. Because the
+    filter is linear phase, the output is delayed by a fixed number of
+    samples, see getLatency().
+ */
+class PolyphaseUpsampler
+{
+public:
+    PolyphaseUpsampler();
+
+    static constexpr int maximumFactor = 8;
+
+    // A multiple of 4 so that the dot products need no scalar tail
+    static constexpr int tapsPerPhase = 32;
+
+    // Designs the filter and allocates for up to maximumNumberOfInputSamples per call. Not for the audio thread.
+    void prepare(int newFactor, int maximumNumberOfInputSamples);
+
+    // Forgets the input seen so far
+    void reset();
+
+    int getFactor() const { return factor; }
+
+    // Delay of the output, in output samples: the centre of the filter, rounded to a whole sample
+    int getLatency() const { return juce::roundToInt((tapsPerPhase * factor - 1) / 2.0); }
+
+    // Writes numberOfInputSamples * getFactor() samples into each of the two output channels.
+    // Does not lock or allocate.
+    void process(const float *const *input, float *const *output, int numberOfInputSamples);
+
+    // Name of the instruction set the kernel was compiled for, for diagnostics
+    const char *getKernelName() const { return kernelName; }
+
+    using DotProduct = float (*)(const float *a, const float *b);
+
+private:
+    int factor = 1;
+    int maximumInputSamples = 0;
+
+    // factor phases of tapsPerPhase coefficients, each reversed so that it runs along the history
+    std::vector<float> phases;
+
+    // Per channel, the last tapsPerPhase - 1 input samples followed by the current input
+    std::vector<float> history[2];
+
+    DotProduct dotProduct = nullptr;
+    const char *kernelName = "";
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PolyphaseUpsampler)
+};
@@ -0,0 +1,142 @@
+#include "ProgramSnapshots.h"
+#include "StateReplicator.h"
+
+ProgramSnapshots::ProgramSnapshots()
+    : juce::Thread("Program Snapshots")
+{
+}
+
+ProgramSnapshots::~ProgramSnapshots()
+{
+    stopThread(10000);
+    delete publishedTable.exchange(nullptr);
+    delete retiredTable.exchange(nullptr);
+    delete tableInUse;
+}
+
+void ProgramSnapshots::setInstance(std::unique_ptr<juce::AudioProcessor> newInstance)
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+
+    stopThread(10000);
+    instance = std::move(newInstance);
+    if (instance != nullptr) {
+        startThread(juce::Thread::Priority::low);
+    }
+}
+
+void ProgramSnapshots::startBuilding(const juce::MemoryBlock &state)
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+
+    {
+        const juce::ScopedLock lock(requestLock);
+        requestedState = state;
+        requestedGeneration = generation.load();
+    }
+    requestCount++;
+    notify();
+}
+
+void ProgramSnapshots::update()
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+
+    delete retiredTable.exchange(nullptr, std::memory_order_acquire);
+
+    std::unique_ptr<Table> table;
+    {
+        const juce::ScopedLock lock(finishedLock);
+        table = std::move(finishedTable);
+    }
+
+    // A table getValues() never picked up can go right away
+    if (table != nullptr) {
+        delete publishedTable.exchange(table.release(), std::memory_order_acq_rel);
+    }
+}
+
+void ProgramSnapshots::invalidate()
+{
+    generation++;
+}
+
+const float *ProgramSnapshots::getValues(int program, int numberOfParameters)
+{
+    // Switch to a newly published table once the previous one has been given back
+    if (publishedTable.load(std::memory_order_relaxed) != nullptr && retiredTable.load(std::memory_order_relaxed) == nullptr) {
+        retiredTable.store(tableInUse, std::memory_order_release);
+        tableInUse = publishedTable.exchange(nullptr, std::memory_order_acq_rel);
+    }
+
+    const Table *table = tableInUse;
+    if (table == nullptr || table->generation != generation.load(std::memory_order_relaxed)
+        || table->numberOfParameters != numberOfParameters || !juce::isPositiveAndBelow(program, table->numberOfPrograms)) {
+        return nullptr;
+    }
+    return table->values.data() + static_cast<size_t>(program * numberOfParameters);
+}
+
+void ProgramSnapshots::run()
+{
+    uint32_t builtRequest = 0;
+    while (!threadShouldExit()) {
+        const uint32_t request = requestCount.load();
+        if (request == builtRequest) {
+            wait(-1);
+            continue;
+        }
+        builtRequest = request;
+
+        juce::MemoryBlock state;
+        uint32_t stateGeneration = 0;
+        {
+            const juce::ScopedLock lock(requestLock);
+            state = requestedState;
+            stateGeneration = requestedGeneration;
+        }
+
+        if (auto table = build(state, stateGeneration)) {
+            const juce::ScopedLock lock(finishedLock);
+            finishedTable = std::move(table);
+        }
+    }
+}
+
+std::unique_ptr<ProgramSnapshots::Table> ProgramSnapshots::build(const juce::MemoryBlock &state, uint32_t tableGeneration)
+{
+    const uint32_t request = requestCount.load();
+
+    // Taken per call, so that loads into the instances that are played wait for one program at most
+    {
+        const juce::ScopedLock dexedLock(StateReplicator::getDexedLock());
+        instance->setStateInformation(state.getData(), static_cast<int>(state.getSize()));
+    }
+
+    // Parameter indices are not necessarily positions in getParameters(), see ParameterSync
+    const auto &parameters = instance->getParameters();
+    auto table = std::make_unique<Table>();
+    table->generation = tableGeneration;
+    table->numberOfPrograms = instance->getNumPrograms();
+    for (auto *parameter : parameters) {
+        table->numberOfParameters = juce::jmax(table->numberOfParameters, parameter->getParameterIndex() + 1);
+    }
+    table->values.assign(static_cast<size_t>(table->numberOfPrograms * table->numberOfParameters), 0.0f);
+
+    for (int program = 0; program < table->numberOfPrograms; program++) {
+        // A newer cartridge makes this one pointless
+        if (threadShouldExit() || requestCount.load() != request) {
+            return nullptr;
+        }
+
+        {
+            const juce::ScopedLock dexedLock(StateReplicator::getDexedLock());
+            instance->setCurrentProgram(program);
+        }
+        float *values = table->values.data() + static_cast<size_t>(program * table->numberOfParameters);
+        for (auto *parameter : parameters) {
+            values[parameter->getParameterIndex()] = parameter->getValue();
+        }
+    }
+    return table;
+}
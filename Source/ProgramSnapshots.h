@@ -0,0 +1,90 @@
+/*
+  ==============================================================================
+
+    Parameter values of every program in the current cartridge, prepared in
+    the background so that a program change is applied to all instances in
+    one block.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+//==============================================================================
+/**
+    Loads the leader's state into an instance of its own, which is never
+    rendered, selects every program there in turn and records the values of
+    all parameters by parameter index. Each load and program change holds
+    StateReplicator::getDexedLock(), like those of the instances that are played.
+
+    The message thread starts a build with startBuilding() and publishes the
+    result with update(). A program change reads the values with getValues(),
+    which neither locks nor allocates, from one thread at a time; tables it has
+    finished with are freed by update(). invalidate() makes getValues() return nullptr until a table of
+    a build started later is published, e.g. when another cartridge is loaded.
+ */
+class ProgramSnapshots : private juce::Thread
+{
+public:
+    ProgramSnapshots();
+    ~ProgramSnapshots() override;
+
+    // The instance the programs are selected in. Message thread, while nothing is being built.
+    void setInstance(std::unique_ptr<juce::AudioProcessor> newInstance);
+    bool hasInstance() const { return instance != nullptr; }
+
+    // Builds the table for the cartridge in the state; a build in progress is abandoned. Message thread.
+    void startBuilding(const juce::MemoryBlock &state);
+
+    // Publishes a finished table and frees those getValues() has let go of. Message thread.
+    void update();
+
+    // Any thread
+    void invalidate();
+
+    // The values of the program by parameter index, or nullptr if there is no up-to-date table
+    // or it has a different number of parameters. Message thread.
+    const float *getValues(int program, int numberOfParameters);
+
+private:
+    struct Table
+    {
+        uint32_t generation = 0;
+        int numberOfPrograms = 0;
+        int numberOfParameters = 0;
+        std::vector<float> values;
+    };
+
+    void run() override;
+
+    // Selects every program in the instance and records its values; nullptr if the build was abandoned
+    std::unique_ptr<Table> build(const juce::MemoryBlock &state, uint32_t generation);
+
+    std::unique_ptr<juce::AudioProcessor> instance;
+
+    // The request for the background thread
+    juce::CriticalSection requestLock;
+    juce::MemoryBlock requestedState;
+    uint32_t requestedGeneration = 0;
+    std::atomic<uint32_t> requestCount { 0 };
+
+    // Tables whose build started after the last invalidate() are up to date
+    std::atomic<uint32_t> generation { 1 };
+
+    // Built, waiting for the message thread to publish it
+    std::unique_ptr<Table> finishedTable;
+    juce::CriticalSection finishedLock;
+
+    // Handed to getValues(), in use by it, and given back by it
+    std::atomic<Table *> publishedTable { nullptr };
+    Table *tableInUse = nullptr;
+    std::atomic<Table *> retiredTable { nullptr };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ProgramSnapshots)
+};
@@ -0,0 +1,273 @@
+#include "RealtimeLog.h"
+#include "DexedLocator.h"
+
+#include <cstring>
+
+namespace {
+
+struct Record
+{
+    // Which lap of the queue the record belongs to; see Queue
+    std::atomic<uint32_t> sequence { 0 };
+
+    RealtimeLog::Level level = RealtimeLog::Level::info;
+    const char *format = nullptr;
+    juce::int64 ticks = 0;
+    double values[2] = {};
+    bool hasText = false;
+    char text[RealtimeLog::maximumTextLength + 1] = {};
+};
+
+// A bounded queue for many writers and one reader. A record is free for the writer that claimed position p
+// when its sequence is p, and ready for the reader when it is p + 1; the reader then sets it to p + queueSize.
+struct Queue
+{
+    Queue()
+    {
+        for (uint32_t i = 0; i < RealtimeLog::queueSize; i++) {
+            records[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    Record records[RealtimeLog::queueSize];
+    std::atomic<uint32_t> writePosition { 0 };
+    uint32_t readPosition = 0;
+    std::atomic<uint32_t> droppedRecords { 0 };
+};
+
+Queue &getQueue()
+{
+    static Queue queue;
+    return queue;
+}
+
+std::atomic<int> currentLevel { static_cast<int>(RealtimeLog::Level::info) };
+
+// Claims a free record, or returns nullptr if the queue is full
+Record *claimRecord(Queue &queue, uint32_t &position)
+{
+    position = queue.writePosition.load(std::memory_order_relaxed);
+    for (;;) {
+        Record &record = queue.records[position % RealtimeLog::queueSize];
+        const uint32_t sequence = record.sequence.load(std::memory_order_acquire);
+        const int32_t difference = static_cast<int32_t>(sequence - position);
+        if (difference == 0) {
+            if (queue.writePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                return &record;
+            }
+        } else if (difference < 0) {
+            queue.droppedRecords.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        } else {
+            position = queue.writePosition.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void writeRecord(RealtimeLog::Level level, const char *format, const juce::String *text, double firstValue, double secondValue)
+{
+    if (!RealtimeLog::isEnabled(level)) {
+        return;
+    }
+
+    auto &queue = getQueue();
+    uint32_t position = 0;
+    Record *record = claimRecord(queue, position);
+    if (record == nullptr) {
+        return;
+    }
+
+    record->level = level;
+    record->format = format;
+    record->ticks = juce::Time::getHighResolutionTicks();
+    record->values[0] = firstValue;
+    record->values[1] = secondValue;
+    record->hasText = text != nullptr;
+    if (text != nullptr) {
+        text->copyToUTF8(record->text, sizeof(record->text));
+    }
+    record->sequence.store(position + 1, std::memory_order_release);
+}
+
+const char *getLevelName(RealtimeLog::Level level)
+{
+    switch (level) {
+        case RealtimeLog::Level::debug: return "debug";
+        case RealtimeLog::Level::info: return "info";
+        case RealtimeLog::Level::warning: return "warning";
+        case RealtimeLog::Level::error: return "error";
+        case RealtimeLog::Level::off: break;
+    }
+    return "off";
+}
+
+juce::String formatRecord(const Record &record)
+{
+    juce::String message;
+    int nextValue = 0;
+    bool textIsUsed = !record.hasText;
+    for (const char *c = record.format; *c != 0; c++) {
+        if (c[0] == '{' && c[1] == '}') {
+            if (!textIsUsed) {
+                message << juce::String::fromUTF8(record.text);
+                textIsUsed = true;
+            } else if (nextValue < 2) {
+                message << juce::String(record.values[nextValue++]);
+            }
+            c++;
+        } else {
+            message << *c;
+        }
+    }
+    return message;
+}
+
+} // namespace
+
+RealtimeLog::RealtimeLog()
+    : juce::Thread("MultiDexed log")
+{
+    // Constructs the queue before any audio thread can get to it
+    getQueue();
+
+    startTime = juce::Time::getCurrentTime();
+    startTicks = juce::Time::getHighResolutionTicks();
+    updateLevelFromSettings();
+    startThread(juce::Thread::Priority::low);
+}
+
+RealtimeLog::~RealtimeLog()
+{
+    stopThread(2000);
+    writeQueuedRecords();
+}
+
+void RealtimeLog::write(Level level, const char *format, double firstValue, double secondValue)
+{
+    writeRecord(level, format, nullptr, firstValue, secondValue);
+}
+
+void RealtimeLog::write(Level level, const char *format, const juce::String &text, double value)
+{
+    writeRecord(level, format, &text, value, 0.0);
+}
+
+void RealtimeLog::setLevel(Level newLevel)
+{
+    currentLevel.store(static_cast<int>(newLevel), std::memory_order_relaxed);
+}
+
+RealtimeLog::Level RealtimeLog::getLevel()
+{
+    return static_cast<Level>(currentLevel.load(std::memory_order_relaxed));
+}
+
+juce::File RealtimeLog::getLogFile()
+{
+    return DexedLocator::getSettingsOptions().getDefaultFile().getSiblingFile("MultiDexed.log");
+}
+
+void RealtimeLog::run()
+{
+    // Nobody waits for the records, so a few per second is plenty
+    int iterationsSinceSettingsCheck = 0;
+    while (!threadShouldExit()) {
+        wait(200);
+        writeQueuedRecords();
+
+        if (++iterationsSinceSettingsCheck >= 10) {
+            iterationsSinceSettingsCheck = 0;
+            updateLevelFromSettings();
+        }
+    }
+}
+
+void RealtimeLog::writeQueuedRecords()
+{
+    auto &queue = getQueue();
+
+    juce::String lines;
+    const uint32_t dropped = queue.droppedRecords.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0) {
+        lines << juce::Time::getCurrentTime().toISO8601(true) << " warning: " << juce::String(dropped) << " log records dropped\n";
+    }
+
+    for (;;) {
+        Record &record = queue.records[queue.readPosition % queueSize];
+        if (record.sequence.load(std::memory_order_acquire) != queue.readPosition + 1) {
+            break;
+        }
+
+        const double seconds = juce::Time::highResolutionTicksToSeconds(record.ticks - startTicks);
+        const juce::Time time = startTime + juce::RelativeTime::seconds(seconds);
+        const juce::String line = time.toISO8601(true) + " " + getLevelName(record.level) + ": " + formatRecord(record);
+        lines << line << "\n";
+#if JUCE_DEBUG
+        juce::Logger::outputDebugString(line);
+#endif
+
+        record.sequence.store(queue.readPosition + queueSize, std::memory_order_release);
+        queue.readPosition++;
+    }
+
+    if (lines.isEmpty()) {
+        return;
+    }
+
+    if (stream == nullptr) {
+        openLogFile();
+    }
+    if (stream != nullptr) {
+        stream->writeText(lines, false, false, nullptr);
+        stream->flush();
+        if (stream->getPosition() >= maximumFileSize) {
+            rotateLogFile();
+        }
+    }
+}
+
+void RealtimeLog::openLogFile()
+{
+    const juce::File file = getLogFile();
+    file.getParentDirectory().createDirectory();
+    stream = std::make_unique<juce::FileOutputStream>(file);
+    if (stream->failedToOpen()) {
+        stream = nullptr;
+    }
+}
+
+void RealtimeLog::rotateLogFile()
+{
+    stream = nullptr;
+
+    // MultiDexed.log becomes MultiDexed.1.log, which becomes MultiDexed.2.log, and so on
+    const juce::File file = getLogFile();
+    auto oldFile = [&file](int number) {
+        return file.getSiblingFile(file.getFileNameWithoutExtension() + "." + juce::String(number) + file.getFileExtension());
+    };
+    oldFile(numberOfOldFiles).deleteFile();
+    for (int i = numberOfOldFiles - 1; i >= 1; i--) {
+        oldFile(i).moveFileTo(oldFile(i + 1));
+    }
+    file.moveFileTo(oldFile(1));
+
+    openLogFile();
+}
+
+void RealtimeLog::updateLevelFromSettings()
+{
+    const juce::File settingsFile = DexedLocator::getSettingsOptions().getDefaultFile();
+    const juce::Time modificationTime = settingsFile.getLastModificationTime();
+    if (modificationTime == settingsModificationTime) {
+        return;
+    }
+    settingsModificationTime = modificationTime;
+
+    juce::PropertiesFile settings(DexedLocator::getSettingsOptions());
+    const juce::String name = settings.getValue("logLevel").trim().toLowerCase();
+    for (auto level : { Level::debug, Level::info, Level::warning, Level::error, Level::off }) {
+        if (name == getLevelName(level)) {
+            setLevel(level);
+        }
+    }
+}
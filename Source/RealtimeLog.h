@@ -0,0 +1,86 @@
+/*
+  ==============================================================================
+
+    Logging that is safe on the audio thread and in parameter listeners.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <atomic>
+
+//==============================================================================
+/**
+    write() copies a fixed-size record into a lock-free queue shared by the
+    whole process; it does not lock, allocate, format or make system calls, and
+    drops the record if the queue is full. Records below the current level are
+    not even queued.
+
+    A background thread, which runs while at least one RealtimeLog object
+    exists, formats the records and appends them to MultiDexed.log next to the
+    settings file. The file is rotated when it gets too large. The level can be
+    changed with setLevel(), or with the "logLevel" entry of the settings file
+    (debug, info, warning, error or off), which is read again when it changes.
+
+    Keep one alive with a juce::SharedResourcePointer<RealtimeLog>; records
+    written while none exists are kept until the queue is full.
+ */
+class RealtimeLog : private juce::Thread
+{
+public:
+    RealtimeLog();
+    ~RealtimeLog() override;
+
+    enum class Level
+    {
+        debug,
+        info,
+        warning,
+        error,
+        off
+    };
+
+    // Longest text a record carries; longer text is cut
+    static constexpr int maximumTextLength = 127;
+
+    static constexpr int queueSize = 512;
+    static constexpr int64_t maximumFileSize = 1024 * 1024;
+    static constexpr int numberOfOldFiles = 2;
+
+    // format must be a string literal. Its "{}" are replaced by the values, in order.
+    static void write(Level level, const char *format, double firstValue = 0.0, double secondValue = 0.0);
+
+    // Same, except that the first "{}" is replaced by the text
+    static void write(Level level, const char *format, const juce::String &text, double value = 0.0);
+
+    static void setLevel(Level newLevel);
+    static Level getLevel();
+    static bool isEnabled(Level level) { return level >= getLevel() && level != Level::off; }
+
+    // The file being written
+    static juce::File getLogFile();
+
+private:
+    void run() override;
+
+    // Formats and writes what is queued
+    void writeQueuedRecords();
+
+    void openLogFile();
+    void rotateLogFile();
+
+    // Applies the "logLevel" entry if the settings file changed
+    void updateLevelFromSettings();
+
+    std::unique_ptr<juce::FileOutputStream> stream;
+    juce::Time settingsModificationTime;
+
+    // Maps the high resolution ticks of the records to wall-clock time
+    juce::Time startTime;
+    juce::int64 startTicks = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RealtimeLog)
+};
@@ -0,0 +1,233 @@
+#include "RenderHelperWorker.h"
+#include "OutOfProcessHost.h"
+
+RenderHelperWorker::RenderHelperWorker()
+    : juce::Thread("MultiDexed Render Helper")
+{
+    formatManager.addFormat(new juce::VST3PluginFormat());
+
+    midi.ensureSize(SharedRenderChannel::midiCapacity * 2);
+    instanceMidi.ensureSize(SharedRenderChannel::midiCapacity * 2);
+}
+
+RenderHelperWorker::~RenderHelperWorker()
+{
+    signalThreadShouldExit();
+    stopThread(1000);
+
+    const juce::ScopedLock lock(renderLock);
+    for (auto &instance : instances) {
+        instance.reset();
+    }
+}
+
+void RenderHelperWorker::handleMessageFromCoordinator(const juce::MemoryBlock &message)
+{
+    // This is the connection thread; plugins are created and loaded on the message thread
+    juce::MessageManager::callAsync([this, message] { handleMessage(message); });
+}
+
+void RenderHelperWorker::handleConnectionLost()
+{
+    // MultiDexed has gone away, or it stopped us
+    juce::JUCEApplicationBase::quit();
+}
+
+void RenderHelperWorker::handleMessage(const juce::MemoryBlock &message)
+{
+    juce::MemoryInputStream input(message, false);
+
+    switch (static_cast<OutOfProcessHost::MessageType>(input.readInt())) {
+    case OutOfProcessHost::MessageType::initialise:
+        initialise(input);
+        break;
+    case OutOfProcessHost::MessageType::states:
+        loadStates(input);
+        break;
+    case OutOfProcessHost::MessageType::parameters:
+        setParameters(input);
+        break;
+    }
+}
+
+void RenderHelperWorker::initialise(juce::MemoryInputStream &input)
+{
+    const juce::String channelName = input.readString();
+    const auto xml = juce::parseXML(input.readString());
+    sampleRate = input.readDouble();
+    maximumBlockSize = input.readInt();
+
+    description = std::make_unique<juce::PluginDescription>();
+    if (xml == nullptr || !description->loadFromXml(*xml) || !channel.open(channelName)) {
+        RealtimeLog::write(RealtimeLog::Level::error, "Render helper could not initialise");
+        juce::JUCEApplicationBase::quit();
+        return;
+    }
+
+    if (!startRealtimeThread(juce::Thread::RealtimeOptions {})) {
+        startThread(juce::Thread::Priority::highest);
+    }
+}
+
+void RenderHelperWorker::loadStates(juce::MemoryInputStream &input)
+{
+    if (description == nullptr || !channel.isOpen()) {
+        return;
+    }
+
+    const uint32_t generation = static_cast<uint32_t>(input.readInt());
+    const int numberOfStates = input.readInt();
+
+    uint64_t wantedInstances = 0;
+    std::array<juce::MemoryBlock, SharedRenderChannel::maximumNumberOfInstances> states;
+    for (int i = 0; i < numberOfStates && !input.isExhausted(); i++) {
+        const int instance = input.readInt();
+        const int size = input.readInt();
+        if (!juce::isPositiveAndBelow(instance, SharedRenderChannel::maximumNumberOfInstances) || size < 0) {
+            return;
+        }
+
+        input.readIntoMemoryBlock(states[static_cast<size_t>(instance)], size);
+        wantedInstances |= uint64_t(1) << instance;
+    }
+
+    // Create the missing copies first, without holding up the render thread
+    std::array<std::unique_ptr<juce::AudioPluginInstance>, SharedRenderChannel::maximumNumberOfInstances> created;
+    for (int i = 0; i < SharedRenderChannel::maximumNumberOfInstances; i++) {
+        if (!(wantedInstances & (uint64_t(1) << i)) || instances[static_cast<size_t>(i)] != nullptr) {
+            continue;
+        }
+
+        juce::String error;
+        auto instance = formatManager.createPluginInstance(*description, sampleRate, maximumBlockSize, error);
+        if (instance == nullptr) {
+            RealtimeLog::write(RealtimeLog::Level::error, "Render helper could not create a Dexed instance: {}", error);
+            continue;
+        }
+
+        instance->enableAllBuses();
+        instance->prepareToPlay(sampleRate, maximumBlockSize);
+        const auto &state = states[static_cast<size_t>(i)];
+        instance->setStateInformation(state.getData(), static_cast<int>(state.getSize()));
+        created[static_cast<size_t>(i)] = std::move(instance);
+    }
+
+    std::array<std::unique_ptr<juce::AudioPluginInstance>, SharedRenderChannel::maximumNumberOfInstances> removed;
+    uint64_t hostedInstances = 0;
+    {
+        const juce::ScopedLock lock(renderLock);
+
+        for (int i = 0; i < SharedRenderChannel::maximumNumberOfInstances; i++) {
+            auto &instance = instances[static_cast<size_t>(i)];
+            if (!(wantedInstances & (uint64_t(1) << i))) {
+                removed[static_cast<size_t>(i)] = std::move(instance);
+            } else if (created[static_cast<size_t>(i)] != nullptr) {
+                instance = std::move(created[static_cast<size_t>(i)]);
+            } else if (instance != nullptr) {
+                const auto &state = states[static_cast<size_t>(i)];
+                instance->setStateInformation(state.getData(), static_cast<int>(state.getSize()));
+            }
+
+            if (instance != nullptr) {
+                hostedInstances |= uint64_t(1) << i;
+            }
+        }
+
+        auto &header = channel.getHeader();
+        header.hostedInstances.store(hostedInstances, std::memory_order_release);
+        header.loadedStateGeneration.store(generation, std::memory_order_release);
+    }
+
+    // The copies that are no longer needed are torn down after the lock was released
+    for (auto &instance : removed) {
+        if (instance != nullptr) {
+            instance->releaseResources();
+            instance.reset();
+        }
+    }
+}
+
+void RenderHelperWorker::setParameters(juce::MemoryInputStream &input)
+{
+    const int instance = input.readInt();
+    const int numberOfChanges = input.readInt();
+    if (!juce::isPositiveAndBelow(instance, SharedRenderChannel::maximumNumberOfInstances)) {
+        return;
+    }
+
+    const juce::ScopedLock lock(renderLock);
+    auto &plugin = instances[static_cast<size_t>(instance)];
+    if (plugin == nullptr) {
+        return;
+    }
+
+    for (int i = 0; i < numberOfChanges && !input.isExhausted(); i++) {
+        const int index = input.readInt();
+        const float value = input.readFloat();
+        if (auto *parameter = plugin->getParameters()[index]) {
+            parameter->setValue(value);
+        }
+    }
+}
+
+void RenderHelperWorker::run()
+{
+    auto &header = channel.getHeader();
+    uint32_t lastRequest = header.completed.load(std::memory_order_acquire);
+
+    while (!threadShouldExit()) {
+        // Wakes up now and then to check whether it should exit
+        if (!channel.waitWhileEqual(header.requested, lastRequest, 0.1)) {
+            continue;
+        }
+
+        lastRequest = header.requested.load(std::memory_order_acquire);
+        render();
+        header.completed.store(lastRequest, std::memory_order_release);
+        channel.wake(header.completed);
+    }
+}
+
+void RenderHelperWorker::render()
+{
+    auto &header = channel.getHeader();
+    const juce::ScopedLock lock(renderLock);
+
+    const int numberOfSamples = juce::jlimit(0, header.maximumBlockSize, header.numberOfSamples);
+    const int numberOfChannels = juce::jmin(header.numberOfChannels, 16);
+    const int numberOfChanges = juce::jlimit(0, SharedRenderChannel::maximumNumberOfParameterChanges, header.numberOfParameterChanges);
+
+    midi.clear();
+    channel.readMidi(midi);
+
+    uint64_t renderedInstances = 0;
+    for (int i = 0; i < SharedRenderChannel::maximumNumberOfInstances; i++) {
+        auto &instance = instances[static_cast<size_t>(i)];
+        if (instance == nullptr) {
+            continue;
+        }
+
+        // The changes made to the leader in MultiDexed for this block
+        const auto &parameters = instance->getParameters();
+        for (int change = 0; change < numberOfChanges; change++) {
+            if (auto *parameter = parameters[header.parameterChanges[change].index]) {
+                parameter->setValue(header.parameterChanges[change].value);
+            }
+        }
+
+        // Render straight into the shared memory
+        float *channels[16];
+        for (int c = 0; c < numberOfChannels; c++) {
+            channels[c] = channel.getChannel(i, c);
+        }
+        juce::AudioBuffer<float> buffer(channels, numberOfChannels, numberOfSamples);
+        buffer.clear();
+
+        instanceMidi.clear();
+        instanceMidi.addEvents(midi, 0, numberOfSamples, 0);
+        instance->processBlock(buffer, instanceMidi);
+        renderedInstances |= uint64_t(1) << i;
+    }
+
+    header.renderedInstances.store(renderedInstances, std::memory_order_release);
+}
@@ -0,0 +1,69 @@
+/*
+  ==============================================================================
+
+    The side of a render helper process that runs the Dexed copies.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "RealtimeLog.h"
+#include "SharedRenderChannel.h"
+
+#include <array>
+
+//==============================================================================
+/**
+    Runs in a helper process started by OutOfProcessHost.
+
+    The messages from MultiDexed are handled on the message thread: they
+    create and remove the Dexed copies and load their states and parameters.
+    A render thread waits for the requests in the SharedRenderChannel and
+    renders every copy straight into the shared memory.
+
+    The process quits when MultiDexed goes away.
+ */
+class RenderHelperWorker : public juce::ChildProcessWorker,
+                           private juce::Thread
+{
+public:
+    RenderHelperWorker();
+    ~RenderHelperWorker() override;
+
+    void handleMessageFromCoordinator(const juce::MemoryBlock &message) override;
+    void handleConnectionLost() override;
+
+private:
+    // Message thread
+    void handleMessage(const juce::MemoryBlock &message);
+    void initialise(juce::MemoryInputStream &input);
+    void loadStates(juce::MemoryInputStream &input);
+    void setParameters(juce::MemoryInputStream &input);
+
+    // Render thread
+    void run() override;
+    void render();
+
+    juce::AudioPluginFormatManager formatManager;
+    std::unique_ptr<juce::PluginDescription> description;
+    double sampleRate = 44100.0;
+    int maximumBlockSize = 512;
+
+    SharedRenderChannel channel;
+
+    // Writes the log of the helper into the same file as MultiDexed
+    juce::SharedResourcePointer<RealtimeLog> logWriter;
+
+    // The copies of the followers, by their instance index in MultiDexed
+    std::array<std::unique_ptr<juce::AudioPluginInstance>, SharedRenderChannel::maximumNumberOfInstances> instances;
+
+    // Held while rendering, and while the message thread changes the copies
+    juce::CriticalSection renderLock;
+
+    juce::MidiBuffer midi;
+    juce::MidiBuffer instanceMidi;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RenderHelperWorker)
+};
@@ -0,0 +1,129 @@
+#include "SessionState.h"
+
+#include <cstring>
+
+namespace {
+
+const char magic[4] = { 'M', 'D', 'X', 'S' };
+
+// Sanity limits for reading damaged data; far above anything real
+constexpr int maximumBlockSize = 64 * 1024 * 1024;
+constexpr int maximumNumberOfOverrides = 65536;
+constexpr int maximumNumberOfLayers = 64;
+
+bool readBlock(juce::InputStream &input, juce::MemoryBlock &block)
+{
+    const int size = input.readCompressedInt();
+    if (size < 0 || size > maximumBlockSize) {
+        return false;
+    }
+    block.setSize(static_cast<size_t>(size));
+    return input.read(block.getData(), size) == size;
+}
+
+void writeBlock(juce::OutputStream &output, const juce::MemoryBlock &block)
+{
+    output.writeCompressedInt(static_cast<int>(block.getSize()));
+    output.write(block.getData(), block.getSize());
+}
+
+} // namespace
+
+void SessionState::writeTo(juce::MemoryBlock &destData) const
+{
+    destData.reset();
+    juce::MemoryOutputStream output(destData, false);
+    output.write(magic, sizeof(magic));
+    output.writeInt(currentVersion);
+
+    juce::GZIPCompressorOutputStream compressed(output);
+    writeBlock(compressed, parameters);
+    writeBlock(compressed, dexedState);
+
+    compressed.writeCompressedInt(numberOfInstances);
+    size_t next = 0;
+    for (int instance = 0; instance < numberOfInstances; instance++) {
+        size_t end = next;
+        while (end < overrides.size() && overrides[end].instance == instance) {
+            end++;
+        }
+
+        compressed.writeCompressedInt(static_cast<int>(end - next));
+        for (; next < end; next++) {
+            jassert(juce::isPositiveAndBelow(overrides[next].parameterIndex, 65536));
+            compressed.writeShort(static_cast<short>(overrides[next].parameterIndex));
+            compressed.writeFloat(overrides[next].value);
+        }
+    }
+
+    // Overrides must be sorted by instance
+    jassert(next == overrides.size());
+
+    compressed.writeCompressedInt(static_cast<int>(layerStates.size()));
+    for (const auto &layerState : layerStates) {
+        writeBlock(compressed, layerState);
+    }
+
+    compressed.flush();
+}
+
+bool SessionState::readFrom(const void *data, int sizeInBytes)
+{
+    if (!isSessionState(data, sizeInBytes)) {
+        return false;
+    }
+
+    juce::MemoryInputStream input(data, static_cast<size_t>(sizeInBytes), false);
+    input.skipNextBytes(sizeof(magic));
+    const int version = input.readInt();
+    if (version > currentVersion) {
+        return false;
+    }
+
+    juce::GZIPDecompressorInputStream compressed(input);
+    if (!readBlock(compressed, parameters) || !readBlock(compressed, dexedState)) {
+        return false;
+    }
+
+    numberOfInstances = compressed.readCompressedInt();
+    if (numberOfInstances < 0 || numberOfInstances > 1024) {
+        return false;
+    }
+
+    overrides.clear();
+    for (int instance = 0; instance < numberOfInstances; instance++) {
+        const int count = compressed.readCompressedInt();
+        if (count < 0 || count > maximumNumberOfOverrides) {
+            return false;
+        }
+
+        for (int i = 0; i < count; i++) {
+            Override entry;
+            entry.instance = instance;
+            entry.parameterIndex = static_cast<uint16_t>(compressed.readShort());
+            entry.value = compressed.readFloat();
+            overrides.push_back(entry);
+        }
+    }
+
+    layerStates.clear();
+    if (version >= 2) {
+        const int numberOfLayers = compressed.readCompressedInt();
+        if (numberOfLayers < 0 || numberOfLayers > maximumNumberOfLayers) {
+            return false;
+        }
+
+        layerStates.resize(static_cast<size_t>(numberOfLayers));
+        for (auto &layerState : layerStates) {
+            if (!readBlock(compressed, layerState)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool SessionState::isSessionState(const void *data, int sizeInBytes)
+{
+    return sizeInBytes >= static_cast<int>(sizeof(magic)) + 4 && std::memcmp(data, magic, sizeof(magic)) == 0;
+}
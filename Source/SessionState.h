@@ -0,0 +1,61 @@
+/*
+  ==============================================================================
+
+    The state MultiDexed saves into host sessions.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <vector>
+
+//==============================================================================
+/**
+    Versioned binary session state.
+
+    Storing a full Dexed state per instance would multiply the size of every
+    session by the number of instances, although the instances differ in a
+    handful of parameters at most. So one Dexed state is stored for all of
+    them, followed by the parameters in which each follower differs from the
+    leader, and our own apvts parameters:
+
+        "MDXS", int32 version, then GZIP compressed:
+        compressed int size + apvts ValueTree,
+        compressed int size + base Dexed state,
+        compressed int number of instances,
+        per instance: compressed int count + count * (uint16 parameter index, float value),
+        since version 2: compressed int number of layers + per layer compressed int size + Dexed state
+
+    The layer states are those of the layers after the main group, empty for
+    a layer that never had a patch. Older sessions contain nothing but the
+    Dexed state of instance 0; isSessionState() tells the two apart.
+ */
+struct SessionState
+{
+    // A follower parameter whose value differs from the leader
+    struct Override
+    {
+        int32_t instance;
+        int32_t parameterIndex;
+        float value;
+    };
+
+    juce::MemoryBlock parameters;
+    juce::MemoryBlock dexedState;
+    int numberOfInstances = 0;
+    std::vector<Override> overrides;
+    std::vector<juce::MemoryBlock> layerStates;
+
+    void writeTo(juce::MemoryBlock &destData) const;
+
+    // Returns false if the data is damaged or from a newer version
+    bool readFrom(const void *data, int sizeInBytes);
+
+    // Whether the data is in this format rather than a plain Dexed state
+    static bool isSessionState(const void *data, int sizeInBytes);
+
+    static constexpr int currentVersion = 2;
+};
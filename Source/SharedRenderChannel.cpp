@@ -0,0 +1,296 @@
+#include "SharedRenderChannel.h"
+
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+#if JUCE_WINDOWS
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#  include <ctime>
+#  if JUCE_LINUX
+#    include <linux/futex.h>
+#    include <sys/syscall.h>
+#  elif JUCE_BSD
+#    include <sys/types.h>
+#    include <sys/umtx.h>
+#  endif
+#endif
+
+#if JUCE_MAC
+// The futex of macOS, which libc++ uses for std::atomic::wait; there is no header for it. Named
+// semaphores would do as well, but macOS has no sem_timedwait().
+extern "C" int __ulock_wait(uint32_t operation, void *address, uint64_t value, uint32_t timeoutMicroseconds);
+extern "C" int __ulock_wake(uint32_t operation, void *address, uint64_t wakeValue);
+#endif
+
+namespace {
+
+constexpr uint32_t magic = 0x4d445843; // "MDXC"
+
+#if JUCE_MAC
+// Compares and waits on a word that may be shared with other processes
+constexpr uint32_t compareAndWaitShared = 3;
+constexpr uint32_t wakeAll = 0x100;
+#endif
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+              "The handshake only works across processes with lock-free atomics");
+
+} // namespace
+
+SharedRenderChannel::~SharedRenderChannel()
+{
+    close();
+}
+
+size_t SharedRenderChannel::sizeFor(int numberOfChannels, int maximumBlockSize)
+{
+    return sizeof(Header) + sizeof(float) * static_cast<size_t>(maximumNumberOfInstances * numberOfChannels * maximumBlockSize);
+}
+
+bool SharedRenderChannel::create(const juce::String &name, int numberOfChannels, int maximumBlockSize)
+{
+    close();
+    regionName = name;
+    ownsRegion = true;
+
+    if (!map(sizeFor(numberOfChannels, maximumBlockSize), true)) {
+        close();
+        return false;
+    }
+
+    std::memset(region, 0, regionSize);
+    header->numberOfChannels = numberOfChannels;
+    header->maximumBlockSize = maximumBlockSize;
+    header->magic = magic;
+    return true;
+}
+
+bool SharedRenderChannel::open(const juce::String &name)
+{
+    close();
+    regionName = name;
+    ownsRegion = false;
+
+    // Map the header first to find out how large the whole region is
+    if (!map(sizeof(Header), false) || header->magic != magic) {
+        close();
+        return false;
+    }
+
+    const size_t size = sizeFor(header->numberOfChannels, header->maximumBlockSize);
+    close();
+    regionName = name;
+    return map(size, false);
+}
+
+bool SharedRenderChannel::map(size_t size, bool creating)
+{
+#if JUCE_WINDOWS
+    const auto wideName = regionName.toWideCharPointer();
+    if (creating) {
+        mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                     static_cast<DWORD>(static_cast<uint64_t>(size) >> 32), static_cast<DWORD>(size), wideName);
+    } else {
+        mapping = OpenFileMappingW(FILE_MAP_ALL_ACCESS, FALSE, wideName);
+    }
+    if (mapping == nullptr) {
+        return false;
+    }
+
+    region = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+
+    // Opened by name on both sides, whichever comes first creates them
+    requestedEvent = CreateEventW(nullptr, FALSE, FALSE, (regionName + "-requested").toWideCharPointer());
+    completedEvent = CreateEventW(nullptr, FALSE, FALSE, (regionName + "-completed").toWideCharPointer());
+    if (requestedEvent == nullptr || completedEvent == nullptr) {
+        return false;
+    }
+#else
+    const int descriptor = creating ? shm_open(regionName.toRawUTF8(), O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR)
+                                    : shm_open(regionName.toRawUTF8(), O_RDWR, 0);
+    if (descriptor < 0) {
+        return false;
+    }
+
+    if (creating && ftruncate(descriptor, static_cast<off_t>(size)) != 0) {
+        ::close(descriptor);
+        return false;
+    }
+
+    region = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    ::close(descriptor);
+    if (region == MAP_FAILED) {
+        region = nullptr;
+    }
+#endif
+
+    if (region == nullptr) {
+        return false;
+    }
+
+    regionSize = size;
+    header = static_cast<Header *>(region);
+    audio = reinterpret_cast<float *>(static_cast<char *>(region) + sizeof(Header));
+    return true;
+}
+
+void SharedRenderChannel::close()
+{
+#if JUCE_WINDOWS
+    if (region != nullptr) {
+        UnmapViewOfFile(region);
+    }
+    if (mapping != nullptr) {
+        CloseHandle(mapping);
+        mapping = nullptr;
+    }
+    for (void **event : { &requestedEvent, &completedEvent }) {
+        if (*event != nullptr) {
+            CloseHandle(*event);
+            *event = nullptr;
+        }
+    }
+#else
+    if (region != nullptr) {
+        munmap(region, regionSize);
+    }
+    if (ownsRegion && regionName.isNotEmpty()) {
+        shm_unlink(regionName.toRawUTF8());
+    }
+#endif
+
+    region = nullptr;
+    header = nullptr;
+    audio = nullptr;
+    regionSize = 0;
+    ownsRegion = false;
+    regionName = {};
+}
+
+float *SharedRenderChannel::getChannel(int instance, int channel) const
+{
+    jassert(juce::isPositiveAndBelow(instance, maximumNumberOfInstances) && juce::isPositiveAndBelow(channel, header->numberOfChannels));
+    return audio + static_cast<size_t>((instance * header->numberOfChannels + channel) * header->maximumBlockSize);
+}
+
+bool SharedRenderChannel::writeMidi(const juce::MidiBuffer &midi, int numberOfSamples)
+{
+    // Room for an all notes off on every channel
+    constexpr int allNotesOffSize = 16 * getEventSize(3);
+
+    int size = 0;
+    auto write = [this, &size](const void *data, int numBytes, int32_t position) {
+        const uint16_t length = static_cast<uint16_t>(numBytes);
+        std::memcpy(header->midi + size, &position, sizeof(position));
+        std::memcpy(header->midi + size + sizeof(position), &length, sizeof(length));
+        std::memcpy(header->midi + size + sizeof(position) + sizeof(length), data, static_cast<size_t>(numBytes));
+        size += getEventSize(numBytes);
+    };
+
+    bool complete = true;
+    for (const auto metadata : midi) {
+        if (metadata.samplePosition >= numberOfSamples) {
+            break;
+        }
+
+        // Too long for the header, but missing it leaves no notes hanging
+        if (metadata.numBytes > 0xffff) {
+            continue;
+        }
+
+        if (size + getEventSize(metadata.numBytes) > midiCapacity - allNotesOffSize) {
+            for (int channel = 1; channel <= 16; channel++) {
+                const auto allNotesOff = juce::MidiMessage::allNotesOff(channel);
+                write(allNotesOff.getRawData(), allNotesOff.getRawDataSize(), metadata.samplePosition);
+            }
+            complete = false;
+            break;
+        }
+
+        write(metadata.data, metadata.numBytes, metadata.samplePosition);
+    }
+    header->midiSize = size;
+    return complete;
+}
+
+void SharedRenderChannel::readMidi(juce::MidiBuffer &midi) const
+{
+    const int size = juce::jlimit(0, midiCapacity, header->midiSize);
+    int offset = 0;
+    while (offset + static_cast<int>(sizeof(int32_t) + sizeof(uint16_t)) <= size) {
+        int32_t position;
+        uint16_t length;
+        std::memcpy(&position, header->midi + offset, sizeof(position));
+        std::memcpy(&length, header->midi + offset + sizeof(position), sizeof(length));
+        offset += static_cast<int>(sizeof(position) + sizeof(length));
+
+        if (offset + length > size) {
+            break;
+        }
+        midi.addEvent(header->midi + offset, length, position);
+        offset += length;
+    }
+}
+
+void SharedRenderChannel::wake(std::atomic<uint32_t> &word)
+{
+#if JUCE_LINUX
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#elif JUCE_BSD
+    _umtx_op(&word, UMTX_OP_WAKE, INT_MAX, nullptr, nullptr);
+#elif JUCE_MAC
+    __ulock_wake(compareAndWaitShared | wakeAll, &word, 0);
+#elif JUCE_WINDOWS
+    SetEvent(&word == &header->requested ? requestedEvent : completedEvent);
+#else
+    // The waiting side polls
+    juce::ignoreUnused(word);
+#endif
+}
+
+bool SharedRenderChannel::waitWhileEqual(std::atomic<uint32_t> &word, uint32_t value, double timeoutSeconds)
+{
+    const double deadline = juce::Time::getMillisecondCounterHiRes() + timeoutSeconds * 1000.0;
+
+    // The other side usually answers within microseconds, so spin briefly before sleeping
+    for (int i = 0; i < 2000; i++) {
+        if (word.load(std::memory_order_acquire) != value) {
+            return true;
+        }
+    }
+
+    while (word.load(std::memory_order_acquire) == value) {
+        const double remaining = deadline - juce::Time::getMillisecondCounterHiRes();
+        if (remaining <= 0.0) {
+            return false;
+        }
+
+#if JUCE_LINUX || JUCE_BSD
+        struct timespec timeout;
+        timeout.tv_sec = static_cast<time_t>(remaining / 1000.0);
+        timeout.tv_nsec = static_cast<long>((remaining - timeout.tv_sec * 1000.0) * 1.0e6);
+#  if JUCE_LINUX
+        // Not FUTEX_PRIVATE_FLAG, the word is shared with another process
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT, value, &timeout, nullptr, 0);
+#  else
+        _umtx_op(&word, UMTX_OP_WAIT_UINT, value, reinterpret_cast<void *>(sizeof(timeout)), &timeout);
+#  endif
+#elif JUCE_MAC
+        // A timeout of 0 would wait forever
+        __ulock_wait(compareAndWaitShared, &word, value, static_cast<uint32_t>(juce::jlimit(1.0, 1.0e9, remaining * 1000.0)));
+#elif JUCE_WINDOWS
+        // The event may still be set from an earlier wake(); the loop checks the word again then
+        WaitForSingleObject(&word == &header->requested ? requestedEvent : completedEvent,
+                            static_cast<DWORD>(std::ceil(remaining)));
+#else
+        juce::Thread::yield();
+#endif
+    }
+    return true;
+}
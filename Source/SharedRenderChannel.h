@@ -0,0 +1,127 @@
+/*
+  ==============================================================================
+
+    Shared memory through which MultiDexed and a render helper process
+    exchange the MIDI and audio of each block.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <atomic>
+
+//==============================================================================
+/**
+    A named shared memory region holding one render request and the audio
+    of every instance the helper renders.
+
+    MultiDexed writes the MIDI and the parameter changes of a block into the
+    header, bumps requested and wakes the helper. The helper renders straight
+    into the audio area, sets completed to the same number and wakes
+    MultiDexed. Nothing is copied through a pipe or socket. Waiting is done
+    with a futex on Linux and FreeBSD, with its macOS counterpart, the shared
+    compare-and-wait of the kernel, and with a named event per word on Windows.
+
+    The header is plain data plus lock-free atomics, so it works the same way
+    in both processes.
+ */
+class SharedRenderChannel
+{
+public:
+    // The masks of hosted instances have one bit per instance
+    static constexpr int maximumNumberOfInstances = 64;
+    static constexpr int midiCapacity = 16384;
+    static constexpr int maximumNumberOfParameterChanges = 1024;
+
+    struct ParameterChange
+    {
+        int32_t index;
+        float value;
+    };
+
+    struct Header
+    {
+        uint32_t magic;
+        int32_t numberOfChannels;
+        int32_t maximumBlockSize;
+
+        // Sequence numbers of the latest request and of the latest block rendered for it
+        std::atomic<uint32_t> requested;
+        std::atomic<uint32_t> completed;
+
+        // Written by the helper: bit i is set if it has a copy of instance i, and the
+        // generation of the states it loaded into them
+        std::atomic<uint64_t> hostedInstances;
+        std::atomic<uint32_t> loadedStateGeneration;
+
+        // Written by the helper with completed: the instances it rendered for the request
+        std::atomic<uint64_t> renderedInstances;
+
+        // The current request
+        int32_t numberOfSamples;
+        int32_t midiSize;
+        int32_t numberOfParameterChanges;
+        ParameterChange parameterChanges[maximumNumberOfParameterChanges];
+
+        // Events as int32 sample position, uint16 size, data
+        uint8_t midi[midiCapacity];
+    };
+
+    SharedRenderChannel() = default;
+    ~SharedRenderChannel();
+
+    // Creates the region; used by MultiDexed, which also removes it again
+    bool create(const juce::String &name, int numberOfChannels, int maximumBlockSize);
+
+    // Opens a region created by create(); used by the helper
+    bool open(const juce::String &name);
+
+    void close();
+
+    bool isOpen() const { return header != nullptr; }
+    Header &getHeader() const { return *header; }
+
+    // Audio of a channel of an instance, maximumBlockSize samples
+    float *getChannel(int instance, int channel) const;
+
+    // Writes the MIDI of a block into the header. If not all of it fits, the rest is dropped and
+    // all notes are turned off where it starts, for which room is kept; returns false then.
+    bool writeMidi(const juce::MidiBuffer &midi, int numberOfSamples);
+
+    // Bytes an event with numberOfBytes of data takes up in the header
+    static constexpr int getEventSize(int numberOfBytes) { return static_cast<int>(sizeof(int32_t) + sizeof(uint16_t)) + numberOfBytes; }
+
+    // Adds the MIDI in the header to midi, which should have room for it
+    void readMidi(juce::MidiBuffer &midi) const;
+
+    // Wakes whoever waits for word, requested or completed of the header, to change
+    void wake(std::atomic<uint32_t> &word);
+
+    // Waits until word, requested or completed of the header, is no longer value; returns false if it
+    // did not change in time
+    bool waitWhileEqual(std::atomic<uint32_t> &word, uint32_t value, double timeoutSeconds);
+
+private:
+    static size_t sizeFor(int numberOfChannels, int maximumBlockSize);
+    bool map(size_t size, bool creating);
+
+    juce::String regionName;
+    bool ownsRegion = false;
+    size_t regionSize = 0;
+    void *region = nullptr;
+    Header *header = nullptr;
+    float *audio = nullptr;
+
+#if JUCE_WINDOWS
+    void *mapping = nullptr;
+
+    // Auto-reset events set by wake(), for requested and for completed
+    void *requestedEvent = nullptr;
+    void *completedEvent = nullptr;
+#endif
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SharedRenderChannel)
+};
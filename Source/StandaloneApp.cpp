@@ -0,0 +1,84 @@
+/*
+  ==============================================================================
+
+    The standalone application, which also runs as the render helper process
+    when it is started by OutOfProcessHost.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+
+#if JucePlugin_Build_Standalone && JUCE_USE_CUSTOM_PLUGIN_STANDALONE_APP
+
+#include <juce_audio_plugin_client/Standalone/juce_StandaloneFilterWindow.h>
+#include "DexedLocator.h"
+#include "OutOfProcessHost.h"
+#include "RenderHelperWorker.h"
+
+//==============================================================================
+// Same as JUCE's StandaloneFilterApp, except that it becomes a render helper without any window
+// when the command line says so
+class MultiDexedStandaloneApp : public juce::JUCEApplication
+{
+public:
+    MultiDexedStandaloneApp()
+    {
+        // The plugin reads the search path for Dexed from the same settings
+        appProperties.setStorageParameters(DexedLocator::getSettingsOptions());
+    }
+
+    const juce::String getApplicationName() override { return JucePlugin_Name; }
+    const juce::String getApplicationVersion() override { return JucePlugin_VersionString; }
+
+    // Helpers run side by side, one per process
+    bool moreThanOneInstanceAllowed() override { return true; }
+    void anotherInstanceStarted(const juce::String &) override {}
+
+    void initialise(const juce::String &commandLine) override
+    {
+        auto worker = std::make_unique<RenderHelperWorker>();
+        if (worker->initialiseFromCommandLine(commandLine, OutOfProcessHost::commandLineUniqueID)) {
+            renderHelper = std::move(worker);
+            return;
+        }
+
+        mainWindow.reset(new juce::StandaloneFilterWindow(getApplicationName(),
+                                                          juce::LookAndFeel::getDefaultLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId),
+                                                          appProperties.getUserSettings(), false, {}, nullptr, {}, false));
+        mainWindow->setVisible(true);
+    }
+
+    void shutdown() override
+    {
+        renderHelper = nullptr;
+        mainWindow = nullptr;
+        appProperties.saveIfNeeded();
+    }
+
+    void systemRequestedQuit() override
+    {
+        if (mainWindow != nullptr) {
+            mainWindow->pluginHolder->savePluginState();
+        }
+
+        if (juce::ModalComponentManager::getInstance()->cancelAllModalComponents()) {
+            juce::Timer::callAfterDelay(100, [] {
+                if (auto *app = juce::JUCEApplicationBase::getInstance()) {
+                    app->systemRequestedQuit();
+                }
+            });
+        } else {
+            quit();
+        }
+    }
+
+private:
+    juce::ApplicationProperties appProperties;
+    std::unique_ptr<juce::StandaloneFilterWindow> mainWindow;
+    std::unique_ptr<RenderHelperWorker> renderHelper;
+};
+
+JUCE_CREATE_APPLICATION_DEFINE(MultiDexedStandaloneApp)
+
+#endif
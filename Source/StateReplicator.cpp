@@ -0,0 +1,216 @@
+#include "StateReplicator.h"
+#include "TraceRecorder.h"
+
+namespace {
+
+// Set while the current thread loads a state into the instances, on whichever thread load() runs
+thread_local bool isLoadingOnThisThread = false;
+
+} // namespace
+
+StateReplicator::StateReplicator()
+    : juce::Thread("State Replicator")
+{
+    loadFinished.signal();
+
+    for (int i = 0; i < 64; i++) {
+        loadedFingerprints[i] = 0;
+        loadedStructures[i] = 0;
+    }
+}
+
+StateReplicator::~StateReplicator()
+{
+    signalThreadShouldExit();
+    loadRequested.signal();
+    stopThread(10000);
+}
+
+void StateReplicator::setInstances(juce::AudioProcessor *const *newInstances, int newNumberOfInstances)
+{
+    jassert(!isLoading());
+    jassert(newNumberOfInstances <= 64);
+
+    numberOfInstances = newNumberOfInstances;
+    for (int i = 0; i < newNumberOfInstances; i++) {
+        instances[i] = newInstances[i];
+        loadedFingerprints[i] = 0;
+        loadedStructures[i] = 0;
+    }
+
+    if (!isThreadRunning()) {
+        startThread();
+    }
+}
+
+void StateReplicator::setInstance(int index, juce::AudioProcessor *instance)
+{
+    jassert(juce::isPositiveAndBelow(index, 64) && index >= numberOfInstances.load());
+
+    instances[index] = instance;
+    loadedFingerprints[index] = 0;
+    loadedStructures[index] = 0;
+}
+
+void StateReplicator::setNumberOfInstances(int newNumberOfInstances)
+{
+    jassert(!isLoading());
+    jassert(newNumberOfInstances <= 64);
+
+    numberOfInstances = newNumberOfInstances;
+}
+
+uint64_t StateReplicator::fingerprint(const void *data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ull;
+    const auto *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t StateReplicator::structuralFingerprint(const juce::MemoryBlock &state)
+{
+    auto xml = juce::AudioProcessor::getXmlFromBinary(state.getData(), static_cast<int>(state.getSize()));
+    if (xml == nullptr || !xml->hasTagName("dexedState")) {
+        return 0;
+    }
+
+    // Dexed keeps the current voice in the "program" attribute of "dexedBlob"; all of it is
+    // exposed as parameters. Everything else, e.g. the cartridge and the tuning, is not.
+    if (auto *blob = xml->getChildByName("dexedBlob")) {
+        blob->removeAttribute("program");
+    }
+
+    const juce::String text = xml->toString(juce::XmlElement::TextFormat().singleLine().withoutHeader());
+    return fingerprint(text.toRawUTF8(), text.getNumBytesAsUTF8());
+}
+
+bool StateReplicator::wouldChange(const juce::MemoryBlock &state, int firstInstance)
+{
+    const uint64_t stateFingerprint = fingerprint(state.getData(), state.getSize());
+
+    if (firstInstance == 0) {
+        juce::MemoryBlock leaderState;
+        getLeaderState(leaderState);
+        if (fingerprint(leaderState.getData(), leaderState.getSize()) != stateFingerprint) {
+            return true;
+        }
+    }
+
+    const int count = numberOfInstances.load();
+    for (int i = juce::jmax(firstInstance, 1); i < count; i++) {
+        if (loadedFingerprints[i].load() != stateFingerprint) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool StateReplicator::isLoadingOnCurrentThread()
+{
+    return isLoadingOnThisThread;
+}
+
+juce::CriticalSection &StateReplicator::getDexedLock()
+{
+    static juce::CriticalSection dexedLock;
+    return dexedLock;
+}
+
+void StateReplicator::load(const juce::MemoryBlock &state, int firstInstance)
+{
+    MULTIDEXED_TRACE_SCOPE("loadState");
+    const juce::ScopedValueSetter<bool> loadingOnThisThread(isLoadingOnThisThread, true);
+    const uint64_t stateFingerprint = fingerprint(state.getData(), state.getSize());
+    const uint64_t stateStructure = structuralFingerprint(state);
+
+    // The followers copy every parameter change of the leader, so they can only
+    // still be in the state they were loaded with if the leader is as well
+    bool leaderMatches = true;
+    if (firstInstance == 0) {
+        const juce::ScopedLock lock(leaderLock);
+        juce::MemoryBlock leaderState;
+        instances[0]->getStateInformation(leaderState);
+        leaderMatches = fingerprint(leaderState.getData(), leaderState.getSize()) == stateFingerprint;
+        if (!leaderMatches) {
+            const juce::ScopedLock dexedLock(getDexedLock());
+            instances[0]->setStateInformation(state.getData(), static_cast<int>(state.getSize()));
+        }
+        loadedFingerprints[0] = stateFingerprint;
+        loadedStructures[0] = stateStructure;
+    }
+
+    const int count = numberOfInstances.load();
+    for (int i = juce::jmax(firstInstance, 1); i < count; i++) {
+        if (leaderMatches && loadedFingerprints[i].load() == stateFingerprint) {
+            continue;
+        }
+
+        // Same cartridge and settings: only the current voice differs, and copying
+        // the parameters of the leader takes care of that
+        if (stateStructure != 0 && loadedStructures[i].load() == stateStructure) {
+            loadedFingerprints[i] = stateFingerprint;
+            continue;
+        }
+
+        MULTIDEXED_TRACE_SCOPE("loadFollowerState", i);
+        {
+            const juce::ScopedLock dexedLock(getDexedLock());
+            instances[i]->setStateInformation(state.getData(), static_cast<int>(state.getSize()));
+        }
+        loadedFingerprints[i] = stateFingerprint;
+        loadedStructures[i] = stateStructure;
+    }
+}
+
+void StateReplicator::startLoad(juce::MemoryBlock *state, int firstInstance)
+{
+    jassert(phase.load() == idle);
+
+    loadingState = state;
+    loadingFrom = firstInstance;
+    loadFinished.reset();
+    phase.store(loading, std::memory_order_release);
+    loadRequested.signal();
+}
+
+juce::MemoryBlock *StateReplicator::takeFinishedLoad()
+{
+    if (phase.load(std::memory_order_acquire) != finished) {
+        return nullptr;
+    }
+
+    phase.store(idle, std::memory_order_relaxed);
+    return loadingState;
+}
+
+void StateReplicator::getLeaderState(juce::MemoryBlock &state)
+{
+    const juce::ScopedLock lock(leaderLock);
+    instances[0]->getStateInformation(state);
+}
+
+void StateReplicator::waitUntilIdle()
+{
+    if (isLoading()) {
+        loadFinished.wait(-1);
+    }
+}
+
+void StateReplicator::run()
+{
+    while (!threadShouldExit()) {
+        loadRequested.wait(-1);
+
+        if (phase.load(std::memory_order_acquire) == loading) {
+            load(*loadingState, loadingFrom);
+            phase.store(finished, std::memory_order_release);
+            loadFinished.signal();
+        }
+    }
+
+    TraceRecorder::releaseThreadBuffer();
+}
@@ -0,0 +1,121 @@
+/*
+  ==============================================================================
+
+    Loads Dexed states into the plugin instances without blocking the audio
+    thread, and without loading anything that is already there.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <atomic>
+#include <memory>
+
+//==============================================================================
+/**
+    Copies a Dexed state blob into a range of instances.
+
+    Every instance remembers the fingerprint of the blob it was last loaded
+    with, so pushing the same state again costs a hash instead of a load.
+    Followers whose cartridge and settings already match the blob are not
+    loaded at all; they only need their parameters copied from the leader,
+    which ParameterSync does. The remaining followers are loaded one after
+    another on one thread: Dexed keeps lookup tables in globals shared by all
+    its instances and makes no promise that setStateInformation() may run in
+    several of them at once.
+
+    The audio thread starts a load with startLoad(), leaves the instances
+    from getFirstLoadingInstance() on alone while isLoading() returns true,
+    and picks up the result with takeFinishedLoad().
+ */
+class StateReplicator : private juce::Thread
+{
+public:
+    StateReplicator();
+    ~StateReplicator() override;
+
+    // Sets the instances to load into; instances[0] is the leader. Must not be called during a load.
+    void setInstances(juce::AudioProcessor *const *instances, int numberOfInstances);
+
+    // Replaces a single instance, or removes it if instance is nullptr. The index must not be below
+    // the number of instances loads go into.
+    void setInstance(int index, juce::AudioProcessor *instance);
+
+    // Number of instances loads go into. Must not be called during a load.
+    void setNumberOfInstances(int newNumberOfInstances);
+
+    // Whether loading the state into the instances from firstInstance on would change anything.
+    // Not for the audio thread, as it asks the leader for its state.
+    bool wouldChange(const juce::MemoryBlock &state, int firstInstance);
+
+    // Loads the state into the instances from firstInstance on, on the calling thread.
+    // Nothing else may use these instances meanwhile.
+    void load(const juce::MemoryBlock &state, int firstInstance);
+
+    // Starts load() on the background thread. The state must stay alive until takeFinishedLoad()
+    // returns it. Audio thread only; does not allocate.
+    void startLoad(juce::MemoryBlock *state, int firstInstance);
+
+    bool isLoading() const { return phase.load(std::memory_order_acquire) == loading; }
+
+    // Whether the calling thread is inside load(), e.g. to tell the changes the instances report
+    // while a state is loaded into them from changes made by the user
+    static bool isLoadingOnCurrentThread();
+
+    // Held around every setStateInformation() and setCurrentProgram() of a Dexed instance, on any
+    // thread and in every MultiDexed of the process, as Dexed keeps lookup tables in globals
+    static juce::CriticalSection &getDexedLock();
+
+    // First instance of the load in progress, or the number of instances if there is none
+    int getFirstLoadingInstance() const { return isLoading() ? loadingFrom : numberOfInstances.load(); }
+
+    // Returns the state of a load that finished since the last call, or nullptr. Audio thread only.
+    juce::MemoryBlock *takeFinishedLoad();
+
+    // Gets the state of the leader, which a load in progress may be replacing meanwhile. Not for the audio thread.
+    void getLeaderState(juce::MemoryBlock &state);
+
+    // Blocks until a load in progress has finished. Not for the audio thread.
+    void waitUntilIdle();
+
+    // FNV-1a hash of the blob
+    static uint64_t fingerprint(const void *data, size_t size);
+
+    // Fingerprint of what a Dexed state contains besides the current voice, i.e. what
+    // cannot be copied through parameters; 0 if the blob is not a state we understand
+    static uint64_t structuralFingerprint(const juce::MemoryBlock &state);
+
+private:
+    void run() override;
+
+    enum Phase
+    {
+        idle,
+        loading,
+        finished
+    };
+
+    juce::AudioProcessor *instances[64] = {};
+    std::atomic<int> numberOfInstances { 0 };
+
+    // Fingerprints of the blob each instance was last loaded with; 0 if unknown
+    std::atomic<uint64_t> loadedFingerprints[64];
+    std::atomic<uint64_t> loadedStructures[64];
+
+    // The load handed over by the audio thread
+    std::atomic<int> phase { idle };
+    juce::MemoryBlock *loadingState = nullptr;
+    int loadingFrom = 0;
+    juce::WaitableEvent loadRequested;
+
+    // Signalled when no load is in progress, for waitUntilIdle()
+    juce::WaitableEvent loadFinished { true };
+
+    // Held while the state of the leader is read or replaced
+    juce::CriticalSection leaderLock;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StateReplicator)
+};
@@ -0,0 +1,248 @@
+#include "TraceRecorder.h"
+#include "RealtimeLog.h"
+
+#include <cstring>
+
+namespace {
+
+struct Event
+{
+    const char *name;
+    juce::int64 startTicks;
+    juce::int64 endTicks;
+    int argument;
+};
+
+// Written by the thread that owns it and read by the writer thread
+struct ThreadBuffer
+{
+    enum State
+    {
+        free,
+        owned,
+        released
+    };
+
+    std::atomic<int> state { free };
+
+    // Counts the threads that owned the buffer, so that each shows up as a thread of its own
+    std::atomic<uint32_t> generation { 0 };
+    char threadName[32] = {};
+
+    Event events[TraceRecorder::eventsPerThread];
+    std::atomic<uint32_t> writePosition { 0 };
+    std::atomic<uint32_t> readPosition { 0 };
+    std::atomic<uint32_t> droppedEvents { 0 };
+};
+
+ThreadBuffer threadBuffers[TraceRecorder::maximumNumberOfThreads];
+
+// Bumped when all buffers are taken back, after which threads have to ask for one again
+std::atomic<uint32_t> bufferEpoch { 1 };
+
+// Plain data, so that nothing of ours runs when a thread ends, which may be after the plugin was unloaded
+struct ThreadBufferOwner
+{
+    ThreadBuffer *buffer;
+    uint32_t epoch;
+};
+
+thread_local ThreadBufferOwner threadBufferOwner {};
+
+ThreadBuffer *getThreadBuffer()
+{
+    auto &owner = threadBufferOwner;
+    const uint32_t epoch = bufferEpoch.load(std::memory_order_acquire);
+    if (owner.epoch == epoch) {
+        return owner.buffer;
+    }
+
+    owner.epoch = epoch;
+    owner.buffer = nullptr;
+    for (auto &buffer : threadBuffers) {
+        int expected = ThreadBuffer::free;
+        if (buffer.state.compare_exchange_strong(expected, ThreadBuffer::owned, std::memory_order_acquire)) {
+            // Threads the host created have no juce::Thread
+            if (auto *thread = juce::Thread::getCurrentThread()) {
+                thread->getThreadName().copyToUTF8(buffer.threadName, sizeof(buffer.threadName));
+            } else {
+                std::memcpy(buffer.threadName, "Host thread", sizeof("Host thread"));
+            }
+            buffer.generation.fetch_add(1, std::memory_order_release);
+            owner.buffer = &buffer;
+            break;
+        }
+    }
+
+    // Without a buffer, because all of them are taken, this thread is not traced
+    return owner.buffer;
+}
+
+// Event data goes into JSON strings; the names are literals of ours, but thread names are not
+juce::String escape(const juce::String &text)
+{
+    return text.replace("\\", "\\\\").replace("\"", "\\\"");
+}
+
+} // namespace
+
+TraceRecorder::TraceRecorder()
+    : juce::Thread("MultiDexed trace")
+{
+    if (juce::SystemStats::getEnvironmentVariable("MULTIDEXED_TRACE", {}) == "1") {
+        setEnabled(true);
+    }
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    setEnabled(false);
+
+    // Take back the buffers of the threads that are still around, such as those of the host
+    for (auto &buffer : threadBuffers) {
+        buffer.writePosition.store(0, std::memory_order_relaxed);
+        buffer.readPosition.store(0, std::memory_order_relaxed);
+        buffer.state.store(ThreadBuffer::free, std::memory_order_release);
+    }
+    bufferEpoch.fetch_add(1, std::memory_order_acq_rel);
+}
+
+void TraceRecorder::releaseThreadBuffer()
+{
+    auto &owner = threadBufferOwner;
+    if (owner.buffer != nullptr && owner.epoch == bufferEpoch.load(std::memory_order_acquire)) {
+        owner.buffer->state.store(ThreadBuffer::released, std::memory_order_release);
+    }
+    owner.buffer = nullptr;
+}
+
+void TraceRecorder::record(const char *name, juce::int64 startTicks, juce::int64 endTicks, int argument)
+{
+    ThreadBuffer *buffer = getThreadBuffer();
+    if (buffer == nullptr) {
+        return;
+    }
+
+    const uint32_t position = buffer->writePosition.load(std::memory_order_relaxed);
+    if (position - buffer->readPosition.load(std::memory_order_acquire) >= static_cast<uint32_t>(eventsPerThread)) {
+        buffer->droppedEvents.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    buffer->events[position % eventsPerThread] = { name, startTicks, endTicks, argument };
+    buffer->writePosition.store(position + 1, std::memory_order_release);
+}
+
+void TraceRecorder::setEnabled(bool shouldBeEnabled)
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+
+    if (shouldBeEnabled == (stream != nullptr)) {
+        return;
+    }
+
+    if (shouldBeEnabled) {
+        traceFile = RealtimeLog::getLogFile().getSiblingFile("MultiDexed-trace-" + juce::Time::getCurrentTime().formatted("%Y%m%d-%H%M%S") + ".json");
+        traceFile.getParentDirectory().createDirectory();
+        stream = std::make_unique<juce::FileOutputStream>(traceFile);
+        if (stream->failedToOpen()) {
+            RealtimeLog::write(RealtimeLog::Level::error, "Could not write the trace to {}", traceFile.getFullPathName());
+            stream = nullptr;
+            return;
+        }
+        stream->writeText("[\n", false, false, nullptr);
+        hasWrittenEvents = false;
+
+        // Events recorded by scopes that were still open when the previous trace ended are not part of this one
+        for (auto &buffer : threadBuffers) {
+            buffer.readPosition.store(buffer.writePosition.load(std::memory_order_acquire), std::memory_order_release);
+        }
+        for (auto &generation : namedGenerations) {
+            generation = 0;
+        }
+
+        traceStartTicks = juce::Time::getHighResolutionTicks();
+        enabled.store(true, std::memory_order_relaxed);
+        startThread(juce::Thread::Priority::low);
+        RealtimeLog::write(RealtimeLog::Level::info, "Tracing to {}", traceFile.getFullPathName());
+    } else {
+        enabled.store(false, std::memory_order_relaxed);
+        stopThread(2000);
+        writeEvents();
+        stream->writeText("\n]\n", false, false, nullptr);
+        stream = nullptr;
+        RealtimeLog::write(RealtimeLog::Level::info, "Trace written to {}", traceFile.getFullPathName());
+    }
+}
+
+void TraceRecorder::run()
+{
+    while (!threadShouldExit()) {
+        wait(100);
+        writeEvents();
+    }
+}
+
+void TraceRecorder::writeEvents()
+{
+    if (stream == nullptr) {
+        return;
+    }
+
+    const double ticksPerMicrosecond = juce::Time::getHighResolutionTicksPerSecond() / 1.0e6;
+    juce::String text;
+    auto addEvent = [this, &text](const juce::String &event) {
+        if (hasWrittenEvents) {
+            text << ",\n";
+        }
+        text << event;
+        hasWrittenEvents = true;
+    };
+
+    for (int slot = 0; slot < maximumNumberOfThreads; slot++) {
+        auto &buffer = threadBuffers[slot];
+        const int state = buffer.state.load(std::memory_order_acquire);
+        if (state == ThreadBuffer::free) {
+            continue;
+        }
+
+        const uint32_t generation = buffer.generation.load(std::memory_order_acquire);
+        const juce::String threadID = juce::String(slot + 1) + juce::String(generation).paddedLeft('0', 3);
+        if (namedGenerations[slot] != generation) {
+            namedGenerations[slot] = generation;
+            addEvent("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + threadID
+                     + ",\"args\":{\"name\":\"" + escape(juce::String::fromUTF8(buffer.threadName)) + "\"}}");
+        }
+
+        const uint32_t end = buffer.writePosition.load(std::memory_order_acquire);
+        for (uint32_t position = buffer.readPosition.load(std::memory_order_relaxed); position != end; position++) {
+            const Event &event = buffer.events[position % eventsPerThread];
+            juce::String line;
+            line << "{\"name\":\"" << event.name << "\",\"cat\":\"MultiDexed\",\"ph\":\"X\",\"pid\":1,\"tid\":" << threadID
+                 << ",\"ts\":" << juce::String((event.startTicks - traceStartTicks) / ticksPerMicrosecond, 1)
+                 << ",\"dur\":" << juce::String((event.endTicks - event.startTicks) / ticksPerMicrosecond, 1);
+            if (event.argument >= 0) {
+                line << ",\"args\":{\"index\":" << event.argument << "}";
+            }
+            line << "}";
+            addEvent(line);
+        }
+        buffer.readPosition.store(end, std::memory_order_release);
+
+        if (const uint32_t dropped = buffer.droppedEvents.exchange(0, std::memory_order_relaxed)) {
+            RealtimeLog::write(RealtimeLog::Level::warning, "Trace events dropped on {}: {}", juce::String::fromUTF8(buffer.threadName), dropped);
+        }
+
+        // The thread has ended and everything it recorded is written
+        if (state == ThreadBuffer::released) {
+            buffer.writePosition.store(0, std::memory_order_relaxed);
+            buffer.readPosition.store(0, std::memory_order_relaxed);
+            buffer.state.store(ThreadBuffer::free, std::memory_order_release);
+        }
+    }
+
+    if (text.isNotEmpty()) {
+        stream->writeText(text, false, false, nullptr);
+        stream->flush();
+    }
+}
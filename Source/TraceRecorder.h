@@ -0,0 +1,100 @@
+/*
+  ==============================================================================
+
+    Records how long the phases of a block take, for viewing in Chrome's
+    about:tracing or in Perfetto.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <atomic>
+
+//==============================================================================
+/**
+    Scopes placed with MULTIDEXED_TRACE_SCOPE record their start and duration
+    into a buffer of the thread they run on. Each thread gets one of
+    maximumNumberOfThreads preallocated buffers the first time it records.
+    Threads of ours give it back with releaseThreadBuffer() before they end;
+    the buffers of the host's threads are taken back when the last recorder
+    goes away. Recording does not lock, allocate or make system calls, and
+    drops events if the buffer is full. While tracing is off, a scope costs
+    one relaxed atomic load.
+
+    While tracing is on, a background thread moves the events into a Chrome
+    trace file (JSON array format) next to the log, which Perfetto opens as
+    well. Tracing is switched with setEnabled(), from the editor, or on from
+    the start by setting the environment variable MULTIDEXED_TRACE to 1.
+
+    Keep one alive with a juce::SharedResourcePointer<TraceRecorder>.
+ */
+class TraceRecorder : private juce::Thread
+{
+public:
+    TraceRecorder();
+    ~TraceRecorder() override;
+
+    static constexpr int maximumNumberOfThreads = 32;
+    static constexpr int eventsPerThread = 4096;
+
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+    // Starts writing a new trace file, or finishes the current one. Message thread only.
+    void setEnabled(bool shouldBeEnabled);
+
+    // The file being written, or the last one that was
+    juce::File getTraceFile() const { return traceFile; }
+
+    // Gives the buffer of the calling thread back; call at the end of a thread that may have recorded
+    static void releaseThreadBuffer();
+
+    // name must be a string literal; argument is shown as "index" unless it is negative
+    static void record(const char *name, juce::int64 startTicks, juce::int64 endTicks, int argument);
+
+    class Scope
+    {
+    public:
+        explicit Scope(const char *scopeName, int scopeArgument = -1) noexcept
+            : name(scopeName), argument(scopeArgument), startTicks(isEnabled() ? juce::Time::getHighResolutionTicks() : 0)
+        {
+        }
+
+        ~Scope()
+        {
+            if (startTicks != 0) {
+                record(name, startTicks, juce::Time::getHighResolutionTicks(), argument);
+            }
+        }
+
+    private:
+        const char *name;
+        int argument;
+        juce::int64 startTicks;
+
+        JUCE_DECLARE_NON_COPYABLE(Scope)
+    };
+
+private:
+    void run() override;
+
+    // Moves the recorded events into the file
+    void writeEvents();
+
+    inline static std::atomic<bool> enabled { false };
+
+    juce::File traceFile;
+    std::unique_ptr<juce::FileOutputStream> stream;
+    bool hasWrittenEvents = false;
+    juce::int64 traceStartTicks = 0;
+
+    // Generation of the thread whose name was last written for each buffer
+    uint32_t namedGenerations[maximumNumberOfThreads] = {};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(TraceRecorder)
+};
+
+// Records the time until the end of the enclosing block under the given name, and optionally an index
+#define MULTIDEXED_TRACE_SCOPE(...) TraceRecorder::Scope JUCE_JOIN_MACRO(traceScope, __LINE__)(__VA_ARGS__)
@@ -0,0 +1,41 @@
+#include "UnisonGovernor.h"
+
+#include <cmath>
+
+void UnisonGovernor::update(double processSeconds, double blockSeconds, int numberOfVoices)
+{
+    if (blockSeconds <= 0.0 || numberOfVoices < 1) {
+        return;
+    }
+
+    // The weight of a block depends on its length, so that the smoothing time does not
+    const float weight = static_cast<float>(1.0 - std::exp(-blockSeconds / smoothingSeconds));
+    float smoothedLoad = load.load(std::memory_order_relaxed);
+    smoothedLoad += weight * (static_cast<float>(processSeconds / blockSeconds) - smoothedLoad);
+    load.store(smoothedLoad, std::memory_order_relaxed);
+
+    shedVoices = juce::jmin(shedVoices, numberOfVoices - 1);
+
+    secondsSinceChange += blockSeconds;
+    if (secondsSinceChange < holdSeconds) {
+        return;
+    }
+
+    // Assumes that the load is mostly the voices, which is what makes shedding them worthwhile
+    const int renderedVoices = numberOfVoices - shedVoices;
+    if (smoothedLoad > shedLoad && renderedVoices > 1) {
+        const int keep = static_cast<int>(renderedVoices * targetLoad / smoothedLoad);
+        shedVoices = numberOfVoices - juce::jlimit(1, renderedVoices - 1, keep);
+        secondsSinceChange = 0.0;
+    } else if (shedVoices > 0 && smoothedLoad * (renderedVoices + 1) / renderedVoices < targetLoad) {
+        shedVoices--;
+        secondsSinceChange = 0.0;
+    }
+}
+
+void UnisonGovernor::reset()
+{
+    load.store(0.0f, std::memory_order_relaxed);
+    shedVoices = 0;
+    secondsSinceChange = 0.0;
+}
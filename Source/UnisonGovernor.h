@@ -0,0 +1,60 @@
+/*
+  ==============================================================================
+
+    Decides how many unison voices to leave out while processBlock takes
+    too much of the time the host gives it.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <atomic>
+
+//==============================================================================
+/**
+    Tracks the share of the block time spent in processBlock, smoothed over a
+    few hundred milliseconds, and turns it into a number of voices to shed.
+
+    Under sustained overload it sheds as many voices as it takes to bring the
+    load down to targetLoad; once the load is low enough that bringing back a
+    voice would still leave it well below shedLoad, it restores one voice at a
+    time. After every change it waits holdSeconds before changing again, so
+    that the load can settle. Called on the audio thread only; does not lock
+    or allocate.
+ */
+class UnisonGovernor
+{
+public:
+    UnisonGovernor() = default;
+
+    // Sheds voices when the smoothed load goes above this
+    static constexpr float shedLoad = 0.85f;
+
+    // What shedding aims for, and the most that restoring a voice may bring the load to
+    static constexpr float targetLoad = 0.7f;
+
+    static constexpr double smoothingSeconds = 0.3;
+    static constexpr double holdSeconds = 0.5;
+
+    // Records a block and updates the number of voices to shed out of numberOfVoices
+    void update(double processSeconds, double blockSeconds, int numberOfVoices);
+
+    // Restores all voices and forgets the load
+    void reset();
+
+    // Never more than numberOfVoices - 1 of the latest update(), so at least one voice is left
+    int getNumberOfShedVoices() const { return shedVoices; }
+
+    // Smoothed share of the block time, 1.0 being the whole block; may be read from any thread
+    float getLoad() const { return load.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<float> load { 0.0f };
+    int shedVoices = 0;
+    double secondsSinceChange = 0.0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(UnisonGovernor)
+};
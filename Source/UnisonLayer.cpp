@@ -0,0 +1,361 @@
+#include "UnisonLayer.h"
+#include "StateReplicator.h"
+
+namespace {
+
+// "keyRangeLow" as is, or "layer2KeyRangeLow" with a prefix
+juce::String makeParameterID(const juce::String &idPrefix, const juce::String &name)
+{
+    if (idPrefix.isEmpty()) {
+        return name;
+    }
+    return idPrefix + name.substring(0, 1).toUpperCase() + name.substring(1);
+}
+
+juce::String getIDPrefix(int layerNumber)
+{
+    return "layer" + juce::String(layerNumber);
+}
+
+} // namespace
+
+//==============================================================================
+void NoteRange::addParameters(std::vector<std::unique_ptr<juce::RangedAudioParameter>> &parameters,
+                              const juce::String &idPrefix, const juce::String &namePrefix)
+{
+    parameters.push_back(std::make_unique<juce::AudioParameterInt>(makeParameterID(idPrefix, "keyRangeLow"), // parameterID
+                                                        namePrefix + "Lowest Key", // parameter name
+                                                        0,   // minimum value
+                                                        127, // maximum value
+                                                        0)); // default value
+    parameters.push_back(std::make_unique<juce::AudioParameterInt>(makeParameterID(idPrefix, "keyRangeHigh"), // parameterID
+                                                        namePrefix + "Highest Key", // parameter name
+                                                        0,   // minimum value
+                                                        127, // maximum value
+                                                        127)); // default value
+    parameters.push_back(std::make_unique<juce::AudioParameterInt>(makeParameterID(idPrefix, "velocityRangeLow"), // parameterID
+                                                        namePrefix + "Lowest Velocity", // parameter name
+                                                        1,   // minimum value
+                                                        127, // maximum value
+                                                        1)); // default value
+    parameters.push_back(std::make_unique<juce::AudioParameterInt>(makeParameterID(idPrefix, "velocityRangeHigh"), // parameterID
+                                                        namePrefix + "Highest Velocity", // parameter name
+                                                        1,   // minimum value
+                                                        127, // maximum value
+                                                        127)); // default value
+}
+
+void NoteRange::attach(juce::AudioProcessorValueTreeState &apvts, const juce::String &idPrefix)
+{
+    lowestKey = apvts.getRawParameterValue(makeParameterID(idPrefix, "keyRangeLow"));
+    highestKey = apvts.getRawParameterValue(makeParameterID(idPrefix, "keyRangeHigh"));
+    lowestVelocity = apvts.getRawParameterValue(makeParameterID(idPrefix, "velocityRangeLow"));
+    highestVelocity = apvts.getRawParameterValue(makeParameterID(idPrefix, "velocityRangeHigh"));
+}
+
+bool NoteRange::coversEverything() const
+{
+    return lowestKey->load() <= 0.0f && highestKey->load() >= 127.0f
+        && lowestVelocity->load() <= 1.0f && highestVelocity->load() >= 127.0f;
+}
+
+void NoteRange::filter(const juce::MidiBuffer &source, juce::MidiBuffer &destination, int numSamples) const
+{
+    const int keyLow = static_cast<int>(lowestKey->load());
+    const int keyHigh = static_cast<int>(highestKey->load());
+    const int velocityLow = static_cast<int>(lowestVelocity->load());
+    const int velocityHigh = static_cast<int>(highestVelocity->load());
+
+    destination.clear();
+    for (const auto metadata : source) {
+        if (metadata.samplePosition >= numSamples) {
+            break;
+        }
+
+        // Note-on: 0x9n key velocity, where a velocity of 0 is a note-off
+        const juce::uint8 *data = metadata.data;
+        if (metadata.numBytes == 3 && (data[0] & 0xf0) == 0x90 && data[2] != 0) {
+            if (data[1] < keyLow || data[1] > keyHigh || data[2] < velocityLow || data[2] > velocityHigh) {
+                continue;
+            }
+        }
+        destination.addEvent(data, metadata.numBytes, metadata.samplePosition);
+    }
+}
+
+//==============================================================================
+UnisonLayer::UnisonLayer()
+{
+    // Every voice has its own detune, so voice 0 must not overwrite it
+    parameterSync.excludeParameter(ParameterSync::detuneParameterIndex);
+}
+
+UnisonLayer::~UnisonLayer()
+{
+    if (voices[0] != nullptr) {
+        removeLeaderListeners();
+    }
+    parameterSync.detach();
+
+    for (auto &voice : voices) {
+        if (voice != nullptr) {
+            delete voice->getActiveEditor();
+            voice->releaseResources();
+        }
+    }
+}
+
+void UnisonLayer::addParameters(std::vector<std::unique_ptr<juce::RangedAudioParameter>> &parameters, int layerNumber)
+{
+    const juce::String idPrefix = getIDPrefix(layerNumber);
+    const juce::String namePrefix = "Layer " + juce::String(layerNumber) + " ";
+
+    parameters.push_back(std::make_unique<juce::AudioParameterInt>(idPrefix + "Voices", // parameterID
+                                                        namePrefix + "Voices", // parameter name
+                                                        0,   // minimum value
+                                                        maximumNumberOfVoices, // maximum value
+                                                        0)); // default value
+    parameters.push_back(std::make_unique<juce::AudioParameterFloat>(idPrefix + "DetuneSpread", // parameterID
+                                                        namePrefix + "Detune Spread", // parameter name
+                                                        0.0f,   // minimum value
+                                                        0.4f,   // maximum value
+                                                        0.1f)); // default value
+    parameters.push_back(std::make_unique<juce::AudioParameterFloat>(idPrefix + "PanSpread", // parameterID
+                                                        namePrefix + "Pan Spread", // parameter name
+                                                        0.0f,   // minimum value
+                                                        1.0f,   // maximum value
+                                                        1.0f)); // default value
+    NoteRange::addParameters(parameters, idPrefix, namePrefix);
+}
+
+void UnisonLayer::attach(juce::AudioProcessorValueTreeState &apvts, int layerNumber)
+{
+    const juce::String idPrefix = getIDPrefix(layerNumber);
+    voicesParameter = apvts.getRawParameterValue(idPrefix + "Voices");
+    detuneSpreadParameter = apvts.getRawParameterValue(idPrefix + "DetuneSpread");
+    panSpreadParameter = apvts.getRawParameterValue(idPrefix + "PanSpread");
+    noteRange.attach(apvts, idPrefix);
+}
+
+int UnisonLayer::getWantedNumberOfVoices() const
+{
+    return juce::jlimit(0, maximumNumberOfVoices, static_cast<int>(voicesParameter->load()));
+}
+
+void UnisonLayer::addVoice(int index, std::unique_ptr<juce::AudioProcessor> voice)
+{
+    jassert(index >= renderedVoices.load());
+    jassert(index == 0 || voices[0] != nullptr);
+
+    if (index == 0) {
+        // Nothing of the layer is rendered, so the index maps can be built now
+        parameterSync.attach(voice.get(), maximumNumberOfVoices);
+        leaderProgram = voice->getCurrentProgram();
+        voices[0] = std::move(voice);
+        addLeaderListeners();
+    } else {
+        parameterSync.setFollower(index, voice.get());
+        voices[static_cast<size_t>(index)] = std::move(voice);
+    }
+}
+
+void UnisonLayer::resynchronizeVoice(int index)
+{
+    jassert(index >= renderedVoices.load());
+
+    if (parameterSync.isAttached()) {
+        parameterSync.resynchronize(index);
+    }
+}
+
+void UnisonLayer::removeVoice(int index)
+{
+    auto &voice = voices[static_cast<size_t>(index)];
+    if (voice == nullptr) {
+        return;
+    }
+
+    if (index == 0) {
+        // Keep the patch for when the layer is switched on again, unless a new one is waiting
+        if (firstVoiceToReload.load() > 0) {
+            const juce::ScopedLock lock(stateLock);
+            voice->getStateInformation(state);
+        }
+        removeLeaderListeners();
+        parameterSync.detach();
+    } else {
+        parameterSync.setFollower(index, nullptr);
+    }
+
+    // The editor has no tab any more, but it still exists
+    delete voice->getActiveEditor();
+    voice->releaseResources();
+    voice.reset();
+}
+
+juce::MemoryBlock UnisonLayer::getState() const
+{
+    if (voices[0] != nullptr && firstVoiceToReload.load() > 0) {
+        juce::MemoryBlock leaderState;
+        voices[0]->getStateInformation(leaderState);
+        return leaderState;
+    }
+
+    const juce::ScopedLock lock(stateLock);
+    return state;
+}
+
+void UnisonLayer::setState(const juce::MemoryBlock &newState)
+{
+    // Hosts like to push the same state again, e.g. on undo; that does not need the voices created again
+    if (newState == getState()) {
+        return;
+    }
+
+    {
+        const juce::ScopedLock lock(stateLock);
+        state = newState;
+    }
+    requestReload(0);
+}
+
+int UnisonLayer::getFirstVoiceToReload()
+{
+    // Dexed does not report all program changes, so voice 0 is asked; like in the main group, the
+    // followers get the new program through parameterSync
+    if (voices[0] != nullptr) {
+        const int program = voices[0]->getCurrentProgram();
+        if (program != leaderProgram) {
+            leaderProgram = program;
+            parameterSync.markAllDirty();
+        }
+    }
+    return firstVoiceToReload.load();
+}
+
+void UnisonLayer::reloadVoice(int index)
+{
+    jassert(index > 0 && index >= renderedVoices.load());
+
+    juce::MemoryBlock leaderState;
+    voices[0]->getStateInformation(leaderState);
+
+    const juce::ScopedLock dexedLock(StateReplicator::getDexedLock());
+    voices[static_cast<size_t>(index)]->setStateInformation(leaderState.getData(), static_cast<int>(leaderState.getSize()));
+}
+
+void UnisonLayer::parameterValueChanged(int parameterIndex, float)
+{
+    parameterSync.markDirty(parameterIndex);
+
+    // The followers only get a new cartridge through their state, see reloadVoice()
+    if (parameterIndex == ParameterSync::cartridgeParameterIndex) {
+        requestReload(1);
+    }
+}
+
+void UnisonLayer::requestReload(int firstVoice)
+{
+    // Whatever is requested first and reaches furthest down wins
+    int expected = firstVoiceToReload.load();
+    while (expected > firstVoice && !firstVoiceToReload.compare_exchange_weak(expected, firstVoice)) {
+    }
+}
+
+void UnisonLayer::addLeaderListeners()
+{
+    for (auto *parameter : voices[0]->getParameters()) {
+        parameter->addListener(this);
+    }
+}
+
+void UnisonLayer::removeLeaderListeners()
+{
+    for (auto *parameter : voices[0]->getParameters()) {
+        parameter->removeListener(this);
+    }
+}
+
+void UnisonLayer::reserveMidi()
+{
+    filteredMidi.ensureSize(4096);
+    for (auto &midi : midiBuffers) {
+        midi.ensureSize(4096);
+    }
+}
+
+void UnisonLayer::setActiveVoices(int newNumberOfVoices, int newNumberOfRenderedVoices)
+{
+    activeVoices = newNumberOfVoices;
+    setRenderedVoices(newNumberOfRenderedVoices);
+
+    // Spread across the stereo field like the main group; voices fading out keep their pans
+    for (int v = 0; v < newNumberOfVoices; v++) {
+        pans[v] = newNumberOfVoices > 1 ? v / (newNumberOfVoices - 1.0f) : 0.5f;
+    }
+
+    // New voices were brought up to date with voice 0 before the command was posted; their
+    // mute parameter may have changed then
+    if (parameterSync.isAttached()) {
+        parameterSync.refreshMuteFlags();
+    }
+    updateDetune(true);
+}
+
+void UnisonLayer::setRenderedVoices(int newNumberOfRenderedVoices)
+{
+    renderedVoices.store(newNumberOfRenderedVoices, std::memory_order_relaxed);
+    if (parameterSync.isAttached()) {
+        parameterSync.setNumberOfInstancesInUse(newNumberOfRenderedVoices);
+    }
+}
+
+void UnisonLayer::prepareBlock(const juce::MidiBuffer &midiMessages, int numSamples)
+{
+    const int rendered = renderedVoices.load(std::memory_order_relaxed);
+    if (rendered == 0) {
+        return;
+    }
+
+    parameterSync.flush();
+
+    const bool filter = !noteRange.coversEverything();
+    if (filter) {
+        noteRange.filter(midiMessages, filteredMidi, numSamples);
+    }
+
+    // Every voice gets the same MIDI, but in a buffer of its own
+    for (int v = 0; v < rendered; v++) {
+        midiBuffers[static_cast<size_t>(v)].clear();
+        midiBuffers[static_cast<size_t>(v)].addEvents(filter ? filteredMidi : midiMessages, 0, numSamples, 0);
+    }
+}
+
+void UnisonLayer::updateDetune(bool force)
+{
+    const float range = detuneSpreadParameter->load();
+    if (!force && range == appliedDetuneSpread) {
+        return;
+    }
+    appliedDetuneSpread = range;
+
+    // Voice 0 is played too, so all voices are spread symmetrically around the center
+    for (int v = 0; v < activeVoices; v++) {
+        if (auto *voice = voices[static_cast<size_t>(v)].get()) {
+            const double detune = 0.5 - range / 2.0 + (v + 0.5) * range / activeVoices;
+            // Not notifying, as for the followers of the main group
+            voice->getParameters()[ParameterSync::detuneParameterIndex]->setValue(static_cast<float>(detune));
+        }
+    }
+}
+
+uint64_t UnisonLayer::getUnmutedVoices() const
+{
+    uint64_t unmuted = parameterSync.getUnmutedInstances();
+    if (auto *mute = parameterSync.getParameter(0, ParameterSync::muteParameterIndex)) {
+        if (mute->getValue() > 0.0f) {
+            unmuted |= 1;
+        }
+    }
+    return unmuted;
+}
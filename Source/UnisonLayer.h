@@ -0,0 +1,195 @@
+/*
+  ==============================================================================
+
+    A further group of Dexed instances that plays a patch of its own on top
+    of the main unison group, for layers and keyboard splits.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "ParameterSync.h"
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+//==============================================================================
+/**
+    The keys and velocities a group of instances plays, from four apvts
+    parameters. Note-ons outside the range are left out of the MIDI of the
+    group; everything else passes, so that notes always end.
+ */
+class NoteRange
+{
+public:
+    // Adds "keyRangeLow", "keyRangeHigh", "velocityRangeLow" and "velocityRangeHigh", prefixed
+    // with idPrefix if it is not empty, e.g. "layer2KeyRangeLow"
+    static void addParameters(std::vector<std::unique_ptr<juce::RangedAudioParameter>> &parameters,
+                              const juce::String &idPrefix, const juce::String &namePrefix);
+
+    void attach(juce::AudioProcessorValueTreeState &apvts, const juce::String &idPrefix);
+
+    // Whether every note passes, so that the MIDI need not be filtered
+    bool coversEverything() const;
+
+    // Copies the events of source before numSamples into destination, except the note-ons outside
+    // the range. Does not allocate as long as destination has room.
+    void filter(const juce::MidiBuffer &source, juce::MidiBuffer &destination, int numSamples) const;
+
+private:
+    std::atomic<float> *lowestKey = nullptr;
+    std::atomic<float> *highestKey = nullptr;
+    std::atomic<float> *lowestVelocity = nullptr;
+    std::atomic<float> *highestVelocity = nullptr;
+};
+
+//==============================================================================
+/**
+    Up to maximumNumberOfVoices Dexed instances that play one patch, detuned
+    and panned like the main group, within a NoteRange. Voice 0 leads: its
+    editor is where the patch is edited and its parameters are copied to the
+    other voices, but unlike instance 0 of the main group it is played and
+    mixed as well. The layer is off while its voices parameter is 0.
+
+    The processor renders the voices on its render pool and mixes them in the
+    same pass as the main group, in slots of its buffer arena after those of
+    the main instances. Voices are created and torn down on the message thread
+    like the main instances; the audio thread learns about them through
+    setLayerVoices commands.
+
+    The patch is kept as a Dexed state while the layer is off, and voices are
+    created from it. A program change in voice 0 is passed on through
+    parameterSync, and a cartridge change by loading the state of voice 0
+    into the other voices once they have faded out, see getFirstVoiceToReload().
+ */
+class UnisonLayer : private juce::AudioProcessorParameter::Listener
+{
+public:
+    UnisonLayer();
+    ~UnisonLayer() override;
+
+    static constexpr int maximumNumberOfVoices = 8;
+
+    // Adds the parameters of the layer with the given number, 2 and up, e.g. "layer2Voices"
+    static void addParameters(std::vector<std::unique_ptr<juce::RangedAudioParameter>> &parameters, int layerNumber);
+    void attach(juce::AudioProcessorValueTreeState &apvts, int layerNumber);
+
+    //==============================================================================
+    // Message thread, with the instanceLock of the processor held
+
+    // What the voices parameter asks for
+    int getWantedNumberOfVoices() const;
+
+    // The voices created for the audio thread, including those it has not been told about yet
+    std::atomic<int> numberOfVoices { 0 };
+
+    // Number of setLayerVoices commands posted but not applied yet
+    std::atomic<int> pendingVoiceCountChanges { 0 };
+
+    // Set when creating voices failed, so that it is not retried until the voices parameter changes
+    int failedNumberOfVoices = 0;
+
+    juce::AudioProcessor *getVoice(int index) const { return voices[static_cast<size_t>(index)].get(); }
+
+    // Adds a voice the audio thread does not render yet; voice 0 must be added first
+    void addVoice(int index, std::unique_ptr<juce::AudioProcessor> voice);
+
+    // Tears down a voice the audio thread no longer renders; voice 0 leaves its patch behind as the state
+    void removeVoice(int index);
+
+    // Copies the parameters of voice 0 into a voice the audio thread does not render yet, right before
+    // it is put in use: new voices start out as copies of voice 0, but it may have changed since
+    void resynchronizeVoice(int index);
+
+    // The patch of the layer: the state of voice 0, or what was kept of it; empty if there never was one
+    juce::MemoryBlock getState() const;
+
+    // Replaces the patch; voices that exist are created again with it
+    void setState(const juce::MemoryBlock &newState);
+
+    // The voices from this one on have to get a new patch, maximumNumberOfVoices if none: voice 0 and
+    // the others by being created again, the others after a cartridge change in voice 0 by reloadVoice().
+    // Also notices when voice 0 has selected another program, which parameterSync passes on.
+    int getFirstVoiceToReload();
+    void finishReload() { firstVoiceToReload = maximumNumberOfVoices; }
+
+    // Loads the state of voice 0 into a voice other than 0 that the audio thread does not render
+    void reloadVoice(int index);
+
+    //==============================================================================
+    // Audio thread
+
+    // The voices that are rendered, including those still fading out
+    std::atomic<int> renderedVoices { 0 };
+
+    // The number of voices at the latest setLayerVoices command
+    int activeVoices = 0;
+
+    // Sets the voices in use and the pans for a new number of voices
+    void setActiveVoices(int newNumberOfVoices, int newNumberOfRenderedVoices);
+
+    // Stops rendering the voices from newNumberOfRenderedVoices on, once they have faded out
+    void setRenderedVoices(int newNumberOfRenderedVoices);
+
+    // Filters the MIDI of the block for the voices and copies the changes to voice 0 into the others
+    void prepareBlock(const juce::MidiBuffer &midiMessages, int numSamples);
+
+    // The MIDI for the voice in the current block
+    juce::MidiBuffer &getMidiBuffer(int index) { return midiBuffers[static_cast<size_t>(index)]; }
+
+    // Detunes the voices if detune or the number of voices changed
+    void updateDetune(bool force);
+
+    // Bit v set if voice v is not muted
+    uint64_t getUnmutedVoices() const;
+
+    // Pan of every voice between 0 (left) and 1 (right); voices fading out keep theirs
+    float getPan(int index) const { return pans[index]; }
+
+    float getPanSpread() const { return panSpreadParameter->load(); }
+
+    // The pan spread and unmuted voices the mixer gains of the layer were last computed for
+    float gainsPanSpread = -1.0f;
+    uint64_t gainsUnmutedVoices = 0;
+
+    // Room for the MIDI of a block, so that prepareBlock() does not allocate. Not for the audio thread.
+    void reserveMidi();
+
+private:
+    // Voice 0 is listened to for its parameter changes
+    void parameterValueChanged(int parameterIndex, float newValue) override;
+    void parameterGestureChanged(int, bool) override {}
+
+    // Lowers firstVoiceToReload to firstVoice unless it is lower already. Any thread.
+    void requestReload(int firstVoice);
+
+    void addLeaderListeners();
+    void removeLeaderListeners();
+
+    // Declared before parameterSync, whose mute listeners must go first
+    std::array<std::unique_ptr<juce::AudioProcessor>, maximumNumberOfVoices> voices;
+    ParameterSync parameterSync;
+
+    mutable juce::CriticalSection stateLock;
+    juce::MemoryBlock state;
+
+    std::atomic<int> firstVoiceToReload { maximumNumberOfVoices };
+    int leaderProgram = -1;
+
+    NoteRange noteRange;
+    juce::MidiBuffer filteredMidi;
+    std::array<juce::MidiBuffer, maximumNumberOfVoices> midiBuffers;
+
+    float pans[maximumNumberOfVoices] = {};
+    float appliedDetuneSpread = -1.0f;
+
+    std::atomic<float> *voicesParameter = nullptr;
+    std::atomic<float> *detuneSpreadParameter = nullptr;
+    std::atomic<float> *panSpreadParameter = nullptr;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(UnisonLayer)
+};
@@ -0,0 +1,213 @@
+#include "UnisonMixer.h"
+
+#if JUCE_INTEL
+#  include <immintrin.h>
+#  if JUCE_MSVC
+#    define MULTIDEXED_TARGET_AVX2
+#  else
+#    define MULTIDEXED_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#  endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#  include <arm_neon.h>
+#  define MULTIDEXED_HAS_NEON 1
+#endif
+
+namespace {
+
+// A source count of 0 means the count is only known at run time
+
+template<int N>
+void mixScalar(float *destination, const float *const *sources, const float *gains,
+               int numberOfSources, int numberOfSamples)
+{
+    const int n = N > 0 ? N : numberOfSources;
+    for (int sample = 0; sample < numberOfSamples; sample++) {
+        float sum = 0.0f;
+        for (int i = 0; i < n; i++) {
+            sum += sources[i][sample] * gains[i];
+        }
+        destination[sample] = sum;
+    }
+}
+
+#if JUCE_INTEL
+
+template<int N>
+void mixSSE(float *destination, const float *const *sources, const float *gains,
+            int numberOfSources, int numberOfSamples)
+{
+    const int n = N > 0 ? N : numberOfSources;
+
+    __m128 gain[UnisonMixer::maximumNumberOfSources];
+    for (int i = 0; i < n; i++) {
+        gain[i] = _mm_set1_ps(gains[i]);
+    }
+
+    int sample = 0;
+    for (; sample + 4 <= numberOfSamples; sample += 4) {
+        __m128 sum = _mm_mul_ps(_mm_loadu_ps(sources[0] + sample), gain[0]);
+        for (int i = 1; i < n; i++) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(sources[i] + sample), gain[i]));
+        }
+        _mm_storeu_ps(destination + sample, sum);
+    }
+
+    for (; sample < numberOfSamples; sample++) {
+        float sum = 0.0f;
+        for (int i = 0; i < n; i++) {
+            sum += sources[i][sample] * gains[i];
+        }
+        destination[sample] = sum;
+    }
+}
+
+template<int N>
+MULTIDEXED_TARGET_AVX2 void mixAVX2(float *destination, const float *const *sources,
+                                    const float *gains, int numberOfSources, int numberOfSamples)
+{
+    const int n = N > 0 ? N : numberOfSources;
+
+    __m256 gain[UnisonMixer::maximumNumberOfSources];
+    for (int i = 0; i < n; i++) {
+        gain[i] = _mm256_set1_ps(gains[i]);
+    }
+
+    int sample = 0;
+    for (; sample + 8 <= numberOfSamples; sample += 8) {
+        __m256 sum = _mm256_mul_ps(_mm256_loadu_ps(sources[0] + sample), gain[0]);
+        for (int i = 1; i < n; i++) {
+            sum = _mm256_fmadd_ps(_mm256_loadu_ps(sources[i] + sample), gain[i], sum);
+        }
+        _mm256_storeu_ps(destination + sample, sum);
+    }
+
+    for (; sample < numberOfSamples; sample++) {
+        float sum = 0.0f;
+        for (int i = 0; i < n; i++) {
+            sum += sources[i][sample] * gains[i];
+        }
+        destination[sample] = sum;
+    }
+}
+
+#endif
+
+#if MULTIDEXED_HAS_NEON
+
+template<int N>
+void mixNEON(float *destination, const float *const *sources, const float *gains,
+             int numberOfSources, int numberOfSamples)
+{
+    const int n = N > 0 ? N : numberOfSources;
+
+    int sample = 0;
+    for (; sample + 4 <= numberOfSamples; sample += 4) {
+        float32x4_t sum = vmulq_n_f32(vld1q_f32(sources[0] + sample), gains[0]);
+        for (int i = 1; i < n; i++) {
+            sum = vfmaq_n_f32(sum, vld1q_f32(sources[i] + sample), gains[i]);
+        }
+        vst1q_f32(destination + sample, sum);
+    }
+
+    for (; sample < numberOfSamples; sample++) {
+        float sum = 0.0f;
+        for (int i = 0; i < n; i++) {
+            sum += sources[i][sample] * gains[i];
+        }
+        destination[sample] = sum;
+    }
+}
+
+#endif
+
+// Fills the kernel table with the specializations of Kernel for 1..8 sources and the generic one
+#define MULTIDEXED_FILL_KERNELS(Kernel)                                                            \
+    specializedKernels[1] = Kernel<1>;                                                             \
+    specializedKernels[2] = Kernel<2>;                                                             \
+    specializedKernels[3] = Kernel<3>;                                                             \
+    specializedKernels[4] = Kernel<4>;                                                             \
+    specializedKernels[5] = Kernel<5>;                                                             \
+    specializedKernels[6] = Kernel<6>;                                                             \
+    specializedKernels[7] = Kernel<7>;                                                             \
+    specializedKernels[8] = Kernel<8>;                                                             \
+    genericKernel = Kernel<0>;
+
+} // namespace
+
+//==============================================================================
+UnisonMixer::UnisonMixer()
+{
+    // Pick the widest instruction set the CPU supports at run time
+#if JUCE_INTEL
+    if (juce::SystemStats::hasAVX2() && juce::SystemStats::hasFMA3()) {
+        MULTIDEXED_FILL_KERNELS(mixAVX2)
+        kernelName = "AVX2";
+    } else {
+        MULTIDEXED_FILL_KERNELS(mixSSE)
+        kernelName = "SSE";
+    }
+#elif MULTIDEXED_HAS_NEON
+    MULTIDEXED_FILL_KERNELS(mixNEON)
+    kernelName = "NEON";
+#else
+    MULTIDEXED_FILL_KERNELS(mixScalar)
+    kernelName = "Scalar";
+#endif
+}
+
+#undef MULTIDEXED_FILL_KERNELS
+
+void UnisonMixer::setGains(const float *leftGains, const float *rightGains, int numberOfSources)
+{
+    jassert(numberOfSources <= maximumNumberOfSources);
+
+    numberOfActiveSources = 0;
+    for (int i = 0; i < juce::jmin(numberOfSources, maximumNumberOfSources); i++) {
+        if (leftGains[i] != 0.0f || rightGains[i] != 0.0f) {
+            activeSources[numberOfActiveSources] = i;
+            activeLeftGains[numberOfActiveSources] = leftGains[i];
+            activeRightGains[numberOfActiveSources] = rightGains[i];
+            numberOfActiveSources++;
+        }
+    }
+}
+
+UnisonMixer::Kernel UnisonMixer::kernelFor(int numberOfSources) const
+{
+    if (numberOfSources <= numberOfSpecializedKernels) {
+        return specializedKernels[numberOfSources];
+    }
+    return genericKernel;
+}
+
+void UnisonMixer::mix(const juce::AudioBuffer<float> *sources,
+                      juce::AudioBuffer<float> &destination) const
+{
+    const int numberOfSamples = destination.getNumSamples();
+
+    if (numberOfActiveSources == 0) {
+        destination.clear();
+        return;
+    }
+
+    const float *leftSources[maximumNumberOfSources];
+    const float *rightSources[maximumNumberOfSources];
+    for (int i = 0; i < numberOfActiveSources; i++) {
+        const auto &source = sources[activeSources[i]];
+        leftSources[i] = source.getReadPointer(0);
+        rightSources[i] = source.getReadPointer(juce::jmin(1, source.getNumChannels() - 1));
+    }
+
+    Kernel kernel = kernelFor(numberOfActiveSources);
+
+    // Channel 0 is left, every further channel gets the right gains
+    for (int channel = 0; channel < destination.getNumChannels(); channel++) {
+        if (channel == 0) {
+            kernel(destination.getWritePointer(channel), leftSources, activeLeftGains,
+                   numberOfActiveSources, numberOfSamples);
+        } else {
+            kernel(destination.getWritePointer(channel), rightSources, activeRightGains,
+                   numberOfActiveSources, numberOfSamples);
+        }
+    }
+}
@@ -0,0 +1,62 @@
+/*
+  ==============================================================================
+
+    Mixes the buffers of the Dexed instances down into the stereo output
+    using a precomputed matrix of per-instance left/right gains.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    Sums the instance buffers into the output buffer.
+
+    The gains are set with setGains() whenever they change, not per block, and
+    sources with a gain of zero in both channels are skipped entirely. The
+    inner loop works on whole channel spans with float accumulation and is
+    implemented with SSE, AVX2 or NEON depending on what the CPU supports. It
+    is specialized at compile time for the common unison sizes.
+ */
+class UnisonMixer
+{
+public:
+    UnisonMixer();
+
+    // Upper bound for the number of sources that can be mixed
+    static constexpr int maximumNumberOfSources = 64;
+
+    // Sets the gains of all sources; sources whose gains are both zero are not mixed
+    void setGains(const float *leftGains, const float *rightGains, int numberOfSources);
+
+    // Overwrites channel 0 and 1 of destination with the weighted sum of the
+    // sources. sources must point to at least as many buffers as were passed
+    // to setGains(). Does not lock or allocate.
+    void mix(const juce::AudioBuffer<float> *sources, juce::AudioBuffer<float> &destination) const;
+
+    // Name of the instruction set the kernel was compiled for, for diagnostics
+    const char *getKernelName() const { return kernelName; }
+
+    using Kernel = void (*)(float *destination, const float *const *sources, const float *gains,
+                            int numberOfSources, int numberOfSamples);
+
+private:
+    Kernel kernelFor(int numberOfSources) const;
+
+    // Compacted list of the audible sources and their gains
+    int activeSources[maximumNumberOfSources] = {};
+    float activeLeftGains[maximumNumberOfSources] = {};
+    float activeRightGains[maximumNumberOfSources] = {};
+    int numberOfActiveSources = 0;
+
+    // Kernels specialized for 1..numberOfSpecializedKernels sources, and one for any count
+    static constexpr int numberOfSpecializedKernels = 8;
+    Kernel specializedKernels[numberOfSpecializedKernels + 1] = {};
+    Kernel genericKernel = nullptr;
+    const char *kernelName = "";
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(UnisonMixer)
+};